@@ -0,0 +1,532 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Writes large synthetic gcode files in the style of Slic3r or KISSlicer so
+// the import, geometry and splice paths can be stress tested at production
+// sizes.  The same options and seed always produce the same file.
+//
+// Usage: GCodeGenerator -o <file> [options]
+//
+//    --style slic3r|kiss     The slicer style to mimic (default slic3r).
+//    --layers N              The number of layers (default 500).
+//    --segments N            Extrusion segments per layer (default 2000).
+//    --size-mb N             Keep adding layers until the file reaches N MB,
+//                            this overrides --layers.
+//    --layer-height H        The layer height in mm (default 0.2).
+//    --retract-every N       Retract and travel every N segments, 0 for
+//                            never (default 200).
+//    --retract-length L      The retraction length in mm (default 1.0).
+//    --reset-every N         Reset the extruder with G92 every N layers, 0
+//                            for never (default 1).
+//    --unit-switch-every N   Write every Nth layer in inches (G20) before
+//                            switching back to millimeters, 0 for never
+//                            (default 0).
+//    --comment-density D     The fraction of lines with a comment, from 0
+//                            to 1 (default 0.5).
+//    --center X,Y            The center of the part in mm (default 100,100).
+//    --radius R              The radius of the part in mm (default 30).
+//    --seed N                The random seed (default 1).
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+const static double PI = 3.14159265358979323846;
+const static double MM_PER_INCH = 25.4;
+
+////////////////////////////////////////////////////////////////////////////////
+enum SlicerStyle
+{
+   SLICER_STYLE_SLIC3R,
+   SLICER_STYLE_KISS,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+struct GeneratorOptions
+{
+   GeneratorOptions()
+   {
+      style = SLICER_STYLE_SLIC3R;
+      layerCount = 500;
+      segmentCount = 2000;
+      targetSize = 0;
+      layerHeight = 0.2;
+      retractEvery = 200;
+      retractLength = 1.0;
+      resetEvery = 1;
+      unitSwitchEvery = 0;
+      commentDensity = 0.5;
+      center[0] = 100.0;
+      center[1] = 100.0;
+      radius = 30.0;
+      seed = 1;
+   }
+
+   std::string    fileName;
+   SlicerStyle    style;
+   long long      layerCount;
+   long long      segmentCount;
+   long long      targetSize;
+   double         layerHeight;
+   long long      retractEvery;
+   double         retractLength;
+   long long      resetEvery;
+   long long      unitSwitchEvery;
+   double         commentDensity;
+   double         center[2];
+   double         radius;
+   unsigned int   seed;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * A small deterministic random generator so every platform produces
+ * exactly the same file for the same seed.
+ */
+class Random
+{
+public:
+   Random(unsigned int seed)
+      : mState(seed? seed: 1)
+   {
+   }
+
+   /**
+    * Retrieves a random value between 0 and 1.
+    */
+   double next()
+   {
+      mState ^= mState << 13;
+      mState ^= mState >> 17;
+      mState ^= mState << 5;
+      return (mState & 0xFFFFFF) / (double)0x1000000;
+   }
+
+private:
+   unsigned int mState;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Writes the gcode while keeping track of how many bytes went out.
+ */
+class GCodeWriter
+{
+public:
+   GCodeWriter(FILE* file)
+      : mFile(file)
+      , mBytes(0)
+   {
+   }
+
+   /**
+    * Writes a single formatted line.
+    */
+   void line(const char* format, ...);
+
+   long long getBytes() const
+   {
+      return mBytes;
+   }
+
+private:
+   FILE*       mFile;
+   long long   mBytes;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeWriter::line(const char* format, ...)
+{
+   va_list args;
+   va_start(args, format);
+   int written = vfprintf(mFile, format, args);
+   va_end(args);
+
+   if (written > 0)
+   {
+      mBytes += written;
+   }
+
+   fputc('\n', mFile);
+   mBytes++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+class GCodeGenerator
+{
+public:
+   GCodeGenerator(const GeneratorOptions& options, GCodeWriter& writer)
+      : mOptions(options)
+      , mWriter(writer)
+      , mRandom(options.seed)
+      , mE(0.0)
+      , mUnitScale(1.0)
+   {
+   }
+
+   void generate()
+   {
+      writeHeader();
+
+      for (long long layer = 0; ; ++layer)
+      {
+         if (mOptions.targetSize > 0)
+         {
+            if (mWriter.getBytes() >= mOptions.targetSize)
+            {
+               break;
+            }
+         }
+         else if (layer >= mOptions.layerCount)
+         {
+            break;
+         }
+
+         writeLayer(layer);
+      }
+
+      writeFooter();
+   }
+
+private:
+
+   /**
+    * Retrieves whether the current line should carry a comment.
+    */
+   bool hasComment()
+   {
+      return mRandom.next() < mOptions.commentDensity;
+   }
+
+   /**
+    * Converts a millimeter value into the current unit mode.
+    */
+   double unit(double mm) const
+   {
+      return mm / mUnitScale;
+   }
+
+   void writeHeader()
+   {
+      if (mOptions.style == SLICER_STYLE_SLIC3R)
+      {
+         mWriter.line("; generated by Slic3r 0.8.5-dev (synthetic)");
+         mWriter.line("");
+         mWriter.line("; layer_height = %g", mOptions.layerHeight);
+         mWriter.line("; perimeters = 2");
+         mWriter.line("; nozzle_diameter = 0.35");
+         mWriter.line("; filament_diameter = 1.75");
+         mWriter.line("");
+         mWriter.line("M107 ; disable fan");
+         mWriter.line("M104 S215 ; set temperature");
+         mWriter.line("M109 S215 ; wait for temperature to be reached");
+         mWriter.line("G90 ; use absolute coordinates");
+         mWriter.line("G21 ; set units to millimeters");
+         mWriter.line("G92 E0 ; reset extrusion distance");
+         mWriter.line("M82 ; use absolute distances for extrusion");
+      }
+      else
+      {
+         mWriter.line("; KISSlicer - PRO (synthetic)");
+         mWriter.line(";");
+         mWriter.line("; *** Printer Settings ***");
+         mWriter.line(";");
+         mWriter.line("; num_extruders = 1");
+         mWriter.line("; bed_size_x_mm = 180");
+         mWriter.line("; bed_size_y_mm = 190");
+         mWriter.line(";");
+         mWriter.line("; *** Header ***");
+         mWriter.line(";");
+         mWriter.line("; fan off");
+         mWriter.line("M107");
+         mWriter.line("; [mm] mode");
+         mWriter.line("G21");
+         mWriter.line("; absolute mode");
+         mWriter.line("G90");
+         mWriter.line("; *** Main G-code ***");
+         mWriter.line(";");
+         mWriter.line("; Reset extruder pos");
+         mWriter.line("G92 E0");
+      }
+   }
+
+   void writeFooter()
+   {
+      if (mOptions.style == SLICER_STYLE_SLIC3R)
+      {
+         mWriter.line("M107 ; disable fan");
+         mWriter.line("");
+         mWriter.line("; filament used = %.1fmm", mE);
+      }
+      else
+      {
+         mWriter.line("; fan off");
+         mWriter.line("M107");
+         mWriter.line("; Total estimated (pre-cool) minutes: 0");
+      }
+   }
+
+   void writeLayer(long long layer)
+   {
+      double z = (layer + 1) * mOptions.layerHeight;
+
+      // Some layers are written entirely in inches to exercise unit switching.
+      bool inches = mOptions.unitSwitchEvery > 0 && layer > 0 && layer % mOptions.unitSwitchEvery == 0;
+      if (inches)
+      {
+         mUnitScale = MM_PER_INCH;
+         if (mOptions.style == SLICER_STYLE_SLIC3R)
+         {
+            mWriter.line("G20 ; set units to inches");
+         }
+         else
+         {
+            mWriter.line("; [inch] mode");
+            mWriter.line("G20");
+         }
+      }
+
+      bool reset = mOptions.resetEvery > 0 && layer % mOptions.resetEvery == 0;
+
+      if (mOptions.style == SLICER_STYLE_SLIC3R)
+      {
+         if (reset)
+         {
+            mE = 0.0;
+            mWriter.line("G92 E0 ; reset extrusion distance");
+         }
+         mWriter.line("G1 Z%.3f F1800.000 ; move to next layer (%lld)", unit(z), layer);
+      }
+      else
+      {
+         mWriter.line("; BEGIN_LAYER_OBJECT z=%.2f", z);
+         if (reset)
+         {
+            mE = 0.0;
+            mWriter.line("G92 E0");
+         }
+         mWriter.line(";");
+         mWriter.line("; 'Perimeter', 10.0 [RPM], 5.0 [mm/s]");
+         mWriter.line("G1 F210");
+         mWriter.line("G1 X%.2f Y%.2f Z%.2f E%.4f", unit(mOptions.center[0] + mOptions.radius), unit(mOptions.center[1]), unit(z), unit(mE));
+         mWriter.line("G1 F300.7");
+      }
+
+      // Each layer spirals around the part center with a little noise so
+      // no two segments are quite the same.
+      double phase = mRandom.next() * 2.0 * PI;
+      for (long long segment = 0; segment < mOptions.segmentCount; ++segment)
+      {
+         if (mOptions.retractEvery > 0 && segment > 0 && segment % mOptions.retractEvery == 0)
+         {
+            writeRetraction(phase + segment * 0.01);
+         }
+
+         double angle = phase + segment * 2.0 * PI / 360.0;
+         double radius = mOptions.radius * (0.5 + 0.5 * (double)(segment % 360) / 360.0) + mRandom.next() * 0.05;
+         double x = mOptions.center[0] + radius * cos(angle);
+         double y = mOptions.center[1] + radius * sin(angle);
+
+         mE += 0.02 + mRandom.next() * 0.01;
+
+         if (mOptions.style == SLICER_STYLE_SLIC3R)
+         {
+            if (hasComment())
+            {
+               mWriter.line("G1 X%.3f Y%.3f E%.5f ; perimeter", unit(x), unit(y), unit(mE));
+            }
+            else
+            {
+               mWriter.line("G1 X%.3f Y%.3f E%.5f", unit(x), unit(y), unit(mE));
+            }
+         }
+         else
+         {
+            if (hasComment())
+            {
+               mWriter.line(";");
+               mWriter.line("; 'Loop', 10.0 [RPM], 5.0 [mm/s]");
+            }
+            mWriter.line("G1 X%.2f Y%.2f E%.4f", unit(x), unit(y), unit(mE));
+         }
+      }
+
+      if (mOptions.style == SLICER_STYLE_KISS)
+      {
+         mWriter.line("; END_LAYER_OBJECT z=%.2f", z);
+         if (mOptions.resetEvery > 0 && (layer + 1) % mOptions.resetEvery == 0)
+         {
+            mWriter.line("; Reset extruder pos");
+         }
+      }
+
+      if (inches)
+      {
+         mUnitScale = 1.0;
+         if (mOptions.style == SLICER_STYLE_SLIC3R)
+         {
+            mWriter.line("G21 ; set units to millimeters");
+         }
+         else
+         {
+            mWriter.line("; [mm] mode");
+            mWriter.line("G21");
+         }
+      }
+   }
+
+   /**
+    * Retracts, travels to a new spot in the layer, and primes again.
+    */
+   void writeRetraction(double angle)
+   {
+      double x = mOptions.center[0] + mOptions.radius * cos(angle);
+      double y = mOptions.center[1] + mOptions.radius * sin(angle);
+
+      if (mOptions.style == SLICER_STYLE_SLIC3R)
+      {
+         mWriter.line("G1 F1800.000 E%.5f ; retract", unit(mE - mOptions.retractLength));
+         mWriter.line("G1 X%.3f Y%.3f F7800.000 ; move to first perimeter point", unit(x), unit(y));
+         mWriter.line("G1 F1800.000 E%.5f ; compensate retraction", unit(mE));
+         mWriter.line("G1 F600.000");
+      }
+      else
+      {
+         mWriter.line("G1 F1800");
+         mWriter.line("G1 E%.4f", unit(mE - mOptions.retractLength));
+         mWriter.line("G1 F5400");
+         mWriter.line("G1 X%.2f Y%.2f E%.4f", unit(x), unit(y), unit(mE - mOptions.retractLength));
+         mWriter.line("G1 F1800");
+         mWriter.line("G1 E%.4f", unit(mE));
+         mWriter.line("G1 F300.7");
+      }
+   }
+
+   const GeneratorOptions& mOptions;
+   GCodeWriter&            mWriter;
+   Random                  mRandom;
+
+   double                  mE;
+   double                  mUnitScale;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+void printUsage()
+{
+   fprintf(stderr,
+      "Usage: GCodeGenerator -o <file> [--style slic3r|kiss] [--layers N] [--segments N]\n"
+      "                      [--size-mb N] [--layer-height H] [--retract-every N]\n"
+      "                      [--retract-length L] [--reset-every N] [--unit-switch-every N]\n"
+      "                      [--comment-density D] [--center X,Y] [--radius R] [--seed N]\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+   GeneratorOptions options;
+
+   for (int argIndex = 1; argIndex < argc; ++argIndex)
+   {
+      const char* arg = argv[argIndex];
+      const char* value = argIndex + 1 < argc? argv[argIndex + 1]: NULL;
+
+      if (!value)
+      {
+         printUsage();
+         return 1;
+      }
+
+      if (!strcmp(arg, "-o"))                        options.fileName = value;
+      else if (!strcmp(arg, "--style"))
+      {
+         if (!strcmp(value, "slic3r"))               options.style = SLICER_STYLE_SLIC3R;
+         else if (!strcmp(value, "kiss"))            options.style = SLICER_STYLE_KISS;
+         else
+         {
+            printUsage();
+            return 1;
+         }
+      }
+      else if (!strcmp(arg, "--layers"))             options.layerCount = atoll(value);
+      else if (!strcmp(arg, "--segments"))           options.segmentCount = atoll(value);
+      else if (!strcmp(arg, "--size-mb"))            options.targetSize = atoll(value) * 1024 * 1024;
+      else if (!strcmp(arg, "--layer-height"))       options.layerHeight = atof(value);
+      else if (!strcmp(arg, "--retract-every"))      options.retractEvery = atoll(value);
+      else if (!strcmp(arg, "--retract-length"))     options.retractLength = atof(value);
+      else if (!strcmp(arg, "--reset-every"))        options.resetEvery = atoll(value);
+      else if (!strcmp(arg, "--unit-switch-every"))  options.unitSwitchEvery = atoll(value);
+      else if (!strcmp(arg, "--comment-density"))    options.commentDensity = atof(value);
+      else if (!strcmp(arg, "--radius"))             options.radius = atof(value);
+      else if (!strcmp(arg, "--seed"))               options.seed = (unsigned int)atoll(value);
+      else if (!strcmp(arg, "--center"))
+      {
+         if (sscanf(value, "%lf,%lf", &options.center[0], &options.center[1]) != 2)
+         {
+            printUsage();
+            return 1;
+         }
+      }
+      else
+      {
+         printUsage();
+         return 1;
+      }
+
+      argIndex++;
+   }
+
+   if (options.fileName.empty() || options.layerHeight <= 0.0 || options.segmentCount < 0)
+   {
+      printUsage();
+      return 1;
+   }
+
+   FILE* file = fopen(options.fileName.c_str(), "wb");
+   if (!file)
+   {
+      fprintf(stderr, "Failed to open '%s' for writing.\n", options.fileName.c_str());
+      return 1;
+   }
+
+   // Large buffered writes, these files can get into the gigabytes.
+   setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+   GCodeWriter writer(file);
+   GCodeGenerator generator(options, writer);
+   generator.generate();
+
+   bool success = !ferror(file);
+   fclose(file);
+
+   if (!success)
+   {
+      fprintf(stderr, "Failed to write '%s'.\n", options.fileName.c_str());
+      return 1;
+   }
+
+   printf("Wrote %lld bytes to '%s'.\n", writer.getBytes(), options.fileName.c_str());
+   return 0;
+}
@@ -0,0 +1,561 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Measures the throughput of the gcode parser hot path and of a full
+// GCodeObject::loadFile over a set of gcode files.
+//
+// Usage: ParserBenchmark [files...] [--repeat N] [--synthetic-lines N]
+//                        [--save-baseline file] [--baseline file] [--tolerance percent]
+//
+// Without any files the two sample files in the test folder are used along
+// with a synthetic file.  When comparing against a baseline, the exit code
+// is 2 if any benchmark became slower than the given tolerance.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <GCodeObject.h>
+#include <GCodeParser.h>
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QStringList>
+#include <QTemporaryFile>
+
+#include <new>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Allocation counting.  On glibc we interpose the malloc family itself since
+// Qt containers allocate through malloc rather than operator new, everywhere
+// else we can only see what goes through operator new.
+static unsigned long long gAllocationCount = 0;
+
+#if defined(__GLIBC__)
+extern "C"
+{
+   void* __libc_malloc(size_t size);
+   void* __libc_calloc(size_t count, size_t size);
+   void* __libc_realloc(void* ptr, size_t size);
+
+   void* malloc(size_t size)
+   {
+      gAllocationCount++;
+      return __libc_malloc(size);
+   }
+
+   void* calloc(size_t count, size_t size)
+   {
+      gAllocationCount++;
+      return __libc_calloc(count, size);
+   }
+
+   void* realloc(void* ptr, size_t size)
+   {
+      gAllocationCount++;
+      return __libc_realloc(ptr, size);
+   }
+}
+#else
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+   gAllocationCount++;
+   void* ptr = malloc(size);
+   if (!ptr)
+   {
+      throw std::bad_alloc();
+   }
+   return ptr;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+   return operator new(size);
+}
+
+void operator delete(void* ptr) throw()
+{
+   free(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+   free(ptr);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+struct BenchmarkResult
+{
+   QString name;
+   qint64 lines;
+   qint64 bytes;
+   double seconds;
+   unsigned long long allocations;
+
+   double getLinesPerSecond() const
+   {
+      return seconds > 0.0? lines / seconds: 0.0;
+   }
+
+   double getMegabytesPerSecond() const
+   {
+      return seconds > 0.0? (bytes / (1024.0 * 1024.0)) / seconds: 0.0;
+   }
+
+   double getAllocationsPerLine() const
+   {
+      return lines > 0? (double)allocations / lines: 0.0;
+   }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Each pass reads an entire file once and returns the number of lines read.
+typedef qint64 (*BenchmarkPass)(const QString& fileName);
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passParseNext(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passReadAhead(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.setReadAhead(true);
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passCodeSeen(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+
+      // These are the codes GCodeObject looks for on every line.
+      parser.codeSeen("G");
+      parser.codeSeen("M");
+      parser.codeSeen("X");
+      parser.codeSeen("Y");
+      parser.codeSeen("Z");
+      parser.codeSeen("E");
+      parser.codeSeen("F");
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passCodeValue(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+
+      if (parser.codeSeen("X"))
+      {
+         parser.codeValue();
+      }
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passCodeValueInt(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+
+      if (parser.codeSeen("G"))
+      {
+         parser.codeValueInt();
+      }
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passCodeValueLong(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+
+      if (parser.codeSeen("G"))
+      {
+         parser.codeValueLong();
+      }
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passCodeValueDouble(const QString& fileName)
+{
+   GCodeParser parser;
+   parser.loadFile(fileName);
+
+   qint64 lines = 0;
+   while (parser.parseNext())
+   {
+      lines++;
+
+      if (parser.codeSeen("X"))
+      {
+         parser.codeValueDouble();
+      }
+   }
+
+   return lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 passLoadFile(const QString& fileName)
+{
+   PreferenceData prefs;
+   GCodeObject object(prefs);
+   object.loadFile(fileName);
+
+   // The object does not keep a line count, so the caller fills it in.
+   return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Runs a single pass over a file several times and keeps the fastest run.
+ */
+BenchmarkResult runBenchmark(const QString& name, const QString& label, const QString& fileName, BenchmarkPass pass, qint64 lineCount, int repeat)
+{
+   BenchmarkResult result;
+   result.name = label + "/" + name;
+   result.lines = lineCount;
+   result.bytes = QFileInfo(fileName).size();
+   result.seconds = 0.0;
+   result.allocations = 0;
+
+   for (int run = 0; run < repeat; ++run)
+   {
+      unsigned long long allocations = gAllocationCount;
+
+      QElapsedTimer timer;
+      timer.start();
+
+      qint64 lines = pass(fileName);
+
+      double seconds = timer.nsecsElapsed() / 1000000000.0;
+      allocations = gAllocationCount - allocations;
+
+      if (lines >= 0)
+      {
+         result.lines = lines;
+      }
+
+      if (run == 0 || seconds < result.seconds)
+      {
+         result.seconds = seconds;
+         result.allocations = allocations;
+      }
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Writes a synthetic gcode file in the style of a typical slicer output.
+ *
+ * @param[in]  file       The file to write into.
+ * @param[in]  lineCount  The number of lines to write.
+ */
+void writeSyntheticFile(QFile& file, qint64 lineCount)
+{
+   const int LINES_PER_LAYER = 500;
+
+   file.write("; generated by ParserBenchmark\n");
+   file.write("G21 ; set units to millimeters\n");
+   file.write("G90 ; use absolute coordinates\n");
+   file.write("M82 ; use absolute distances for extrusion\n");
+
+   double e = 0.0;
+   double z = 0.0;
+   for (qint64 line = 0; line < lineCount; ++line)
+   {
+      QByteArray text;
+      if (line % LINES_PER_LAYER == 0)
+      {
+         z += 0.2;
+         e = 0.0;
+         text = "G92 E0\nG1 Z" + QByteArray::number(z, 'f', 3) + " F7800.000\n";
+      }
+      else
+      {
+         double angle = (line % LINES_PER_LAYER) * 0.05;
+         e += 0.02;
+         text = "G1 X" + QByteArray::number(100.0 + 30.0 * cos(angle), 'f', 3) +
+                " Y" + QByteArray::number(100.0 + 30.0 * sin(angle), 'f', 3) +
+                " E" + QByteArray::number(e, 'f', 5);
+
+         if (line % 10 == 0)
+         {
+            text += " F1800.000 ; perimeter";
+         }
+         text += "\n";
+      }
+
+      file.write(text);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool loadBaseline(const QString& fileName, QMap<QString, double>& baseline)
+{
+   QFile file(fileName);
+   if (!file.open(QIODevice::ReadOnly))
+   {
+      return false;
+   }
+
+   while (!file.atEnd())
+   {
+      QString line = QString(file.readLine()).trimmed();
+      int split = line.lastIndexOf(": ");
+      if (split > 0)
+      {
+         baseline[line.left(split)] = line.mid(split + 2).toDouble();
+      }
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool saveBaseline(const QString& fileName, const QList<BenchmarkResult>& results)
+{
+   QFile file(fileName);
+   if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+   {
+      return false;
+   }
+
+   for (int index = 0; index < results.size(); ++index)
+   {
+      file.write(results[index].name.toAscii());
+      file.write(": ");
+      file.write(QByteArray::number(results[index].getLinesPerSecond(), 'f', 0));
+      file.write("\n");
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+   // Loading a full object shows a progress dialog, so we need a gui application.
+   QApplication app(argc, argv);
+
+   QStringList files;
+   QStringList labels;
+   int repeat = 3;
+   qint64 syntheticLines = 1000000;
+   QString saveBaselineFile;
+   QString baselineFile;
+   double tolerance = 10.0;
+
+   QStringList args = app.arguments();
+   for (int argIndex = 1; argIndex < args.size(); ++argIndex)
+   {
+      const QString& arg = args[argIndex];
+      bool hasValue = argIndex + 1 < args.size();
+
+      if (arg == "--repeat" && hasValue)
+      {
+         repeat = qMax(1, args[++argIndex].toInt());
+      }
+      else if (arg == "--synthetic-lines" && hasValue)
+      {
+         syntheticLines = args[++argIndex].toLongLong();
+      }
+      else if (arg == "--save-baseline" && hasValue)
+      {
+         saveBaselineFile = args[++argIndex];
+      }
+      else if (arg == "--baseline" && hasValue)
+      {
+         baselineFile = args[++argIndex];
+      }
+      else if (arg == "--tolerance" && hasValue)
+      {
+         tolerance = args[++argIndex].toDouble();
+      }
+      else
+      {
+         files.append(arg);
+         labels.append(QFileInfo(arg).fileName());
+      }
+   }
+
+   if (files.isEmpty())
+   {
+      files.append(QString(LOCHEGSPLICER_TEST_PATH) + "/Simple.Slic3r.gcode");
+      files.append(QString(LOCHEGSPLICER_TEST_PATH) + "/Simple.KISS.gcode");
+      labels.append("Simple.Slic3r.gcode");
+      labels.append("Simple.KISS.gcode");
+   }
+
+   QTemporaryFile syntheticFile(QDir::tempPath() + "/ParserBenchmark.XXXXXX.gcode");
+   if (syntheticLines > 0 && syntheticFile.open())
+   {
+      writeSyntheticFile(syntheticFile, syntheticLines);
+      syntheticFile.close();
+      files.append(syntheticFile.fileName());
+
+      // The temporary name changes every run, so name it by its size instead.
+      labels.append(QString("Synthetic.%1.gcode").arg(syntheticLines));
+   }
+
+   QList<BenchmarkResult> results;
+   printf("%-40s %14s %10s %12s\n", "Benchmark", "Lines/s", "MB/s", "Allocs/line");
+
+   for (int fileIndex = 0; fileIndex < files.size(); ++fileIndex)
+   {
+      const QString& fileName = files[fileIndex];
+      const QString& label = labels[fileIndex];
+      if (!QFile::exists(fileName))
+      {
+         fprintf(stderr, "File '%s' does not exist.\n", fileName.toAscii().constData());
+         return 1;
+      }
+
+      // Count the lines once so the full load can report its throughput.
+      qint64 lineCount = passParseNext(fileName);
+
+      QList<BenchmarkResult> fileResults;
+      fileResults.append(runBenchmark("parseNext",       label, fileName, passParseNext,       lineCount, repeat));
+      fileResults.append(runBenchmark("readAhead",       label, fileName, passReadAhead,       lineCount, repeat));
+      fileResults.append(runBenchmark("codeSeen",        label, fileName, passCodeSeen,        lineCount, repeat));
+      fileResults.append(runBenchmark("codeValue",       label, fileName, passCodeValue,       lineCount, repeat));
+      fileResults.append(runBenchmark("codeValueInt",    label, fileName, passCodeValueInt,    lineCount, repeat));
+      fileResults.append(runBenchmark("codeValueLong",   label, fileName, passCodeValueLong,   lineCount, repeat));
+      fileResults.append(runBenchmark("codeValueDouble", label, fileName, passCodeValueDouble, lineCount, repeat));
+      fileResults.append(runBenchmark("loadFile",        label, fileName, passLoadFile,        lineCount, repeat));
+
+      for (int index = 0; index < fileResults.size(); ++index)
+      {
+         const BenchmarkResult& result = fileResults[index];
+         printf("%-40s %14.0f %10.2f %12.2f\n",
+            result.name.toAscii().constData(),
+            result.getLinesPerSecond(),
+            result.getMegabytesPerSecond(),
+            result.getAllocationsPerLine());
+      }
+
+      results.append(fileResults);
+   }
+
+   if (!saveBaselineFile.isEmpty() && !saveBaseline(saveBaselineFile, results))
+   {
+      fprintf(stderr, "Failed to write baseline '%s'.\n", saveBaselineFile.toAscii().constData());
+      return 1;
+   }
+
+   int exitCode = 0;
+   if (!baselineFile.isEmpty())
+   {
+      QMap<QString, double> baseline;
+      if (!loadBaseline(baselineFile, baseline))
+      {
+         fprintf(stderr, "Failed to read baseline '%s'.\n", baselineFile.toAscii().constData());
+         return 1;
+      }
+
+      printf("\n%-40s %14s %14s %10s\n", "Benchmark", "Baseline", "Current", "Change");
+      for (int index = 0; index < results.size(); ++index)
+      {
+         const BenchmarkResult& result = results[index];
+         if (!baseline.contains(result.name) || baseline[result.name] <= 0.0)
+         {
+            continue;
+         }
+
+         double previous = baseline[result.name];
+         double change = (result.getLinesPerSecond() - previous) / previous * 100.0;
+         bool regressed = change < -tolerance;
+
+         printf("%-40s %14.0f %14.0f %+9.1f%%%s\n",
+            result.name.toAscii().constData(),
+            previous,
+            result.getLinesPerSecond(),
+            change,
+            regressed? " REGRESSED": "");
+
+         if (regressed)
+         {
+            exitCode = 2;
+         }
+      }
+   }
+
+   return exitCode;
+}
@@ -0,0 +1,387 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Measures the whole production path, importing a set of gcode files,
+// building their visualizer geometry and splicing them for 2 to 4 extruders,
+// and reports the results as JSON.
+//
+// Usage: PipelineBenchmark <files...> [--extruders 2,3,4] [--quality low|med|high]
+//                          [--no-geometry] [--output file.json]
+//
+// Building geometry needs an OpenGL context, so either run it through
+// xvfb-run or pass --no-geometry to run without any display at all.  Set
+// LOCHEGSPLICER_TRACE to a file name to also record a trace of the run.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <GCodeObject.h>
+#include <GCodeSplicer.h>
+#include <Trace.h>
+#include <VisualizerView.h>
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTemporaryFile>
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Retrieves the peak resident memory of this process, in bytes.
+ */
+unsigned long long getPeakMemory()
+{
+#if defined(_WIN32)
+   PROCESS_MEMORY_COUNTERS counters;
+   if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+   {
+      return counters.PeakWorkingSetSize;
+   }
+   return 0;
+#else
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) == 0)
+   {
+#if defined(__APPLE__)
+      return usage.ru_maxrss;
+#else
+      return (unsigned long long)usage.ru_maxrss * 1024;
+#endif
+   }
+   return 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+struct PhaseResult
+{
+   QString name;
+   double seconds;
+   unsigned long long peakMemory;
+   qint64 inputBytes;
+   qint64 outputBytes;
+   int extruders;
+   bool success;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+QString escapeJson(const QString& text)
+{
+   QString result = text;
+   result.replace("\\", "\\\\");
+   result.replace("\"", "\\\"");
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+QByteArray toJson(const QStringList& files, const QList<PhaseResult>& phases)
+{
+   QByteArray json;
+   json += "{\n";
+   json += "  \"files\": [";
+   for (int index = 0; index < files.size(); ++index)
+   {
+      if (index > 0) json += ", ";
+      json += "\"" + escapeJson(files[index]).toUtf8() + "\"";
+   }
+   json += "],\n";
+
+   json += "  \"phases\": [\n";
+   for (int index = 0; index < phases.size(); ++index)
+   {
+      const PhaseResult& phase = phases[index];
+      json += "    {";
+      json += "\"name\": \"" + escapeJson(phase.name).toUtf8() + "\", ";
+      json += "\"success\": " + QByteArray(phase.success? "true": "false") + ", ";
+      if (phase.extruders > 0)
+      {
+         json += "\"extruders\": " + QByteArray::number(phase.extruders) + ", ";
+      }
+      json += "\"seconds\": " + QByteArray::number(phase.seconds, 'f', 6) + ", ";
+      json += "\"peak_rss_bytes\": " + QByteArray::number(phase.peakMemory);
+      if (phase.inputBytes > 0)
+      {
+         json += ", \"input_bytes\": " + QByteArray::number(phase.inputBytes);
+         json += ", \"input_bytes_per_second\": " + QByteArray::number(phase.seconds > 0.0? phase.inputBytes / phase.seconds: 0.0, 'f', 0);
+      }
+      if (phase.outputBytes > 0)
+      {
+         json += ", \"output_bytes\": " + QByteArray::number(phase.outputBytes);
+         json += ", \"output_bytes_per_second\": " + QByteArray::number(phase.seconds > 0.0? phase.outputBytes / phase.seconds: 0.0, 'f', 0);
+      }
+      json += "}";
+      if (index + 1 < phases.size()) json += ",";
+      json += "\n";
+   }
+   json += "  ],\n";
+
+   json += "  \"peak_rss_bytes\": " + QByteArray::number(getPeakMemory()) + "\n";
+   json += "}\n";
+   return json;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+   bool buildGeometry = true;
+   for (int argIndex = 1; argIndex < argc; ++argIndex)
+   {
+      if (QString(argv[argIndex]) == "--no-geometry")
+      {
+         buildGeometry = false;
+      }
+   }
+
+   // Without geometry we run as a plain console application so no display is needed.
+   QApplication app(argc, argv, buildGeometry);
+
+   QStringList files;
+   QList<int> extruderCounts;
+   DrawQuality quality = DRAW_QUALITY_MED;
+   QString outputFile;
+
+   QStringList args = app.arguments();
+   for (int argIndex = 1; argIndex < args.size(); ++argIndex)
+   {
+      const QString& arg = args[argIndex];
+      bool hasValue = argIndex + 1 < args.size();
+
+      if (arg == "--no-geometry")
+      {
+         continue;
+      }
+      else if (arg == "--extruders" && hasValue)
+      {
+         QStringList counts = args[++argIndex].split(',');
+         for (int index = 0; index < counts.size(); ++index)
+         {
+            int count = counts[index].toInt();
+            if (count > 0)
+            {
+               extruderCounts.append(count);
+            }
+         }
+      }
+      else if (arg == "--quality" && hasValue)
+      {
+         QString value = args[++argIndex];
+         if (value == "low")       quality = DRAW_QUALITY_LOW;
+         else if (value == "high") quality = DRAW_QUALITY_HIGH;
+         else                      quality = DRAW_QUALITY_MED;
+      }
+      else if (arg == "--output" && hasValue)
+      {
+         outputFile = args[++argIndex];
+      }
+      else
+      {
+         files.append(arg);
+      }
+   }
+
+   if (files.isEmpty())
+   {
+      fprintf(stderr, "Usage: PipelineBenchmark <files...> [--extruders 2,3,4] [--quality low|med|high] [--no-geometry] [--output file.json]\n");
+      return 1;
+   }
+
+   if (extruderCounts.isEmpty())
+   {
+      extruderCounts << 2 << 3 << 4;
+   }
+
+   int maxExtruders = 0;
+   for (int index = 0; index < extruderCounts.size(); ++index)
+   {
+      maxExtruders = qMax(maxExtruders, extruderCounts[index]);
+   }
+
+   QString traceFile = QString::fromLocal8Bit(qgetenv("LOCHEGSPLICER_TRACE"));
+   if (!traceFile.isEmpty())
+   {
+      Trace::start(traceFile);
+   }
+
+   PreferenceData prefs;
+   prefs.drawQuality = quality;
+   prefs.useDisplayLists = false;
+
+   QList<PhaseResult> phases;
+
+   //// Import.
+   // Every extruder needs at least one object of its own, so we cycle
+   // through the given files until we have enough of them.
+   int objectCount = qMax(files.size(), maxExtruders);
+   QList<GCodeObject*> objects;
+   {
+      PhaseResult phase;
+      phase.name = "import";
+      phase.extruders = 0;
+      phase.inputBytes = 0;
+      phase.outputBytes = 0;
+      phase.success = true;
+
+      QElapsedTimer timer;
+      timer.start();
+
+      for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+      {
+         const QString& fileName = files[objectIndex % files.size()];
+
+         GCodeObject* object = new GCodeObject(prefs);
+         objects.append(object);
+
+         if (!object->loadFile(fileName))
+         {
+            fprintf(stderr, "Failed to load '%s': %s\n", fileName.toAscii().constData(), object->getError().toAscii().constData());
+            phase.success = false;
+            break;
+         }
+
+         phase.inputBytes += QFileInfo(fileName).size();
+      }
+
+      phase.seconds = timer.nsecsElapsed() / 1000000000.0;
+      phase.peakMemory = getPeakMemory();
+      phases.append(phase);
+   }
+
+   //// Geometry.
+   VisualizerView* view = NULL;
+   if (buildGeometry && phases.back().success)
+   {
+      PhaseResult phase;
+      phase.name = "geometry";
+      phase.extruders = 0;
+      phase.inputBytes = 0;
+      phase.outputBytes = 0;
+      phase.success = true;
+
+      view = new VisualizerView(prefs);
+      view->show();
+      app.processEvents();
+      view->makeCurrent();
+
+      QElapsedTimer timer;
+      timer.start();
+
+      for (int objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+      {
+         if (!view->addObject(objects[objectIndex]))
+         {
+            fprintf(stderr, "Failed to build geometry: %s\n", view->getError().toAscii().constData());
+            phase.success = false;
+            break;
+         }
+      }
+
+      phase.seconds = timer.nsecsElapsed() / 1000000000.0;
+      phase.peakMemory = getPeakMemory();
+      phases.append(phase);
+   }
+
+   //// Splice.
+   for (int countIndex = 0; countIndex < extruderCounts.size() && phases.back().success; ++countIndex)
+   {
+      int extruderCount = extruderCounts[countIndex];
+
+      PhaseResult phase;
+      phase.name = "splice";
+      phase.extruders = extruderCount;
+      phase.inputBytes = 0;
+      phase.outputBytes = 0;
+      phase.success = true;
+
+      // Setup as many extruders as we need, spaced out along X.
+      while ((int)prefs.extruderList.size() < extruderCount)
+      {
+         ExtruderData extruder;
+         extruder.offset[X] = 20.0 * prefs.extruderList.size();
+         prefs.extruderList.push_back(extruder);
+      }
+      prefs.extruderList.resize(extruderCount);
+
+      GCodeSplicer splicer(prefs);
+      for (int objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+      {
+         objects[objectIndex]->setExtruder(objectIndex % extruderCount);
+         splicer.addObject(objects[objectIndex]);
+      }
+
+      QTemporaryFile outputGCode(QDir::tempPath() + "/PipelineBenchmark.XXXXXX.gcode");
+      outputGCode.open();
+      QString outputName = outputGCode.fileName();
+      outputGCode.close();
+
+      QElapsedTimer timer;
+      timer.start();
+
+      if (!splicer.build(outputName, NULL))
+      {
+         fprintf(stderr, "Failed to splice: %s\n", splicer.getError().toAscii().constData());
+         phase.success = false;
+      }
+
+      phase.seconds = timer.nsecsElapsed() / 1000000000.0;
+      phase.peakMemory = getPeakMemory();
+      phase.outputBytes = QFileInfo(outputName).size();
+      phases.append(phase);
+   }
+
+   QByteArray json = toJson(files, phases);
+   if (outputFile.isEmpty())
+   {
+      fwrite(json.constData(), 1, json.size(), stdout);
+   }
+   else
+   {
+      QFile file(outputFile);
+      if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+      {
+         fprintf(stderr, "Failed to write '%s'.\n", outputFile.toAscii().constData());
+         return 1;
+      }
+      file.write(json);
+   }
+
+   bool success = true;
+   for (int index = 0; index < phases.size(); ++index)
+   {
+      success &= phases[index].success;
+   }
+
+   delete view;
+   qDeleteAll(objects);
+
+   Trace::stop();
+
+   return success? 0: 1;
+}
@@ -0,0 +1,256 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Builds the visualizer geometry of a gcode file at every draw quality and
+// renders scripted camera paths into an offscreen framebuffer.
+//
+// Usage: VisualizerBenchmark <file.gcode> [--frames N] [--size WxH] [--display-lists]
+//
+// Intended to be run headless, for example:
+//    LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -s "-screen 0 1024x768x24" VisualizerBenchmark test/Simple.Slic3r.gcode
+////////////////////////////////////////////////////////////////////////////////
+
+#include <GCodeObject.h>
+#include <VisualizerView.h>
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QGLFramebufferObject>
+#include <QStringList>
+
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////
+const static char* QUALITY_NAMES[DRAW_QUALITY_NUM] = {"Low", "Medium", "High"};
+
+////////////////////////////////////////////////////////////////////////////////
+enum CameraPath
+{
+   CAMERA_PATH_ORBIT = 0,
+   CAMERA_PATH_ZOOM,
+   CAMERA_PATH_LAYER_SCRUB,
+
+   CAMERA_PATH_NUM,
+};
+
+const static char* CAMERA_PATH_NAMES[CAMERA_PATH_NUM] = {"Orbit", "Zoom", "Layer Scrub"};
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Positions the camera for a single frame along a scripted path.
+ *
+ * @param[in]  view       The visualizer.
+ * @param[in]  object     The object being rendered.
+ * @param[in]  path       The camera path.
+ * @param[in]  progress   How far along the path we are, from 0 to 1.
+ */
+void applyCameraPath(VisualizerView& view, const GCodeObject& object, CameraPath path, double progress)
+{
+   // Reset everything back to the default view first.
+   view.setXRotation(-45.0);
+   view.setZRotation(25.0);
+   view.setZoom(-300.0);
+   view.setLayerDrawHeight(object.getMaxBounds()[Z]);
+
+   switch (path)
+   {
+   case CAMERA_PATH_ORBIT:
+      view.setZRotation(25.0 + progress * 360.0);
+      break;
+
+   case CAMERA_PATH_ZOOM:
+      view.setZoom(-300.0 + progress * 250.0);
+      break;
+
+   case CAMERA_PATH_LAYER_SCRUB:
+      view.setLayerDrawHeight(object.getMinBounds()[Z] + progress * (object.getMaxBounds()[Z] - object.getMinBounds()[Z]));
+      break;
+
+   default:
+      break;
+   }
+
+   view.snapCamera();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Retrieves a percentile from a sorted list of frame times.
+ */
+double getPercentile(const std::vector<double>& sortedTimes, double percentile)
+{
+   if (sortedTimes.empty())
+   {
+      return 0.0;
+   }
+
+   int index = (int)(percentile * (sortedTimes.size() - 1) + 0.5);
+   return sortedTimes[index];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+   QApplication app(argc, argv);
+
+   QString fileName;
+   int frameCount = 240;
+   int width = 1024;
+   int height = 768;
+   bool useDisplayLists = false;
+
+   QStringList args = app.arguments();
+   for (int argIndex = 1; argIndex < args.size(); ++argIndex)
+   {
+      const QString& arg = args[argIndex];
+      if (arg == "--frames" && argIndex + 1 < args.size())
+      {
+         frameCount = args[++argIndex].toInt();
+      }
+      else if (arg == "--size" && argIndex + 1 < args.size())
+      {
+         QStringList size = args[++argIndex].split('x');
+         if (size.size() == 2)
+         {
+            width = size[0].toInt();
+            height = size[1].toInt();
+         }
+      }
+      else if (arg == "--display-lists")
+      {
+         useDisplayLists = true;
+      }
+      else
+      {
+         fileName = arg;
+      }
+   }
+
+   if (fileName.isEmpty() || frameCount <= 0 || width <= 0 || height <= 0)
+   {
+      fprintf(stderr, "Usage: VisualizerBenchmark <file.gcode> [--frames N] [--size WxH] [--display-lists]\n");
+      return 1;
+   }
+
+   PreferenceData prefs;
+   prefs.useDisplayLists = useDisplayLists;
+
+   // Keep every quality around so we can report the memory of each one.
+   prefs.geometryCacheSize = 1024 * 1024;
+
+   GCodeObject object(prefs);
+   if (!object.loadFile(fileName))
+   {
+      fprintf(stderr, "Failed to load '%s': %s\n", fileName.toAscii().constData(), object.getError().toAscii().constData());
+      return 1;
+   }
+
+   // The view still needs a native window for its context, but every
+   // frame is rendered into our own framebuffer object instead.
+   VisualizerView view(prefs);
+   view.resize(width, height);
+   view.show();
+   app.processEvents();
+   view.setUpdatesEnabled(false);
+   view.makeCurrent();
+
+   if (!QGLFramebufferObject::hasOpenGLFramebufferObjects())
+   {
+      fprintf(stderr, "Framebuffer objects are not supported by this OpenGL implementation.\n");
+      return 1;
+   }
+
+   QGLFramebufferObject framebuffer(width, height, QGLFramebufferObject::Depth);
+
+   printf("File: %s (%d layers)\n", fileName.toAscii().constData(), object.getLayerCount());
+   printf("Frames: %d per path at %dx%d, display lists %s\n\n", frameCount, width, height, useDisplayLists? "on": "off");
+   printf("%-8s %-12s %10s %10s %10s %10s %10s %10s\n", "Quality", "Path", "Build ms", "Memory MB", "p50 ms", "p90 ms", "p99 ms", "Max ms");
+
+   // We go from low to high quality so the low quality geometry used while
+   // the camera moves is already built, and only counted once.
+   for (int quality = 0; quality < DRAW_QUALITY_NUM; ++quality)
+   {
+      prefs.drawQuality = (DrawQuality)quality;
+
+      QElapsedTimer buildTimer;
+      buildTimer.start();
+
+      bool built = false;
+      if (quality == 0)
+      {
+         built = view.addObject(&object);
+      }
+      else
+      {
+         built = view.prepareGeometry();
+      }
+
+      qint64 buildTime = buildTimer.elapsed();
+
+      if (!built)
+      {
+         fprintf(stderr, "Failed to build geometry: %s\n", view.getError().toAscii().constData());
+         return 1;
+      }
+
+      double memory = view.getGeometryMemoryUsage(prefs.drawQuality) / (1024.0 * 1024.0);
+
+      view.makeCurrent();
+      framebuffer.bind();
+
+      for (int path = 0; path < CAMERA_PATH_NUM; ++path)
+      {
+         std::vector<double> frameTimes;
+         frameTimes.reserve(frameCount);
+
+         for (int frame = 0; frame < frameCount; ++frame)
+         {
+            applyCameraPath(view, object, (CameraPath)path, frameCount > 1? (double)frame / (frameCount - 1): 0.0);
+
+            QElapsedTimer frameTimer;
+            frameTimer.start();
+
+            view.renderFrame();
+
+            frameTimes.push_back(frameTimer.nsecsElapsed() / 1000000.0);
+         }
+
+         std::sort(frameTimes.begin(), frameTimes.end());
+
+         printf("%-8s %-12s %10lld %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+            QUALITY_NAMES[quality],
+            CAMERA_PATH_NAMES[path],
+            path == 0? (long long)buildTime: 0LL,
+            memory,
+            getPercentile(frameTimes, 0.50),
+            getPercentile(frameTimes, 0.90),
+            getPercentile(frameTimes, 0.99),
+            frameTimes.back());
+      }
+
+      framebuffer.release();
+   }
+
+   view.clearObjects();
+   return 0;
+}
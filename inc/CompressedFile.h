@@ -0,0 +1,72 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef COMPRESSED_FILE_H
+#define COMPRESSED_FILE_H
+
+#include <QFile>
+
+struct z_stream_s;
+
+
+/**
+ * A file that can gzip compress everything written to it as it is written,
+ * so it can be used anywhere a plain file is written to.
+ *
+ * Each time the file is opened for writing a new gzip member is started,
+ * which lets a compressed file be appended to.  Reading compressed files
+ * is handled by the GCodeParser.
+ */
+class CompressedFile : public QFile
+{
+public:
+   CompressedFile();
+   virtual ~CompressedFile();
+
+   /**
+    * Sets whether the file is compressed the next time it is opened.
+    */
+   void setCompressed(bool compressed);
+   bool isCompressed() const;
+
+   virtual bool open(OpenMode mode);
+   virtual void close();
+
+protected:
+   virtual qint64 writeData(const char* data, qint64 len);
+
+private:
+
+   /**
+    * Deflates data and writes the result to file.
+    *
+    * @param[in]  data   The data to compress.
+    * @param[in]  len    The length of the data.
+    * @param[in]  flush  The zlib flush mode.
+    */
+   bool deflateData(const char* data, qint64 len, int flush);
+
+   bool mCompressed;
+   z_stream_s* mStream;
+   QByteArray mDeflateBuffer;
+};
+
+
+#endif // COMPRESSED_FILE_H
@@ -25,8 +25,11 @@
 
 #include <vector>
 
+#include <math.h>
+
 
 class GCodeObject;
+struct GCodeObjectData;
 
 
 const static QString COMPANY_NAME = "Lochemage";
@@ -54,6 +57,29 @@ const static int AXIS_NUM_NO_E = 3;
 
 const static char AXIS_NAME[AXIS_NUM] = {'X', 'Y', 'Z', 'E'};
 
+/**
+ * Axis values are stored as fixed point integers, X, Y and Z in
+ * tenths of a micrometre and E in hundredths of a micrometre.
+ */
+const static int AXIS_DECIMALS[AXIS_NUM] = {4, 4, 4, 5};
+const static double AXIS_SCALE[AXIS_NUM] = {10000.0, 10000.0, 10000.0, 100000.0};
+
+/**
+ * Converts a value in millimetres to the fixed point units of an axis.
+ */
+inline qint64 toFixed(double value, int axis)
+{
+   return qRound64(value * AXIS_SCALE[axis]);
+}
+
+/**
+ * Converts a fixed point value of an axis back to millimetres.
+ */
+inline double fromFixed(qint64 value, int axis)
+{
+   return value / AXIS_SCALE[axis];
+}
+
 /**
  * Various conversion multipliers.
  */
@@ -148,6 +174,8 @@ enum DrawQuality
    DRAW_QUALITY_HIGH,
 };
 
+const static int DRAW_QUALITY_NUM = 3;
+
 enum PointType
 {
    POINT_FIRST_TOP_LEFT,
@@ -179,9 +207,12 @@ struct GCodeCommand
 
       for (int index = 0; index < AXIS_NUM; ++index)
       {
-         axisValue[index] = 0.0;
+         axisValue[index] = 0;
       }
 
+      arcOffset[X] = 0;
+      arcOffset[Y] = 0;
+
       hasF = false;
       hasS = false;
       hasP = false;
@@ -191,14 +222,18 @@ struct GCodeCommand
       p = 0.0;
    }
 
-   int type;
-
    QString command;
    QString comment;
 
-   bool hasAxis;
-   double axisValue[AXIS_NUM];
+   // Positions are absolute, while E is relative to the previous command.
+   qint32 axisValue[AXIS_NUM];
 
+   // The X and Y of an arc's center, relative to where the arc starts.
+   qint32 arcOffset[2];
+
+   int type;
+
+   bool hasAxis;
    bool hasF;
    bool hasS;
    bool hasP;
@@ -208,6 +243,68 @@ struct GCodeCommand
    double p;
 };
 
+/**
+ * Retrieves the angle an arc command sweeps through, in radians and
+ * negative when clockwise, along with its radius and starting angle.
+ *
+ * @param[in]   code        The arc command.
+ * @param[in]   start       The position the arc starts from.
+ * @param[out]  radius      The radius of the arc.
+ * @param[out]  startAngle  The angle of the start around the center.
+ */
+inline double getArcSweep(const GCodeCommand& code, const double* start, double& radius, double& startAngle)
+{
+   double offsetX = fromFixed(code.arcOffset[X], X);
+   double offsetY = fromFixed(code.arcOffset[Y], Y);
+
+   radius = sqrt(offsetX * offsetX + offsetY * offsetY);
+   startAngle = atan2(-offsetY, -offsetX);
+
+   double sweep = atan2(fromFixed(code.axisValue[Y], Y) - (start[Y] + offsetY), fromFixed(code.axisValue[X], X) - (start[X] + offsetX)) - startAngle;
+
+   // An arc that ends where it starts is a full circle.
+   if (code.type == GCODE_CW_ARC && sweep >= 0.0)
+   {
+      sweep -= 2.0 * M_PI;
+   }
+   else if (code.type != GCODE_CW_ARC && sweep <= 0.0)
+   {
+      sweep += 2.0 * M_PI;
+   }
+   return sweep;
+}
+
+/**
+ * Retrieves a point along an arc command, from where it starts
+ * at a fraction of 0 to its target at 1.
+ *
+ * @param[in]   code      The arc command.
+ * @param[in]   start     The position the arc starts from.
+ * @param[in]   fraction  How far along the arc the point is.
+ * @param[out]  point     The X, Y and Z of the point.
+ */
+inline void getArcPoint(const GCodeCommand& code, const double* start, double fraction, double* point)
+{
+   double radius = 0.0;
+   double startAngle = 0.0;
+   double sweep = getArcSweep(code, start, radius, startAngle);
+   double angle = startAngle + sweep * fraction;
+
+   point[X] = start[X] + fromFixed(code.arcOffset[X], X) + radius * cos(angle);
+   point[Y] = start[Y] + fromFixed(code.arcOffset[Y], Y) + radius * sin(angle);
+   point[Z] = start[Z] + (fromFixed(code.axisValue[Z], Z) - start[Z]) * fraction;
+}
+
+/**
+ * Retrieves the length of an arc command, along the arc.
+ */
+inline double getArcLength(const GCodeCommand& code, const double* start)
+{
+   double radius = 0.0;
+   double startAngle = 0.0;
+   return fabs(getArcSweep(code, start, radius, startAngle)) * radius;
+}
+
 struct ExtruderData
 {
    ExtruderData()
@@ -224,6 +321,7 @@ struct ExtruderData
       primer = 3.0;
       travelSpeed = 30.0;
       retractSpeed = 30.0;
+      heatUpRate = 2.0;
       color = Qt::white;
    }
 
@@ -240,6 +338,7 @@ struct ExtruderData
       primer = 3.0;
       travelSpeed = 30.0;
       retractSpeed = 30.0;
+      heatUpRate = 2.0;
       color = col;
    }
 
@@ -251,15 +350,85 @@ struct ExtruderData
    double primer;
    double travelSpeed;
    double retractSpeed;
+   double heatUpRate;      // Degrees per second, used to preheat before a swap.
    QColor color;
 };
 
 struct LayerData
 {
-   double height;
+   qint32 height;    // Fixed point, see toFixed().
    std::vector<GCodeCommand> codes;
 };
 
+/**
+ * A breakdown of the memory used by each subsystem, in bytes.
+ */
+struct MemoryUsage
+{
+   MemoryUsage()
+   {
+      layerCommands = 0;
+      commentStrings = 0;
+      vertexBuffers = 0;
+      normalBuffers = 0;
+      indexBuffers = 0;
+      displayLists = 0;
+   }
+
+   MemoryUsage& operator+=(const MemoryUsage& other)
+   {
+      layerCommands += other.layerCommands;
+      commentStrings += other.commentStrings;
+      vertexBuffers += other.vertexBuffers;
+      normalBuffers += other.normalBuffers;
+      indexBuffers += other.indexBuffers;
+      displayLists += other.displayLists;
+      return *this;
+   }
+
+   unsigned long long getTotal() const
+   {
+      return layerCommands + commentStrings + vertexBuffers + normalBuffers + indexBuffers + displayLists;
+   }
+
+   /**
+    * Formats a byte count into a human readable string.
+    */
+   static QString formatBytes(unsigned long long bytes)
+   {
+      if (bytes >= 1024 * 1024 * 1024) return QString::number(bytes / (1024.0 * 1024.0 * 1024.0), 'f', 2) + " GB";
+      if (bytes >= 1024 * 1024)        return QString::number(bytes / (1024.0 * 1024.0), 'f', 2) + " MB";
+      if (bytes >= 1024)               return QString::number(bytes / 1024.0, 'f', 2) + " KB";
+      return QString::number(bytes) + " B";
+   }
+
+   /**
+    * Retrieves a multi line breakdown of this usage.
+    */
+   QString toString() const
+   {
+      QString text;
+      text += "Layer Commands:  " + formatBytes(layerCommands) + "\n";
+      text += "Comment Strings: " + formatBytes(commentStrings) + "\n";
+      text += "Vertex Buffers:  " + formatBytes(vertexBuffers) + "\n";
+      text += "Normal Buffers:  " + formatBytes(normalBuffers) + "\n";
+      text += "Index Buffers:   " + formatBytes(indexBuffers) + "\n";
+      text += "Display Lists:   " + formatBytes(displayLists) + " (estimated)\n";
+      text += "Total:           " + formatBytes(getTotal()) + "\n";
+      return text;
+   }
+
+   unsigned long long layerCommands;
+   unsigned long long commentStrings;
+   unsigned long long vertexBuffers;
+   unsigned long long normalBuffers;
+   unsigned long long indexBuffers;
+
+   // Display lists live in driver memory, so this is only an estimate
+   // based on the single precision vertex data compiled into them.
+   unsigned long long displayLists;
+};
+
 struct VisualizerBufferData
 {
    VisualizerBufferData()
@@ -301,6 +470,21 @@ struct VisualizerBufferData
       displayListIndex = 0x0501;
    }
 
+   /**
+    * Adds the memory used by the geometry buffers to the given usage.
+    */
+   void getMemoryUsage(MemoryUsage& usage) const
+   {
+      if (vertexBuffer) usage.vertexBuffers += (unsigned long long)vertexCount * 3 * sizeof(double);
+      if (normalBuffer) usage.normalBuffers += (unsigned long long)vertexCount * 3 * sizeof(double);
+      if (indexBuffer)  usage.indexBuffers += (unsigned long long)quadCount * 4 * sizeof(unsigned int);
+
+      if (displayListIndex != 0x0501)
+      {
+         usage.displayLists += (unsigned long long)vertexCount * 3 * sizeof(float) * (normalBuffer? 2: 1);
+      }
+   }
+
    double*        vertexBuffer;
    double*        normalBuffer;
    unsigned int*  indexBuffer;
@@ -311,13 +495,52 @@ struct VisualizerBufferData
    unsigned int   displayListIndex;
 };
 
-struct VisualizerObjectData
+struct VisualizerGeometryData
 {
-   GCodeObject*   object;
+   VisualizerGeometryData()
+   {
+      quality = DRAW_QUALITY_LOW;
+      layerSkipSize = 0;
+      hasDisplayLists = false;
+      lastUsed = 0;
+   }
+
+   void getMemoryUsage(MemoryUsage& usage) const
+   {
+      int layerCount = (int)layers.size();
+      for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+      {
+         layers[layerIndex].getMemoryUsage(usage);
+      }
+   }
+
+   unsigned long long getMemoryUsage() const
+   {
+      MemoryUsage usage;
+      getMemoryUsage(usage);
+      return usage.getTotal();
+   }
+
+   DrawQuality    quality;
+   int            layerSkipSize;
+   bool           hasDisplayLists;
+   unsigned int   lastUsed;
 
    std::vector<VisualizerBufferData> layers;
 };
 
+struct VisualizerObjectData
+{
+   // Geometry is generated once for the parsed data and
+   // drawn for every object instance that shares it.
+   const GCodeObjectData*  data;
+   int                     instanceCount;
+
+   // Every geometry tier that has been generated for this object,
+   // one for each draw quality and layer skip combination.
+   std::vector<VisualizerGeometryData> geometry;
+};
+
 struct PreferenceData
 {
    PreferenceData()
@@ -327,6 +550,8 @@ struct PreferenceData
       useDisplayLists = false;
       drawQuality = DRAW_QUALITY_MED;
       layerSkipSize = 0;
+      geometryCacheSize = 256;
+      memoryBudget = 2048;
 
       // Splicing Properties
       exportImportedStartCode = true;
@@ -335,14 +560,18 @@ struct PreferenceData
       swapCode.clear();
       exportComments = true;
       exportAllAxes = false;
+      exportCompact = false;
       printSkirt = true;
       skirtDistance = 2.0;
+      swapZTolerance = 0.0;
+      arcTolerance = 0.0;
 
       // Printer properties.
       extruderList.push_back(ExtruderData(Qt::green));
       extruderList.push_back(ExtruderData(Qt::blue, 23.5));
       platformWidth = 200;
       platformHeight = 200;
+      arrangeClearance = 5.0;
 
       // Advanced properties.
       exportAbsoluteMode = true;
@@ -350,6 +579,7 @@ struct PreferenceData
 
       importRetraction = -1.0;
       importPrimer = -1.0;
+      importReadAhead = false;
    }
 
    // Editor properties.
@@ -357,6 +587,8 @@ struct PreferenceData
    bool useDisplayLists;
    DrawQuality drawQuality;
    int layerSkipSize;
+   int geometryCacheSize;
+   int memoryBudget;
 
    // Splicing properties.
    bool exportImportedStartCode;
@@ -365,19 +597,24 @@ struct PreferenceData
    QString swapCode;
    bool exportComments;
    bool exportAllAxes;
+   bool exportCompact;
    bool printSkirt;
    double skirtDistance;
+   double swapZTolerance;  // How far one extruder may print above the others to save swaps.
+   double arcTolerance;    // How far fitted arcs may stray from the moves they replace.
 
    // Printer properties.
    std::vector<ExtruderData> extruderList;
    int platformWidth;
    int platformHeight;
+   double arrangeClearance;
 
    // Advanced properties.
    bool exportAbsoluteMode;
    bool exportAbsoluteEMode;
    double importRetraction;
    double importPrimer;
+   bool importReadAhead;   // Reads imported files on a thread of their own while they are parsed.
 };
 
 #endif  // CONSTANTS_H
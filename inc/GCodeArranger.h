@@ -0,0 +1,116 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef G_CODE_ARRANGER_H
+#define G_CODE_ARRANGER_H
+
+#include <Constants.h>
+#include <QPointF>
+#include <QString>
+#include <vector>
+
+
+class GCodeObject;
+
+/**
+ * Packs objects onto the platform by their footprint so that every object
+ * fits within reach of the extruder it prints with.
+ */
+class GCodeArranger
+{
+public:
+   GCodeArranger(const PreferenceData& prefs);
+   virtual ~GCodeArranger();
+
+   /**
+    * Inserts an object into the arrangement.
+    */
+   bool addObject(GCodeObject* object);
+
+   /**
+    * Packs every object onto the platform and updates their positions.
+    * Nothing is moved unless every object fits.
+    *
+    * @param[in]  clearance  The minimum distance to keep between objects.
+    */
+   bool arrange(double clearance);
+
+   const QString& getError() const;
+
+protected:
+
+private:
+
+   struct ArrangeItem
+   {
+      GCodeObject* object;
+
+      // The footprint, moved so its bounding box starts at zero.
+      std::vector<QPointF> footprint;
+      double footprintMin[2];
+      double width;
+      double height;
+
+      // The horizontal extents of the footprint within each slab.
+      std::vector<double> slabLeft;
+      std::vector<double> slabRight;
+
+      // The right extents, grown by the clearance in both directions.
+      std::vector<double> grownRight;
+
+      // The packed position within the arrangement.
+      double pos[2];
+   };
+
+   struct ArrangeShelf
+   {
+      double y;
+      double height;
+      std::vector<int> items;
+   };
+
+   /**
+    * Prepares the footprint and slab extents of an item.
+    */
+   void buildItem(ArrangeItem& item, double clearance);
+
+   /**
+    * Retrieves the leftmost position an item can be placed on a shelf.
+    */
+   double getShelfPos(const ArrangeShelf& shelf, const ArrangeItem& item, double clearance) const;
+
+   /**
+    * Retrieves the horizontal extents of a convex polygon between two heights.
+    */
+   static bool getExtents(const std::vector<QPointF>& polygon, double minY, double maxY, double& outLeft, double& outRight);
+
+   /**
+    * Orders items from tallest to shortest.
+    */
+   static bool isTaller(const ArrangeItem& left, const ArrangeItem& right);
+
+   const PreferenceData& mPrefs;
+
+   std::vector<ArrangeItem> mItemList;
+
+   QString mError;
+};
+
+#endif // G_CODE_ARRANGER_H
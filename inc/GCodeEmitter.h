@@ -0,0 +1,202 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef G_CODE_EMITTER_H
+#define G_CODE_EMITTER_H
+
+#include <CompressedFile.h>
+#include <QString>
+
+
+// The magic number and version at the start of every binary gcode file.
+const static char BINARY_MAGIC[] = "GCDE";
+const static quint32 BINARY_VERSION = 1;
+
+// The most gcode text held in a single binary block, and the most any
+// other block, such as a thumbnail, may hold before we consider it corrupt.
+const static int BINARY_BLOCK_SIZE = 65535;
+const static int BINARY_MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+// The block types of a binary gcode file.
+enum BinaryBlockType
+{
+   BINARY_BLOCK_FILE_METADATA = 0,
+   BINARY_BLOCK_GCODE,
+   BINARY_BLOCK_SLICER_METADATA,
+   BINARY_BLOCK_PRINTER_METADATA,
+   BINARY_BLOCK_PRINT_METADATA,
+   BINARY_BLOCK_THUMBNAIL,
+};
+
+// The ways each block of a binary gcode file can be compressed.
+enum BinaryCompression
+{
+   BINARY_COMPRESSION_NONE = 0,
+   BINARY_COMPRESSION_DEFLATE,
+   BINARY_COMPRESSION_HEATSHRINK_11_4,
+   BINARY_COMPRESSION_HEATSHRINK_12_4,
+};
+
+// The checksum types that follow each block.
+enum BinaryChecksum
+{
+   BINARY_CHECKSUM_NONE = 0,
+   BINARY_CHECKSUM_CRC32,
+};
+
+// The metadata a binary file carries, in the order they are written.
+enum MetadataType
+{
+   METADATA_FILE = 0,
+   METADATA_PRINTER,
+   METADATA_PRINT,
+   METADATA_SLICER,
+};
+
+const static int METADATA_TYPE_NUM = 4;
+
+/**
+ * The destination spliced gcode is written to, so the same splice can be
+ * exported in any format.  Gcode is always written to an emitter as text
+ * and it is up to the emitter to encode it.
+ */
+class GCodeEmitter
+{
+public:
+   virtual ~GCodeEmitter();
+
+   /**
+    * Creates the emitter that suits the extension of a file name, .bgcode
+    * files are binary and every other file is text.
+    *
+    * @param[in]  fileName  The name of the file to write.
+    */
+   static GCodeEmitter* create(const QString& fileName);
+
+   /**
+    * Opens the file for writing.
+    *
+    * @param[in]  append  True to add to the end of a file this emitter already wrote.
+    */
+   virtual bool open(bool append = false) = 0;
+   virtual void close() = 0;
+
+   /**
+    * Writes gcode text, lines must end with a new line.
+    */
+   virtual void write(const QByteArray& data) = 0;
+   void write(const char* data);
+
+   /**
+    * Retrieves how many bytes of gcode text have been written since the
+    * file was opened, before any compression or encoding.
+    */
+   qint64 getPosition() const;
+
+   /**
+    * Adds a metadata value, formats that carry metadata need them all
+    * added before any gcode is written.
+    *
+    * @param[in]  type   The metadata the value belongs to.
+    * @param[in]  key    The name of the value.
+    * @param[in]  value  The value.
+    */
+   virtual void addMetadata(MetadataType type, const QString& key, const QString& value) = 0;
+
+protected:
+   GCodeEmitter(const QString& fileName);
+
+   QString mFileName;
+   qint64  mPosition;
+};
+
+/**
+ * Writes gcode as plain text, compressed with gzip if the file name ends
+ * with .gz.  Metadata is not written since the header comments hold it.
+ */
+class GCodeTextEmitter : public GCodeEmitter
+{
+public:
+   GCodeTextEmitter(const QString& fileName);
+   virtual ~GCodeTextEmitter();
+
+   virtual bool open(bool append = false);
+   virtual void close();
+
+   virtual void write(const QByteArray& data);
+   using GCodeEmitter::write;
+
+   virtual void addMetadata(MetadataType type, const QString& key, const QString& value);
+
+private:
+   CompressedFile mFile;
+};
+
+/**
+ * Writes gcode in the binary gcode format, a file header followed by
+ * metadata blocks and then blocks of gcode lines, each deflated on its own
+ * and followed by a CRC32 checksum.
+ */
+class GCodeBinaryEmitter : public GCodeEmitter
+{
+public:
+   GCodeBinaryEmitter(const QString& fileName);
+   virtual ~GCodeBinaryEmitter();
+
+   virtual bool open(bool append = false);
+   virtual void close();
+
+   virtual void write(const QByteArray& data);
+   using GCodeEmitter::write;
+
+   virtual void addMetadata(MetadataType type, const QString& key, const QString& value);
+
+private:
+
+   /**
+    * Writes every metadata block, once, before the first gcode block.
+    */
+   void writeMetadata();
+
+   /**
+    * Writes the gcode waiting in our block buffer.
+    *
+    * @param[in]  size  The number of bytes to write from the front of the buffer.
+    */
+   void writeGCodeBlock(int size);
+
+   /**
+    * Writes a single block with its header, parameters and checksum.
+    *
+    * @param[in]  type         The block type.
+    * @param[in]  data         The uncompressed block data.
+    * @param[in]  compression  The compression to use.
+    */
+   void writeBlock(BinaryBlockType type, const QByteArray& data, BinaryCompression compression);
+
+   QFile mFile;
+   bool mMetadataWritten;
+
+   QByteArray mMetadata[METADATA_TYPE_NUM];
+   QByteArray mBlockBuffer;
+};
+
+
+#endif // G_CODE_EMITTER_H
@@ -22,14 +22,51 @@
 #define G_CODE_OBJECT_H
 
 #include <Constants.h>
+#include <QDateTime>
+#include <QPointF>
+#include <QSharedData>
 #include <QString>
 #include <vector>
 
 
+/**
+ * The parsed contents of a gcode file.  This is never changed once
+ * loaded, so any number of objects can share it.
+ */
+struct GCodeObjectData : public QSharedData
+{
+   GCodeObjectData();
+
+   // The file and import preferences this data was loaded with.
+   QString   fileName;
+   QDateTime lastModified;
+   double    importRetraction;
+   double    importPrimer;
+
+   std::vector<LayerData> layers;
+
+   // Bounding Box
+   double minBounds[AXIS_NUM_NO_E];
+   double maxBounds[AXIS_NUM_NO_E];
+   double center[AXIS_NUM_NO_E];
+
+   // The convex hull of everything extruded, as seen from above.
+   std::vector<QPointF> footprint;
+
+   double averageLayerHeight;
+};
+
 class GCodeObject
 {
 public:
    GCodeObject(const PreferenceData& prefs);
+
+   /**
+    * Creates another instance of an object.  The parsed data is shared
+    * rather than copied, only the offset and extruder are our own.
+    */
+   GCodeObject(const GCodeObject& other);
+
    virtual ~GCodeObject();
 
    /**
@@ -37,10 +74,32 @@ public:
     */
    bool loadFile(const QString &fileName, QWidget* parent = NULL);
 
+   /**
+    * Retrieves whether loading the given file would result in
+    * the same data this object already has.
+    */
+   bool isLoadedFrom(const QString& fileName) const;
+
+   /**
+    * Retrieves the parsed data, which is shared between instances.
+    */
+   const GCodeObjectData* getData() const;
+
+   /**
+    * Offsets the object so it is in the center of the build platform.
+    */
+   void centerOnPlatform();
+
    const double* getMinBounds() const;
    const double* getMaxBounds() const;
    const double* getCenter() const;
 
+   /**
+    * Retrieves the convex hull of everything the object extrudes as seen
+    * from above, in counter clockwise order and without our offset.
+    */
+   const std::vector<QPointF>& getFootprint() const;
+
    void setOffsetPos(double x, double y, double z);
    const double* getOffsetPos() const;
 
@@ -53,21 +112,27 @@ public:
    const LayerData& getLayer(int levelIndex) const;
 
    /**
-    * Retrieves all layer codes at a given layer height and appends
-    * it to the given layer data.
+    * Retrieves the layer at a given layer height.
     *
-    * @param[out]  outLayer  The layer data to append to.
-    * @param[in]   height    The height to retrieve.
+    * @param[out]  outLayer  The layer to retrieve.
+    * @param[in]   height    The fixed point height to retrieve.
     */
-   bool getLayerAtHeight(std::vector<GCodeCommand>& outLayer, double height) const;
+   bool getLayerAtHeight(const LayerData*& outLayer, qint32 height) const;
 
    /**
     * Retrieves the layer that is right above a given layer height.
     *
     * @param[out]  outLayer  The layer to retrieve.
-    * @param[in]   height    The height.
+    * @param[in]   height    The fixed point height.
+    */
+   bool getLayerAboveHeight(const LayerData*& outLayer, qint32 height) const;
+
+   /**
+    * Adds the memory used by the parsed layer data to the given usage.
+    *
+    * @param[out]  usage  The usage to add to.
     */
-   bool getLayerAboveHeight(const LayerData*& outLayer, double height) const;
+   void getMemoryUsage(MemoryUsage& usage) const;
 
    const QString& getError() const;
 
@@ -78,21 +143,15 @@ private:
    void finalizeTempBuffer(std::vector<GCodeCommand>& tempBuffer, std::vector<GCodeCommand>& finalBuffer, bool cullComments = true);
    void addLayer(std::vector<GCodeCommand>& layer);
    bool healLayerRetraction();
+   void buildFootprint();
 
    const PreferenceData& mPrefs;
 
-   std::vector<LayerData> mData;
-
-   // Bounding Box
-   double mMinBounds[AXIS_NUM_NO_E];
-   double mMaxBounds[AXIS_NUM_NO_E];
-   double mCenter[AXIS_NUM_NO_E];
+   QExplicitlySharedDataPointer<GCodeObjectData> mData;
 
    double mOffsetPos[AXIS_NUM_NO_E];
    int    mExtruderIndex;
 
-   double mAverageLayerHeight;
-
    QString mError;
 };
 
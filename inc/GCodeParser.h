@@ -21,9 +21,13 @@
 #ifndef G_CODE_PARSER_H
 #define G_CODE_PARSER_H
 
+#include <Trace.h>
 #include <QString>
 #include <QFile>
 
+struct z_stream_s;
+class ReadAheadReader;
+
 
 class GCodeParser
 {
@@ -32,7 +36,8 @@ public:
    virtual ~GCodeParser();
 
    /**
-    * Load a specified gcode file.
+    * Load a specified gcode file, gzip compressed and binary gcode files
+    * are decoded as they are parsed.
     *
     * @param[in]  fileName  The name of the gcode file to load.
     */
@@ -40,6 +45,12 @@ public:
    bool closeFile();
    bool isOpen() const;
 
+   /**
+    * Sets whether the next file loaded is read ahead on a thread of its
+    * own, hiding the latency of slow or network storage behind the parse.
+    */
+   void setReadAhead(bool enabled);
+
    /**
     * Sets the comment markers that delimit the comment from the code.
     */
@@ -76,23 +87,104 @@ public:
    QString getComment();
 
    /**
-    * Retrieves the current progress of the parse.
+    * Retrieves where the current line begins, counted in bytes of
+    * gcode text after any decompression.
+    */
+   qint64 getLinePos() const;
+
+   /**
+    * Retrieves the current progress of the parse, for compressed files
+    * this is measured in compressed bytes.
     */
    double getProgress() const;
 
+   /**
+    * Retrieves the error that stopped the parse early, if any.
+    */
+   const QString& getError() const;
+
 protected:
 
 private:
 
+   /**
+    * Reads the next line from file, decompressing it if necessary.
+    */
+   QByteArray readLine();
+
+   /**
+    * Retrieves whether there is nothing left in the file to read.
+    */
+   bool atEnd();
+
+   /**
+    * Reads raw bytes from file, or from the read ahead thread if there is one.
+    */
+   QByteArray readFile(int maxSize);
+   bool fileAtEnd();
+   qint64 getFilePos() const;
+
+   /**
+    * Decodes the next chunk of the file onto our line buffer.
+    *
+    * @return  Returns false when there is nothing left to decode.
+    */
+   bool decodeNext();
+
+   /**
+    * Decompresses the next chunk of a gzip file.
+    */
+   bool inflateNext();
+
+   /**
+    * Decodes the next gcode block of a binary file, skipping any others.
+    */
+   bool readBlock();
+
+   /**
+    * Records the parse time of the current batch of lines.
+    */
+   void flushTrace();
+
    QFile mFile;
 
+   // Once reading ahead, the file is only read through the reader.
+   bool mReadAhead;
+   ReadAheadReader* mReader;
+
+   enum FileFormat
+   {
+      FORMAT_TEXT,
+      FORMAT_GZIP,
+      FORMAT_BINARY,
+   };
+
+   // Encoded files are decoded a chunk at a time into a line buffer.
+   FileFormat mFormat;
+   bool mChecksum;
+   z_stream_s* mStream;
+   QByteArray mCompressedBuffer;
+   QByteArray mLineBuffer;
+   int mLinePos;
+   bool mStreamEnd;
+
+   QString mError;
+
    QByteArray mCommentMarkers;
 
+   // Where the current line, and the one after it, begin in the text.
+   qint64 mLineStart;
+   qint64 mTextPos;
+
    QByteArray mToken;
    QByteArray mComment;
    int mCommentPos;
 
    int mCodePos;
+
+   // Lines are traced in batches, a span for every line would be far too many.
+   TraceAccumulator mParseTrace;
+   qint64 mParseTraceStart;
 };
 
 
@@ -22,12 +22,14 @@
 #define G_CODE_BUILDER_H
 
 #include <Constants.h>
+#include <QPointF>
 #include <QString>
+#include <QStringList>
 #include <vector>
 
 
 class GCodeObject;
-class QFile;
+class GCodeEmitter;
 
 class GCodeSplicer
 {
@@ -40,20 +42,106 @@ public:
     */
    bool addObject(const GCodeObject* object);
 
+   /**
+    * Limits the next build to a range of layers, so a large splice can be
+    * split into shards that are built separately and merged afterwards.
+    * Layers are counted in the order they print, which is not always in
+    * Z order once a swap Z tolerance lets extruders run ahead.
+    *
+    * @param[in]  firstLayer  The first layer to build, starting at 1.
+    * @param[in]  lastLayer   The last layer to build, or -1 for the last layer.
+    */
+   void setLayerRange(int firstLayer, int lastLayer);
+
+   /**
+    * Sets the extruder that is active when a shard begins, by default
+    * it is the one the layers before the shard would have left active.
+    *
+    * @param[in]  extruder  The extruder index, or -1 for the default.
+    */
+   void setEnteringExtruder(int extruder);
+
    /**
     *	Builds the final gcode file and outputs it to a file.
     *
-    * @param[in]  fileName  The name of the file to save.
+    * @param[in]  fileName  The name of the file to save, a .bgcode extension
+    *                       saves binary gcode and .gz compresses the text.
     */
    bool build(const QString& fileName, QWidget* parent);
 
+   /**
+    * Loads the layer index written alongside a spliced file, which holds
+    * where each layer starts and the state of the printer at that point.
+    *
+    * @param[in]  fileName  The name of the spliced file, not of its index.
+    */
+   bool loadLayerIndex(const QString& fileName);
+   int getIndexedLayerCount() const;
+
+   /**
+    * Exports the rest of a spliced file from the start of a layer, behind
+    * a header that brings the printer back to the state it was in at that
+    * layer.  Nothing is spliced again, the layer index says where to start,
+    * and as with setLayerRange its layers are counted in the order they print.
+    *
+    * @param[in]  fileName        The previously spliced file.
+    * @param[in]  layer           The layer to resume from, starting at 1.
+    * @param[in]  resumeFileName  The name of the file to save.
+    */
+   bool exportResume(const QString& fileName, int layer, const QString& resumeFileName);
+
+   /**
+    * Joins shards, in order, into a single file.  A swap is added
+    * wherever a shard begins with a different extruder than the shard
+    * before it left active, and a layer index is written for the result.
+    *
+    * @param[in]  shardFileNames  The shards to join, each needs its layer index.
+    * @param[in]  fileName        The name of the file to save.
+    */
+   bool mergeShards(const QStringList& shardFileNames, const QString& fileName);
+
+   /**
+    * Retrieves the estimated print time of the last build, in seconds,
+    * in total and for each layer it wrote, which are also noted in the
+    * layer index.
+    */
+   double getEstimatedTime() const;
+   const std::vector<double>& getLayerTimes() const;
+
+   /**
+    * Retrieves the number of extruder swaps in the last build, how many
+    * the plain layer by layer order would have needed, and the estimated
+    * time, in seconds, saved by grouping layers between swaps.
+    */
+   int getSwapCount() const;
+   int getBaselineSwapCount() const;
+   double getSwapTimeSaved() const;
+
+   /**
+    * Retrieves the distance, in millimetres, travelled between blocks
+    * in the last build, and how far it was before they were reordered.
+    */
+   double getTravelDistance() const;
+   double getBaselineTravelDistance() const;
+
+   /**
+    * Retrieves the number of arcs fitted in the last build, and
+    * the number of moves they replaced.
+    */
+   int getArcCount() const;
+   int getArcMoveCount() const;
+
    /**
     * Various build helper methods to keep the code clean.
     */
-   bool buildHeader(QFile& file);
-   bool buildExtruderInit(QFile& file, int currentExtruder);
-   bool buildExtruderSwap(QFile& file, int lastExtruder, int currentExtruder, double& extrusionValue);
-   bool buildExtruderMovement(QFile& file, const GCodeCommand& code, int currentExtruder, double* offset, double* currentPos);
+   bool buildHeader(GCodeEmitter& emitter);
+   bool buildFooter(GCodeEmitter& emitter);
+   bool buildExtruderInit(GCodeEmitter& emitter, int currentExtruder);
+   bool buildExtruderSwap(GCodeEmitter& emitter, int lastExtruder, int currentExtruder, qint64& extrusionValue);
+   bool buildExtruderPreheat(GCodeEmitter& emitter, int extruder);
+   bool buildExtruderMovement(GCodeEmitter& emitter, const GCodeCommand& code, int currentExtruder, qint64* offset, qint64* currentPos);
+   bool buildArcMovement(GCodeEmitter& emitter, const std::vector<GCodeCommand>& codes, int startIndex, int endIndex, const QPointF& center, bool clockwise, int currentExtruder, qint64* offset, qint64* currentPos);
+   bool buildClearanceTravel(GCodeEmitter& emitter, qint64 clearZ, const QPointF& entry, int currentExtruder, qint64* currentPos);
 
 #ifdef BUILD_DEBUG_CONTROLS
    /**
@@ -69,20 +157,256 @@ protected:
 private:
 
    /**
-    * Retrieves the total layer count.
+    * An extruder to start heating before a code is written.
+    */
+   struct SplicePreheat
+   {
+      int codeIndex;
+      int extruder;
+   };
+
+   /**
+    * The codes of a single object layer, printed with one extruder.
+    */
+   struct SpliceBlock
+   {
+      const GCodeObject* object;
+      const LayerData*   layer;
+      int                extruder;
+      qint32             height;
+
+      // Estimated timing, in seconds, and the state we start in.
+      double startTime;
+      double duration;
+      double startFeedRate;
+      double startPos[AXIS_NUM_NO_E];
+
+      std::vector<SplicePreheat> preheats;
+   };
+
+   struct SpliceLayer
+   {
+      qint32 height;
+      std::vector<SpliceBlock> blocks;
+   };
+
+   /**
+    * The state of the printer at the start of a layer of the output, where
+    * the offset counts bytes of gcode text before any compression.
+    */
+   struct SpliceLayerState
+   {
+      int                 layer;
+      qint64              offset;
+      qint32              height;
+      int                 extruder;
+      qint64              pos[AXIS_NUM_NO_E];
+      double              feedRate;
+      double              fanSpeed;
+      std::vector<double> temperatures;
+   };
+
+   /**
+    * Determines every block we print, in order, for each layer.
+    */
+   void buildLayerList(std::vector<SpliceLayer>& layerList);
+
+   /**
+    * Reorders the extruders within each layer, and so the extruder each
+    * layer ends with, for the lowest total swap time across the print.
     */
-   int getTotalLayerCount();
+   void orderExtruders(std::vector<SpliceLayer>& layerList);
+
+   /**
+    * Reorders our blocks so an extruder may keep printing its own layers
+    * up to the swap Z tolerance above everything else before swapping.
+    *
+    * Each run of blocks at one height becomes a layer of its own, so with
+    * a tolerance set the layers are no longer in Z order and an extruder
+    * that ran ahead leaves the others to print lower layers after it.
+    * The build travels over the taller parts to reach those layers.
+    */
+   void scheduleLayers(std::vector<SpliceLayer>& layerList);
+
+   /**
+    * Retrieves whether the next block of an object is printed before the
+    * next block of another, lowest first and then in the order they were
+    * printed before scheduling.
+    */
+   bool isScheduledBefore(const std::vector<std::vector<SpliceBlock> >& objectBlocks,
+                          const std::vector<std::vector<int> >& objectRanks,
+                          const std::vector<int>& nextBlock,
+                          int objectIndex, int otherIndex) const;
+
+   /**
+    * Counts the extruder swaps needed to print the given layers.
+    *
+    * @param[in]   layerList  The layers to print.
+    * @param[out]  swapTime   The estimated time spent swapping, in seconds.
+    */
+   int countSwaps(const std::vector<SpliceLayer>& layerList, double& swapTime) const;
+
+   /**
+    * Retrieves roughly how long a swap between two extruders takes,
+    * retracting, priming, heating up and the nozzle offset travel included.
+    */
+   double getSwapTime(int lastExtruder, int currentExtruder) const;
+
+   /**
+    * Reorders the blocks each extruder prints in a row to shorten the
+    * travel between them, with a nearest neighbour pass and 2-opt.
+    */
+   void optimizeTravel(std::vector<SpliceLayer>& layerList);
+
+   /**
+    * Retrieves the distance travelled between every block we print.
+    */
+   double getTravelDistance(const std::vector<SpliceLayer>& layerList) const;
+
+   /**
+    * Retrieves where the head enters and leaves a block, in printer space.
+    */
+   void getBlockEnds(const SpliceBlock& block, QPointF& entry, QPointF& exit) const;
+
+   /**
+    * Schedules each extruder to start heating from idle early enough
+    * that it has reached its print temperature by the time it is swapped in.
+    */
+   void schedulePreheats(std::vector<SpliceLayer>& layerList);
+
+   /**
+    * Retrieves the extruder active and the printer space position of the
+    * nozzle at the start of a layer, from the layers before it.
+    *
+    * @param[in]   layerList   The layers to print.
+    * @param[in]   layerIndex  The layer to start from.
+    * @param[out]  pos         The fixed point position, left alone if nothing has moved.
+    */
+   int getLayerEntryState(const std::vector<SpliceLayer>& layerList, int layerIndex, qint64* pos) const;
+
+   /**
+    * Retrieves the printer space offset of everything in a block.
+    */
+   void getBlockOffset(const SpliceBlock& block, double* offset) const;
+
+   /**
+    * Retrieves how long an extruder takes to heat from idle to print temperature.
+    */
+   double getHeatUpTime(int extruder) const;
 
    /**
     * Retrieves whether there is a next layer above the given height.
     * and outputs the exact height of the next layer.
     */
-   bool getNextLayer(double height, double& outHeight);
+   bool getNextLayer(qint32 height, qint32& outHeight);
+
+   /**
+    * Finds the longest run of moves following a move that fits an arc
+    * within our arc tolerance.
+    *
+    * @param[in]   codes       The codes to search.
+    * @param[in]   startIndex  The move the arc would start from.
+    * @param[out]  center      The center of the arc, in object space.
+    * @param[out]  clockwise   Whether the arc turns clockwise.
+    *
+    * @return  The index of the last move in the arc, or startIndex if none fit.
+    */
+   int fitArc(const std::vector<GCodeCommand>& codes, int startIndex, QPointF& center, bool& clockwise) const;
+
+   /**
+    * Appends the feed rate of a move, if it has one or we were left
+    * one to set, and retrieves whether anything was appended.
+    */
+   bool appendMoveFeedRate(QByteArray& output, const GCodeCommand& code);
+
+   /**
+    * Sets the feed rate of a move we are about to write, as its own
+    * command or, when compacting, as part of the move itself.
+    *
+    * @param[in]      emitter   The output to write to.
+    * @param[in,out]  output    The move being built.
+    * @param[in]      feedRate  The feed rate, in mm/min.
+    */
+   void buildFeedRate(GCodeEmitter& emitter, QByteArray& output, double feedRate);
+
+   /**
+    * Writes any feed rate we were left to set before a command that needs it.
+    */
+   void flushFeedRate(GCodeEmitter& emitter);
+
+   /**
+    * Retrieves whether a command only repeats a temperature or fan speed
+    * we have already set, so compact output can skip it.
+    */
+   bool isRepeatedCommand(const GCodeCommand& code, int currentExtruder);
+
+   /**
+    * Appends a fixed point axis value as text, without any trailing zeros.
+    *
+    * @param[out]  output  The text to append to.
+    * @param[in]   value   The fixed point value.
+    * @param[in]   axis    The axis the value belongs to.
+    */
+   static void appendFixed(QByteArray& output, qint64 value, int axis);
+
+   /**
+    * Writes the state of every layer of the last build to the index
+    * alongside the spliced file.
+    *
+    * @param[in]  fileName  The name of the spliced file.
+    * @param[in]  isShard   True if the file holds only some of the layers.
+    */
+   bool writeLayerIndex(const QString& fileName, bool isShard) const;
+
+   /**
+    * Retrieves where each layer of the last build begins in the file.
+    */
+   std::vector<qint64> getLayerOffsets() const;
+
+   /**
+    * Writes the codes that bring the printer back to the state
+    * it was in at the start of a layer.
+    *
+    * @param[in]  emitter  The output to write to.
+    * @param[in]  state    The state at the start of the layer.
+    * @param[in]  layer    The layer being resumed, starting at 1.
+    */
+   void buildResumeHeader(GCodeEmitter& emitter, const SpliceLayerState& state, int layer);
 
    const PreferenceData& mPrefs;
 
    std::vector<const GCodeObject*> mObjectList;
 
+   double mEstimatedTime;
+   std::vector<double> mLayerTimes;
+
+   int    mSwapCount;
+   int    mBaselineSwapCount;
+   double mSwapTimeSaved;
+
+   double mTravelDistance;
+   double mBaselineTravelDistance;
+
+   // What we last set on the printer while building, in mm/min and
+   // degrees, or -1 while unknown.
+   double              mFeedRate;
+   double              mPendingFeedRate;
+   double              mFanSpeed;
+   std::vector<double> mTemperatures;
+
+   int mArcCount;
+   int mArcMoveCount;
+
+   std::vector<SpliceLayerState> mLayerStates;
+
+   // The layers to build, and the extruders a shard enters and leaves with.
+   int mFirstLayer;
+   int mLastLayer;
+   int mEnteringExtruder;
+   int mShardEnteringExtruder;
+   int mShardLeavingExtruder;
+   int mShardLayerCount;
+
    QString mError;
 };
 
@@ -0,0 +1,213 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef G_CODE_TIME_ESTIMATOR_H
+#define G_CODE_TIME_ESTIMATOR_H
+
+#include <Constants.h>
+#include <QString>
+#include <deque>
+#include <vector>
+
+
+/**
+ * Estimates how long a printer takes to run gcode, following the motion
+ * planner of the firmware.  Every move accelerates and decelerates along
+ * a trapezoid, with the speed at each corner limited by either the jerk
+ * or the junction deviation of the printer.
+ *
+ * Time is counted towards sections, such as layers, which can be
+ * retrieved along with the total once everything has been added.
+ */
+class GCodeTimeEstimator
+{
+public:
+   GCodeTimeEstimator(const PreferenceData& prefs);
+   virtual ~GCodeTimeEstimator();
+
+   /**
+    * Clears all estimated time and restores the default printer state.
+    */
+   void reset();
+
+   /**
+    * Counts any time from here on towards the given section.
+    */
+   void setSection(int section);
+
+   /**
+    * Places the printer at a position without taking any time.
+    *
+    * @param[in]  position  The new position.
+    * @param[in]  feedRate  The feed rate, in mm per minute.
+    */
+   void setPosition(const double* position, double feedRate);
+
+   const double* getPosition() const;
+   double getFeedRate() const;
+
+   /**
+    * Adds an imported gcode command.
+    *
+    * @param[in]  code    The command.
+    * @param[in]  offset  An optional offset to apply to its position.
+    */
+   void addCode(const GCodeCommand& code, const double* offset = NULL);
+
+   /**
+    * Adds a movement.
+    *
+    * @param[in]  target     The position to move to.
+    * @param[in]  extrusion  The amount of filament to extrude.
+    * @param[in]  feedRate   The feed rate, in mm per minute.
+    */
+   void addMove(const double* target, double extrusion, double feedRate);
+
+   /**
+    * Adds an arc movement, followed in short segments like the firmware does.
+    *
+    * @param[in]  target     The position to move to.
+    * @param[in]  center     The center of the arc.
+    * @param[in]  clockwise  Whether the arc turns clockwise.
+    * @param[in]  extrusion  The amount of filament to extrude over the arc.
+    * @param[in]  feedRate   The feed rate, in mm per minute.
+    */
+   void addArc(const double* target, const double* center, bool clockwise, double extrusion, double feedRate);
+
+   /**
+    * Adds a wait once all movements have finished.
+    *
+    * @param[in]  seconds  The time to wait.
+    */
+   void addWait(double seconds);
+
+   /**
+    * Sets the temperature of an extruder, heating at its heat up rate.
+    *
+    * @param[in]  extruder  The extruder index.
+    * @param[in]  temp      The target temperature.
+    * @param[in]  wait      Whether to wait for the temperature to be reached.
+    */
+   void setTemperature(int extruder, double temp, bool wait);
+
+   /**
+    * Estimates the time taken by a whole gcode file, with
+    * a section for every layer.
+    *
+    * @param[in]  fileName        The name of the gcode file.
+    * @param[in]  sectionOffsets  Optionally where each section begins, in
+    *                             bytes of text, for files whose layers are
+    *                             already known.  Otherwise a section begins
+    *                             with the first extrusion above the last.
+    */
+   bool estimateFile(const QString& fileName, const std::vector<qint64>* sectionOffsets = NULL);
+
+   /**
+    * Finishes all remaining movements and retrieves the total time, in seconds.
+    */
+   double getTotalTime();
+
+   /**
+    * Finishes all remaining movements and retrieves the time of each section.
+    */
+   const std::vector<double>& getSectionTimes();
+
+   const QString& getError() const;
+
+   /**
+    * Formats a time in seconds as hours, minutes and seconds.
+    */
+   static QString formatTime(double seconds);
+
+protected:
+
+private:
+
+   /**
+    * A single planned movement.
+    */
+   struct PlanBlock
+   {
+      double distance;
+      double acceleration;
+      double nominalSpeed;
+      double maxEntrySpeed;
+      double entrySpeed;
+      int    section;
+   };
+
+   /**
+    * Applies the machine limit, dwell and temperature codes from a command.
+    */
+   void applyCommand(int type, const QString& command);
+
+   /**
+    * Plans the queued movements, assuming the last one comes to a stop.
+    */
+   void recalculate();
+
+   /**
+    * Retires the first queued movement and adds up its time.
+    */
+   void retireBlock();
+
+   /**
+    * Retires every queued movement.
+    */
+   void flush();
+
+   /**
+    * Brings the temperature of an extruder up to the current time.
+    */
+   void updateTemperature(int extruder);
+
+   void addTime(int section, double seconds);
+
+   const PreferenceData& mPrefs;
+
+   // Printer limits, per axis.
+   double mMaxFeedRate[AXIS_NUM];
+   double mMaxAcceleration[AXIS_NUM];
+   double mJerk[AXIS_NUM];
+   double mPrintAcceleration;
+   double mRetractAcceleration;
+   double mTravelAcceleration;
+   double mJunctionDeviation;
+
+   std::deque<PlanBlock> mPlanQueue;
+   double mPosition[AXIS_NUM_NO_E];
+   double mFeedRate;
+   int mExtruder;
+   double mLastDirection[AXIS_NUM];
+   double mLastNominalSpeed;
+
+   // The temperature of each extruder and when it was set.
+   std::vector<double> mTemperature;
+   std::vector<double> mTargetTemperature;
+   std::vector<double> mTemperatureTime;
+
+   int mSection;
+   double mTotalTime;
+   std::vector<double> mSectionTimes;
+
+   QString mError;
+};
+
+#endif // G_CODE_TIME_ESTIMATOR_H
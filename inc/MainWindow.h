@@ -57,10 +57,14 @@ public slots:
    void onObjectSelectionChanged();
    void onAddPressed();
    void onRemovePressed();
+   void onDuplicatePressed();
+   void onMemoryPressed();
    void onPlaterXPosChanged(double pos);
    void onPlaterYPosChanged(double pos);
    void onPlaterZPosChanged(double pos);
+   void onArrangePressed();
    void onSplicePressed();
+   void onResumePressed();
 #ifdef BUILD_DEBUG_CONTROLS
    void onDebugExportLayerDataPressed();
 #endif
@@ -73,6 +77,14 @@ public slots:
 private:
    void updateLayerSlider();
 
+   /**
+    * Adds an object to the visualizer and the object list.
+    *
+    * @param[in]  object  The object, which is then owned by the window.
+    * @param[in]  name    The name shown in the object list.
+    */
+   void insertObject(GCodeObject* object, const QString& name);
+
    void setupUI();
    void setupConnections();
 
@@ -92,10 +104,14 @@ private:
    QTableWidget*     mObjectListWidget;
    QPushButton*      mAddFileButton;
    QPushButton*      mRemoveFileButton;
+   QPushButton*      mDuplicateButton;
+   QPushButton*      mMemoryButton;
    QDoubleSpinBox*   mPlaterXPosSpin;
    QDoubleSpinBox*   mPlaterYPosSpin;
    QDoubleSpinBox*   mPlaterZPosSpin;
+   QPushButton*      mArrangeButton;
    QPushButton*      mSpliceButton;
+   QPushButton*      mResumeButton;
 #ifdef BUILD_DEBUG_CONTROLS
    QPushButton*      mDebugExportLayerButton;
 #endif
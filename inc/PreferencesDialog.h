@@ -60,6 +60,8 @@ public slots:
    void onUseDisplayListsChanged(int state);
    void onDrawQualityChanged(int value);
    void onLayerSkipChanged(int value);
+   void onGeometryCacheSizeChanged(int value);
+   void onMemoryBudgetChanged(int value);
    void onBackgroundColorPressed();
 
    //// Splicing Tab.
@@ -69,8 +71,11 @@ public slots:
    void onSwapChanged();
    void onExportCommentsChanged(int state);
    void onExportAllAxesChanged(int state);
+   void onExportCompactChanged(int state);
    void onPrintSkirtChanged(int state);
    void onSkirtDistanceChanged(double value);
+   void onSwapZToleranceChanged(double value);
+   void onArcToleranceChanged(double value);
 
    //// Printer Tab.
    void onExtruderSelected(int index);
@@ -86,15 +91,18 @@ public slots:
    void onExtruderPrimerChanged(double value);
    void onExtruderTravelSpeedChanged(double value);
    void onExtruderRetractSpeedChanged(double value);
+   void onExtruderHeatUpRateChanged(double value);
    void onExtruderColorPressed();
    void onPlatformWidthChanged(double value);
    void onPlatformHeightChanged(double value);
+   void onArrangeClearanceChanged(double value);
 
    //// Advanced Tab.
    void onExportAbsoluteModeChanged(int state);
    void onExportAbsoluteEModeChanged(int state);
    void onImportRetractionChanged(double value);
    void onImportPrimerChanged(double value);
+   void onImportReadAheadChanged(int state);
 
    //// Dialog buttons.
    void onOkPressed();
@@ -127,6 +135,8 @@ private:
    QCheckBox*        mUseDisplayListsCheckbox;
    QComboBox*        mDrawQualityCombo;
    QSpinBox*         mLayerSkipSpin;
+   QSpinBox*         mGeometryCacheSizeSpin;
+   QSpinBox*         mMemoryBudgetSpin;
    QPushButton*      mBackgroundColorButton;
 
    //// Splicing Tab
@@ -136,8 +146,11 @@ private:
    QTextEdit*        mGCodeSwapEdit;
    QCheckBox*        mExportCommentsCheckbox;
    QCheckBox*        mExportAllAxesCheckbox;
+   QCheckBox*        mExportCompactCheckbox;
    QCheckBox*        mPrintSkirtCheckbox;
    QDoubleSpinBox*   mSkirtDistanceSpin;
+   QDoubleSpinBox*   mSwapZToleranceSpin;
+   QDoubleSpinBox*   mArcToleranceSpin;
 
    //// Printer Tab.
    QListWidget*      mExtruderList;
@@ -153,9 +166,11 @@ private:
    QDoubleSpinBox*   mExtruderPrimerSpin;
    QDoubleSpinBox*   mExtruderTravelSpeedSpin;
    QDoubleSpinBox*   mExtruderRetractSpeedSpin;
+   QDoubleSpinBox*   mExtruderHeatUpRateSpin;
    QPushButton*      mExtruderColorButton;
    QDoubleSpinBox*   mPlatformWidthSpin;
    QDoubleSpinBox*   mPlatformHeightSpin;
+   QDoubleSpinBox*   mArrangeClearanceSpin;
    int               mCurrentExtruder;
 
    //// Advanced Tab.
@@ -163,6 +178,7 @@ private:
    QCheckBox*        mExportAbsoluteEModeCheckbox;
    QDoubleSpinBox*   mImportRetractionSpin;
    QDoubleSpinBox*   mImportPrimerSpin;
+   QCheckBox*        mImportReadAheadCheckbox;
 
    //// Dialog Buttons.
    QPushButton*      mOkButton;
@@ -0,0 +1,115 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef READ_AHEAD_READER_H
+#define READ_AHEAD_READER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QThread>
+
+// The number of blocks that can be read ahead of the parser.
+const static int READ_AHEAD_SLOT_COUNT = 4;
+
+
+/**
+ * Reads a file on a thread of its own, staying a few large blocks ahead
+ * of whoever is consuming it so slow storage is read while they work.
+ *
+ * Blocks are handed over through a ring that only this thread fills and
+ * only the consumer empties, so neither side ever takes a lock.  Only a
+ * single thread may consume the file at a time.
+ */
+class ReadAheadReader : public QThread
+{
+public:
+   ReadAheadReader();
+   virtual ~ReadAheadReader();
+
+   /**
+    * Opens a file and begins reading it ahead.
+    *
+    * @param[in]  fileName  The name of the file to read.
+    * @param[in]  offset    The position in the file to begin from.
+    */
+   bool open(const QString& fileName, qint64 offset);
+   void close();
+
+   /**
+    * Copies the next bytes of the file, waiting on the reader thread
+    * if they have not been read yet.
+    *
+    * @param[out]  data     The buffer to copy into.
+    * @param[in]   maxSize  The number of bytes wanted.
+    *
+    * @return  Returns the number of bytes copied, which is only less
+    *          than asked for at the end of the file.
+    */
+   int read(char* data, int maxSize);
+
+   /**
+    * Retrieves whether everything in the file has been consumed,
+    * waiting on the reader thread if it can not tell yet.
+    */
+   bool atEnd();
+
+   /**
+    * Retrieves the position in the file that has been consumed up to.
+    */
+   qint64 pos() const;
+
+   /**
+    * Retrieves the error that stopped the reader early, if any.
+    */
+   const QString& getError() const;
+
+protected:
+   virtual void run();
+
+private:
+
+   /**
+    * Waits for the reader thread to fill the next slot.
+    *
+    * @return  Returns false if the end of file was reached first.
+    */
+   bool waitForSlot();
+
+   QFile mFile;
+
+   // Each slot holds one block, the indices only ever grow and
+   // are each written by one side of the ring.
+   QByteArray mSlots[READ_AHEAD_SLOT_COUNT];
+   QAtomicInt mWriteIndex;
+   QAtomicInt mReadIndex;
+   QAtomicInt mFinished;
+   QAtomicInt mStopping;
+
+   // Only the consumer touches these.
+   int mSlotPos;
+   qint64 mPos;
+
+   // Only written by the reader thread before it finishes.
+   QString mError;
+};
+
+
+#endif // READ_AHEAD_READER_H
@@ -0,0 +1,162 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+
+
+/**
+ * Records timed spans and writes them out in the Chrome trace event
+ * format, which can be opened in chrome://tracing or Perfetto.
+ *
+ * While tracing is disabled every span costs a single branch.
+ */
+class Trace
+{
+public:
+   /**
+    * Begins recording spans.
+    *
+    * @param[in]  fileName  The file to write the trace to once stopped.
+    */
+   static void start(const QString& fileName);
+
+   /**
+    * Stops recording and writes every recorded span to file.
+    */
+   static bool stop();
+
+   static inline bool isEnabled()
+   {
+      return mEnabled;
+   }
+
+   /**
+    * Retrieves the time since tracing started, in microseconds.
+    */
+   static qint64 getTime();
+
+   /**
+    * Records a completed span.
+    *
+    * @param[in]  name      The name of the span, must be a string literal.
+    * @param[in]  start     The start time, in microseconds.
+    * @param[in]  duration  The duration, in microseconds.
+    * @param[in]  args      Optional JSON object members, such as "\"lines\": 10".
+    */
+   static void addEvent(const char* name, qint64 start, qint64 duration, const QString& args = QString());
+
+private:
+   static bool mEnabled;
+};
+
+/**
+ * Records a span for as long as it stays in scope.
+ */
+class TraceSpan
+{
+public:
+   TraceSpan(const char* name)
+      : mName(Trace::isEnabled()? name: NULL)
+      , mStart(0)
+   {
+      if (mName)
+      {
+         mStart = Trace::getTime();
+      }
+   }
+
+   ~TraceSpan()
+   {
+      if (mName)
+      {
+         Trace::addEvent(mName, mStart, Trace::getTime() - mStart);
+      }
+   }
+
+private:
+   const char* mName;
+   qint64      mStart;
+};
+
+/**
+ * Accumulates the time of many small calls that would be too
+ * numerous to record as spans of their own.
+ */
+class TraceAccumulator
+{
+public:
+   TraceAccumulator()
+      : mStart(0)
+      , mTotal(0)
+      , mCount(0)
+   {
+   }
+
+   inline void begin()
+   {
+      if (Trace::isEnabled())
+      {
+         mStart = Trace::getTime();
+      }
+   }
+
+   inline void end()
+   {
+      if (Trace::isEnabled())
+      {
+         mTotal += Trace::getTime() - mStart;
+         mCount++;
+      }
+   }
+
+   void reset()
+   {
+      mTotal = 0;
+      mCount = 0;
+   }
+
+   qint64 getTotal() const
+   {
+      return mTotal;
+   }
+
+   int getCount() const
+   {
+      return mCount;
+   }
+
+private:
+   qint64 mStart;
+   qint64 mTotal;
+   int    mCount;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+/**
+ * Records a span from this point until the end of the current scope.
+ */
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACE_H
@@ -55,7 +55,52 @@ public:
 
    void setLayerDrawHeight(double height);
 
-   bool regenerateGeometry();
+   /**
+    * Makes sure every object has geometry for the current draw quality
+    * and layer skip preferences.  Geometry that was generated before is
+    * kept in a cache so switching back to it does not rebuild anything.
+    */
+   bool prepareGeometry();
+
+   /**
+    * Retrieves the number of bytes used by the geometry of every object
+    * at the given draw quality and the current layer skip.
+    */
+   unsigned long long getGeometryMemoryUsage(DrawQuality quality) const;
+
+   /**
+    * Adds the memory used by every cached geometry of an object to the given usage.
+    */
+   void getMemoryUsage(const GCodeObject* object, MemoryUsage& usage) const;
+
+   /**
+    * Estimates the geometry memory every object would use when drawn at the
+    * given quality and layer skip, without generating anything.
+    */
+   unsigned long long estimateGeometryMemory(DrawQuality quality, int layerSkipSize) const;
+
+   /**
+    * Estimates the buffers the geometry of an object would use at the given
+    * quality and layer skip, without generating anything or needing a context.
+    *
+    * @param[in]   data             The parsed data of the object.
+    * @param[in]   quality          The quality of the geometry.
+    * @param[in]   layerSkipSize    The number of layers skipped between each drawn layer.
+    * @param[in]   useDisplayLists  Whether the geometry is also compiled into display lists.
+    * @param[out]  usage            The usage to add the estimate to.
+    */
+   static void estimateGeometryUsage(const GCodeObjectData& data, DrawQuality quality, int layerSkipSize, bool useDisplayLists, MemoryUsage& usage);
+
+   /**
+    * Moves the camera directly to its target instead of easing into it.
+    */
+   void snapCamera();
+
+   /**
+    * Renders a single frame into whatever framebuffer is currently bound
+    * and waits for it to finish, without swapping buffers.
+    */
+   void renderFrame();
 
    const QString& getError() const;
 
@@ -94,20 +139,85 @@ protected:
    void mouseMoveEvent(QMouseEvent *event);
    void wheelEvent(QWheelEvent* event);
 
-   bool genObject(VisualizerObjectData& object, QProgressDialog& progressDialog);
-   void callObject(const VisualizerObjectData& object);
-   void drawObject(const VisualizerObjectData& object);
+   bool genObject(VisualizerGeometryData& geometry, QProgressDialog& progressDialog);
+   void callObject(const GCodeObject& object, const VisualizerGeometryData& geometry);
+   void drawObject(const GCodeObject& object, const VisualizerGeometryData& geometry);
+
+   /**
+    * Draws the cheap line representation of an object, used while
+    * the camera is moving.
+    */
+   void drawInteractionObject(const GCodeObject& object, const VisualizerGeometryData& geometry);
    void drawPlatform();
 
 private:
 
    /**
     * Generate geometry data for the given object.
+    *
+    * @param[in]      data      The object to generate geometry for.
+    * @param[in,out]  geometry  The geometry to fill, using its quality and layer skip.
     */
-   bool generateGeometry(VisualizerObjectData& data, QProgressDialog& progressDialog);
+   bool generateGeometry(VisualizerObjectData& data, VisualizerGeometryData& geometry, QProgressDialog& progressDialog);
+
+   /**
+    * Counts the vertices and quads every layer of an object needs.
+    *
+    * @param[in]   data           The parsed data of the object.
+    * @param[in]   quality        The quality of the geometry.
+    * @param[in]   layerSkipSize  The number of layers skipped between each drawn layer.
+    * @param[out]  layers         The layers to fill with their counts.
+    */
+   static void countGeometry(const GCodeObjectData& data, DrawQuality quality, int layerSkipSize, std::vector<VisualizerBufferData>& layers);
    void addGeometryPoint(double* buffer, int& index, const QVector3D& point);
 
+   /**
+    * Adds the geometry of a single extruded line segment to a layer.
+    *
+    * @param[in,out]  buffer       The layer buffer to fill.
+    * @param[in]      quality      The quality of the geometry.
+    * @param[in]      p1           The start of the segment.
+    * @param[in]      p2           The end of the segment.
+    * @param[in]      radius       Half the width of the extruded line.
+    * @param[in,out]  pointIndex   The next vertex to fill.
+    * @param[in,out]  normalIndex  The next normal to fill.
+    * @param[in,out]  quadIndex    The next quad index to fill.
+    */
+   void addGeometrySegment(VisualizerBufferData& buffer, DrawQuality quality, const QVector3D& p1, const QVector3D& p2, double radius, int& pointIndex, int& normalIndex, int& quadIndex);
+
+   /**
+    * Retrieves the geometry data shared by every instance of
+    * the given parsed data, or NULL if there is none.
+    */
+   VisualizerObjectData* findObjectData(const GCodeObjectData* data);
+   const VisualizerObjectData* findObjectData(const GCodeObjectData* data) const;
+
+   /**
+    * Retrieves the cached geometry of an object for the given
+    * quality and layer skip, or NULL if it was never generated.
+    */
+   VisualizerGeometryData* findGeometry(VisualizerObjectData& data, DrawQuality quality, int layerSkipSize);
+   const VisualizerGeometryData* findGeometry(const VisualizerObjectData& data, DrawQuality quality, int layerSkipSize) const;
+
+   /**
+    * Retrieves the cached geometry of an object, generating it first if necessary.
+    */
+   VisualizerGeometryData* ensureGeometry(VisualizerObjectData& data, DrawQuality quality, int layerSkipSize, QProgressDialog& progressDialog);
+
+   /**
+    * Retrieves whether the given geometry is drawn with the current preferences.
+    */
+   bool isGeometryInUse(const VisualizerGeometryData& geometry) const;
+
+   /**
+    * Frees the least recently used geometry that is not in use
+    * until the cache fits within its preferred size.
+    */
+   void trimGeometryCache();
+
    void freeBuffers(VisualizerObjectData& data);
+   void freeBuffers(std::vector<VisualizerBufferData>& layers);
+   void freeDisplayLists(VisualizerGeometryData& geometry);
 
    double mCameraRot[AXIS_NUM_NO_E];
    double mCameraTrans[AXIS_NUM_NO_E];
@@ -126,9 +236,19 @@ private:
    double mCameraRotDirection;
 
    double mLayerDrawHeight;
+
+   // While the camera is moving towards its target we draw
+   // a cheaper representation of every object.
+   bool   mInteracting;
+   int    mInteractionLayerStride;
+
+   unsigned int mGeometryUseCounter;
    
    std::vector<VisualizerObjectData> mObjectList;
 
+   // Every object drawn, several of which may share the same geometry.
+   std::vector<GCodeObject*>         mInstanceList;
+
    QString mError;
 };
 
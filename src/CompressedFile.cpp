@@ -0,0 +1,141 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <CompressedFile.h>
+
+#include <zlib.h>
+#include <string.h>
+
+// The size of the buffer compressed data is gathered in before being written.
+const static int DEFLATE_CHUNK_SIZE = 64 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+CompressedFile::CompressedFile()
+   : mCompressed(false)
+   , mStream(NULL)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CompressedFile::~CompressedFile()
+{
+   // QFile only closes itself after our part of the object is gone.
+   close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void CompressedFile::setCompressed(bool compressed)
+{
+   mCompressed = compressed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool CompressedFile::isCompressed() const
+{
+   return mCompressed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool CompressedFile::open(OpenMode mode)
+{
+   if (!QFile::open(mode))
+   {
+      return false;
+   }
+
+   if (mCompressed && (mode & QIODevice::WriteOnly))
+   {
+      mStream = new z_stream;
+      memset(mStream, 0, sizeof(z_stream));
+
+      // Adding 16 to the window bits makes zlib write a gzip header.
+      if (deflateInit2(mStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+         delete mStream;
+         mStream = NULL;
+         QFile::close();
+         return false;
+      }
+
+      mDeflateBuffer.resize(DEFLATE_CHUNK_SIZE);
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void CompressedFile::close()
+{
+   if (mStream)
+   {
+      deflateData(NULL, 0, Z_FINISH);
+      deflateEnd(mStream);
+      delete mStream;
+      mStream = NULL;
+   }
+
+   QFile::close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 CompressedFile::writeData(const char* data, qint64 len)
+{
+   if (!mStream)
+   {
+      return QFile::writeData(data, len);
+   }
+
+   if (!deflateData(data, len, Z_NO_FLUSH))
+   {
+      return -1;
+   }
+
+   return len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool CompressedFile::deflateData(const char* data, qint64 len, int flush)
+{
+   mStream->next_in = (Bytef*)data;
+   mStream->avail_in = (uInt)len;
+
+   // Keep deflating until zlib has nothing more to give us.
+   do
+   {
+      mStream->next_out = (Bytef*)mDeflateBuffer.data();
+      mStream->avail_out = DEFLATE_CHUNK_SIZE;
+
+      int result = deflate(mStream, flush);
+      if (result == Z_STREAM_ERROR)
+      {
+         return false;
+      }
+
+      qint64 size = DEFLATE_CHUNK_SIZE - mStream->avail_out;
+      if (size > 0 && QFile::writeData(mDeflateBuffer.constData(), size) != size)
+      {
+         return false;
+      }
+   } while (mStream->avail_out == 0);
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
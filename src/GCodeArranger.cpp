@@ -0,0 +1,368 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <GCodeArranger.h>
+#include <GCodeObject.h>
+#include <Trace.h>
+
+#include <algorithm>
+#include <math.h>
+
+/**
+ * The height of each slab footprints are compared with, in millimetres.
+ * Smaller slabs pack closer at the cost of more comparisons.
+ */
+const static double ARRANGE_SLAB_SIZE = 1.0;
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeArranger::GCodeArranger(const PreferenceData& prefs)
+   : mPrefs(prefs)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeArranger::~GCodeArranger()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeArranger::addObject(GCodeObject* object)
+{
+   if (!object)
+   {
+      return false;
+   }
+
+   // Make sure we don't add the same object twice.
+   int count = (int)mItemList.size();
+   for (int index = 0; index < count; ++index)
+   {
+      if (object == mItemList[index].object)
+      {
+         return false;
+      }
+   }
+
+   ArrangeItem item;
+   item.object = object;
+   mItemList.push_back(item);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeArranger::arrange(double clearance)
+{
+   TRACE_SPAN("GCodeArranger::arrange");
+
+   mError.clear();
+
+   int itemCount = (int)mItemList.size();
+   if (itemCount == 0)
+   {
+      return true;
+   }
+
+   clearance = qMax(0.0, clearance);
+
+   // Every extruder we print with must be able to reach every object,
+   // so we can only use the area of the platform they all share.
+   double platformSize[2];
+   platformSize[X] = mPrefs.platformWidth;
+   platformSize[Y] = mPrefs.platformHeight;
+
+   double regionMin[2] = {0.0, 0.0};
+   double regionMax[2] = {platformSize[X], platformSize[Y]};
+   for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+   {
+      int extruderIndex = mItemList[itemIndex].object->getExtruder();
+      if (extruderIndex < 0 || extruderIndex >= (int)mPrefs.extruderList.size())
+      {
+         extruderIndex = 0;
+      }
+
+      if (extruderIndex < (int)mPrefs.extruderList.size())
+      {
+         const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+         for (int axis = 0; axis < 2; ++axis)
+         {
+            regionMin[axis] = qMax(regionMin[axis], -extruder.offset[axis]);
+            regionMax[axis] = qMin(regionMax[axis], platformSize[axis] - extruder.offset[axis]);
+         }
+      }
+   }
+
+   double regionWidth = regionMax[X] - regionMin[X];
+   double regionHeight = regionMax[Y] - regionMin[Y];
+   if (regionWidth <= 0.0 || regionHeight <= 0.0)
+   {
+      mError = "The extruder offsets leave no room on the platform.";
+      return false;
+   }
+
+   for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+   {
+      buildItem(mItemList[itemIndex], clearance);
+   }
+
+   // Tallest items first, so every shelf is as tall as its first item.
+   std::stable_sort(mItemList.begin(), mItemList.end(), isTaller);
+
+   std::vector<ArrangeShelf> shelfList;
+   int placedCount = 0;
+   for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+   {
+      ArrangeItem& item = mItemList[itemIndex];
+
+      bool placed = false;
+      int shelfCount = (int)shelfList.size();
+      for (int shelfIndex = 0; shelfIndex < shelfCount && !placed; ++shelfIndex)
+      {
+         ArrangeShelf& shelf = shelfList[shelfIndex];
+         if (item.height > shelf.height)
+         {
+            continue;
+         }
+
+         double pos = getShelfPos(shelf, item, clearance);
+         if (pos + item.width <= regionWidth)
+         {
+            item.pos[X] = pos;
+            item.pos[Y] = shelf.y;
+            shelf.items.push_back(itemIndex);
+            placed = true;
+         }
+      }
+
+      // Start a new shelf above the last one.
+      if (!placed && item.width <= regionWidth)
+      {
+         double y = 0.0;
+         if (!shelfList.empty())
+         {
+            y = shelfList.back().y + shelfList.back().height + clearance;
+         }
+
+         if (y + item.height <= regionHeight)
+         {
+            ArrangeShelf shelf;
+            shelf.y = y;
+            shelf.height = item.height;
+            shelf.items.push_back(itemIndex);
+            shelfList.push_back(shelf);
+
+            item.pos[X] = 0.0;
+            item.pos[Y] = y;
+            placed = true;
+         }
+      }
+
+      if (placed)
+      {
+         placedCount++;
+      }
+   }
+
+   if (placedCount < itemCount)
+   {
+      mError = QString("Only %1 of %2 objects fit on the platform.").arg(placedCount).arg(itemCount);
+      return false;
+   }
+
+   // Center the whole arrangement within the usable area.
+   double blockWidth = 0.0;
+   for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+   {
+      blockWidth = qMax(blockWidth, mItemList[itemIndex].pos[X] + mItemList[itemIndex].width);
+   }
+   double blockHeight = shelfList.back().y + shelfList.back().height;
+
+   double origin[2];
+   origin[X] = regionMin[X] + ((regionWidth - blockWidth) / 2.0);
+   origin[Y] = regionMin[Y] + ((regionHeight - blockHeight) / 2.0);
+
+   for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+   {
+      const ArrangeItem& item = mItemList[itemIndex];
+      item.object->setOffsetPos(
+         origin[X] + item.pos[X] - item.footprintMin[X],
+         origin[Y] + item.pos[Y] - item.footprintMin[Y],
+         item.object->getOffsetPos()[Z]);
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const QString& GCodeArranger::getError() const
+{
+   return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeArranger::buildItem(ArrangeItem& item, double clearance)
+{
+   item.footprint = item.object->getFootprint();
+
+   // Without a proper footprint we fall back to the bounding box.
+   if (item.footprint.size() < 3)
+   {
+      const double* minBounds = item.object->getMinBounds();
+      const double* maxBounds = item.object->getMaxBounds();
+
+      item.footprint.clear();
+      item.footprint.push_back(QPointF(minBounds[X], minBounds[Y]));
+      item.footprint.push_back(QPointF(maxBounds[X], minBounds[Y]));
+      item.footprint.push_back(QPointF(maxBounds[X], maxBounds[Y]));
+      item.footprint.push_back(QPointF(minBounds[X], maxBounds[Y]));
+   }
+
+   int pointCount = (int)item.footprint.size();
+   double footprintMax[2];
+   item.footprintMin[X] = footprintMax[X] = item.footprint[0].x();
+   item.footprintMin[Y] = footprintMax[Y] = item.footprint[0].y();
+   for (int pointIndex = 1; pointIndex < pointCount; ++pointIndex)
+   {
+      const QPointF& point = item.footprint[pointIndex];
+      item.footprintMin[X] = qMin(item.footprintMin[X], point.x());
+      item.footprintMin[Y] = qMin(item.footprintMin[Y], point.y());
+      footprintMax[X] = qMax(footprintMax[X], point.x());
+      footprintMax[Y] = qMax(footprintMax[Y], point.y());
+   }
+
+   QPointF footprintMin(item.footprintMin[X], item.footprintMin[Y]);
+   for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+   {
+      item.footprint[pointIndex] -= footprintMin;
+   }
+
+   item.width = footprintMax[X] - item.footprintMin[X];
+   item.height = footprintMax[Y] - item.footprintMin[Y];
+   item.pos[X] = 0.0;
+   item.pos[Y] = 0.0;
+
+   int slabCount = qMax(1, (int)ceil(item.height / ARRANGE_SLAB_SIZE));
+   item.slabLeft.resize(slabCount);
+   item.slabRight.resize(slabCount);
+   for (int slab = 0; slab < slabCount; ++slab)
+   {
+      double minY = slab * ARRANGE_SLAB_SIZE;
+      if (!getExtents(item.footprint, minY, minY + ARRANGE_SLAB_SIZE, item.slabLeft[slab], item.slabRight[slab]))
+      {
+         item.slabLeft[slab] = item.width;
+         item.slabRight[slab] = 0.0;
+      }
+   }
+
+   // Anything within the clearance above or below a slab
+   // must also be kept clear of it.
+   int reach = (int)ceil(clearance / ARRANGE_SLAB_SIZE);
+   item.grownRight.resize(slabCount);
+   for (int slab = 0; slab < slabCount; ++slab)
+   {
+      int first = qMax(0, slab - reach);
+      int last = qMin(slabCount - 1, slab + reach);
+
+      item.grownRight[slab] = item.slabRight[first];
+      for (int other = first + 1; other <= last; ++other)
+      {
+         item.grownRight[slab] = qMax(item.grownRight[slab], item.slabRight[other]);
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeArranger::getShelfPos(const ArrangeShelf& shelf, const ArrangeItem& item, double clearance) const
+{
+   // Slide the item as far left as it can go while staying clear of
+   // everything already on the shelf.  Since every item on a shelf is
+   // at least as tall as this one, their slabs always line up.
+   double pos = 0.0;
+
+   int count = (int)shelf.items.size();
+   for (int index = 0; index < count; ++index)
+   {
+      const ArrangeItem& other = mItemList[shelf.items[index]];
+
+      int slabCount = qMin((int)item.slabLeft.size(), (int)other.grownRight.size());
+      for (int slab = 0; slab < slabCount; ++slab)
+      {
+         pos = qMax(pos, other.pos[X] + other.grownRight[slab] + clearance - item.slabLeft[slab]);
+      }
+   }
+
+   return pos;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeArranger::getExtents(const std::vector<QPointF>& polygon, double minY, double maxY, double& outLeft, double& outRight)
+{
+   bool found = false;
+
+   int pointCount = (int)polygon.size();
+   for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+   {
+      const QPointF& start = polygon[pointIndex];
+      const QPointF& end = polygon[(pointIndex + 1) % pointCount];
+
+      if ((start.y() < minY && end.y() < minY) ||
+          (start.y() > maxY && end.y() > maxY))
+      {
+         continue;
+      }
+
+      // Clip the edge to the slab.
+      double startX = start.x();
+      double endX = end.x();
+      if (start.y() != end.y())
+      {
+         double lowT = (minY - start.y()) / (end.y() - start.y());
+         double highT = (maxY - start.y()) / (end.y() - start.y());
+         if (lowT > highT)
+         {
+            qSwap(lowT, highT);
+         }
+
+         lowT = qMax(0.0, lowT);
+         highT = qMin(1.0, highT);
+
+         startX = start.x() + (end.x() - start.x()) * lowT;
+         endX = start.x() + (end.x() - start.x()) * highT;
+      }
+
+      if (!found)
+      {
+         outLeft = outRight = startX;
+         found = true;
+      }
+
+      outLeft = qMin(outLeft, qMin(startX, endX));
+      outRight = qMax(outRight, qMax(startX, endX));
+   }
+
+   return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeArranger::isTaller(const ArrangeItem& left, const ArrangeItem& right)
+{
+   return left.height > right.height;
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,291 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <GCodeEmitter.h>
+
+#include <zlib.h>
+#include <string.h>
+
+// The binary block each metadata type is written to.
+const static BinaryBlockType METADATA_BLOCK_TYPE[METADATA_TYPE_NUM] =
+{
+   BINARY_BLOCK_FILE_METADATA,
+   BINARY_BLOCK_PRINTER_METADATA,
+   BINARY_BLOCK_PRINT_METADATA,
+   BINARY_BLOCK_SLICER_METADATA,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Appends an unsigned value in little endian byte order.
+ */
+static void appendValue(QByteArray& data, quint32 value, int size)
+{
+   for (int index = 0; index < size; ++index)
+   {
+      data.append((char)((value >> (index * 8)) & 0xFF));
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeEmitter::GCodeEmitter(const QString& fileName)
+   : mFileName(fileName)
+   , mPosition(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeEmitter::~GCodeEmitter()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeEmitter* GCodeEmitter::create(const QString& fileName)
+{
+   if (fileName.endsWith(".bgcode", Qt::CaseInsensitive))
+   {
+      return new GCodeBinaryEmitter(fileName);
+   }
+
+   return new GCodeTextEmitter(fileName);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeEmitter::write(const char* data)
+{
+   write(QByteArray::fromRawData(data, (int)strlen(data)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 GCodeEmitter::getPosition() const
+{
+   return mPosition;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeTextEmitter::GCodeTextEmitter(const QString& fileName)
+   : GCodeEmitter(fileName)
+{
+   // Files named with a .gz extension are compressed as they are written.
+   mFile.setFileName(fileName);
+   mFile.setCompressed(fileName.endsWith(".gz", Qt::CaseInsensitive));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeTextEmitter::~GCodeTextEmitter()
+{
+   close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeTextEmitter::open(bool append)
+{
+   QIODevice::OpenMode mode = QIODevice::WriteOnly;
+   if (append)
+   {
+      mode |= QIODevice::Append;
+   }
+
+   mPosition = 0;
+   return mFile.open(mode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTextEmitter::close()
+{
+   if (mFile.isOpen())
+   {
+      mFile.close();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTextEmitter::write(const QByteArray& data)
+{
+   mFile.write(data);
+   mPosition += data.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTextEmitter::addMetadata(MetadataType type, const QString& key, const QString& value)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeBinaryEmitter::GCodeBinaryEmitter(const QString& fileName)
+   : GCodeEmitter(fileName)
+   , mMetadataWritten(false)
+{
+   mFile.setFileName(fileName);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeBinaryEmitter::~GCodeBinaryEmitter()
+{
+   close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeBinaryEmitter::open(bool append)
+{
+   QIODevice::OpenMode mode = QIODevice::WriteOnly;
+   if (append)
+   {
+      mode |= QIODevice::Append;
+   }
+
+   if (!mFile.open(mode))
+   {
+      return false;
+   }
+
+   mBlockBuffer.clear();
+   mPosition = 0;
+
+   // Appending only adds more gcode blocks to the end.
+   mMetadataWritten = append;
+   if (!append)
+   {
+      QByteArray header(BINARY_MAGIC, 4);
+      appendValue(header, BINARY_VERSION, 4);
+      appendValue(header, BINARY_CHECKSUM_CRC32, 2);
+      mFile.write(header);
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeBinaryEmitter::close()
+{
+   if (!mFile.isOpen())
+   {
+      return;
+   }
+
+   if (!mMetadataWritten)
+   {
+      writeMetadata();
+   }
+
+   if (!mBlockBuffer.isEmpty())
+   {
+      writeGCodeBlock(mBlockBuffer.size());
+   }
+
+   mFile.close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeBinaryEmitter::write(const QByteArray& data)
+{
+   if (!mMetadataWritten)
+   {
+      writeMetadata();
+   }
+
+   mBlockBuffer.append(data);
+   mPosition += data.size();
+   while (mBlockBuffer.size() >= BINARY_BLOCK_SIZE)
+   {
+      // Blocks end on a whole line unless a single line fills one.
+      int size = mBlockBuffer.lastIndexOf('\n', BINARY_BLOCK_SIZE - 1) + 1;
+      if (size == 0)
+      {
+         size = BINARY_BLOCK_SIZE;
+      }
+
+      writeGCodeBlock(size);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeBinaryEmitter::addMetadata(MetadataType type, const QString& key, const QString& value)
+{
+   // Metadata is stored as INI formatted text.
+   mMetadata[type] += key.toAscii() + "=" + value.toAscii() + "\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeBinaryEmitter::writeMetadata()
+{
+   mMetadataWritten = true;
+
+   for (int type = 0; type < METADATA_TYPE_NUM; ++type)
+   {
+      // Only the file metadata is optional.
+      if (type != METADATA_FILE || !mMetadata[type].isEmpty())
+      {
+         writeBlock(METADATA_BLOCK_TYPE[type], mMetadata[type], BINARY_COMPRESSION_NONE);
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeBinaryEmitter::writeGCodeBlock(int size)
+{
+   writeBlock(BINARY_BLOCK_GCODE, mBlockBuffer.left(size), BINARY_COMPRESSION_DEFLATE);
+   mBlockBuffer.remove(0, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeBinaryEmitter::writeBlock(BinaryBlockType type, const QByteArray& data, BinaryCompression compression)
+{
+   QByteArray payload = data;
+   if (compression == BINARY_COMPRESSION_DEFLATE)
+   {
+      uLongf size = compressBound((uLong)data.size());
+      QByteArray compressed(size, 0);
+
+      // Data that does not shrink is stored as it is.
+      if (compress2((Bytef*)compressed.data(), &size, (const Bytef*)data.constData(), (uLong)data.size(), Z_DEFAULT_COMPRESSION) == Z_OK &&
+         (int)size < data.size())
+      {
+         compressed.resize(size);
+         payload = compressed;
+      }
+      else
+      {
+         compression = BINARY_COMPRESSION_NONE;
+      }
+   }
+
+   QByteArray block;
+   appendValue(block, type, 2);
+   appendValue(block, compression, 2);
+   appendValue(block, data.size(), 4);
+   if (compression != BINARY_COMPRESSION_NONE)
+   {
+      appendValue(block, payload.size(), 4);
+   }
+
+   // Every block other than a thumbnail has a single encoding parameter,
+   // which is plain text for gcode and INI for metadata.
+   appendValue(block, 0, 2);
+
+   block.append(payload);
+
+   // The checksum covers everything in the block before it.
+   appendValue(block, crc32(0, (const Bytef*)block.constData(), (uInt)block.size()), 4);
+
+   mFile.write(block);
+}
+
+////////////////////////////////////////////////////////////////////////////////
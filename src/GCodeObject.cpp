@@ -20,26 +20,105 @@
 
 #include <GCodeObject.h>
 #include <GCodeParser.h>
+#include <Trace.h>
 
 #include <QtGui/QtGui>
 
+#include <algorithm>
 #include <math.h>
 
 
+/**
+ * Compares layers by their height, for searching through them.
+ */
+struct LayerHeightLess
+{
+   bool operator()(const LayerData& layer, qint32 height) const
+   {
+      return layer.height < height;
+   }
+
+   bool operator()(qint32 height, const LayerData& layer) const
+   {
+      return height < layer.height;
+   }
+
+   bool operator()(const LayerData& left, const LayerData& right) const
+   {
+      return left.height < right.height;
+   }
+};
+
+/**
+ * Orders points from left to right, then bottom to top.
+ */
+struct PointLess
+{
+   bool operator()(const QPointF& left, const QPointF& right) const
+   {
+      return left.x() < right.x() || (left.x() == right.x() && left.y() < right.y());
+   }
+};
+
+/**
+ * Retrieves whether the path from a through b to c turns counter
+ * clockwise (positive), clockwise (negative) or is straight (zero).
+ */
+static double getTurn(const QPointF& a, const QPointF& b, const QPointF& c)
+{
+   return (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+}
+
+/**
+ * The height of each row the footprint is narrowed down to, in millimetres.
+ */
+const static double FOOTPRINT_ROW_SIZE = 0.1;
+
+/**
+ * The length of each piece arcs are broken into when finding the bounds
+ * and footprint of an object, in millimetres.
+ */
+const static double ARC_SAMPLE_LENGTH = 1.0;
+
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeObjectData::GCodeObjectData()
+   : importRetraction(0.0)
+   , importPrimer(0.0)
+   , averageLayerHeight(0.0)
+{
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      minBounds[axis] = 0.0;
+      maxBounds[axis] = 0.0;
+      center[axis] = 0.0;
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 GCodeObject::GCodeObject(const PreferenceData& prefs)
    : mPrefs(prefs)
+   , mData(new GCodeObjectData())
    , mExtruderIndex(0)
-   , mAverageLayerHeight(0.0)
 {
    for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
    {
-      mMinBounds[axis] = 0.0;
-      mMaxBounds[axis] = 0.0;
       mOffsetPos[axis] = 0.0;
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+GCodeObject::GCodeObject(const GCodeObject& other)
+   : mPrefs(other.mPrefs)
+   , mData(other.mData)
+   , mExtruderIndex(other.mExtruderIndex)
+{
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      mOffsetPos[axis] = other.mOffsetPos[axis];
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 GCodeObject::~GCodeObject()
 {
@@ -48,7 +127,10 @@ GCodeObject::~GCodeObject()
 ////////////////////////////////////////////////////////////////////////////////
 bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
 {
+   TRACE_SPAN("GCodeObject::loadFile");
+
    GCodeParser parser;
+   parser.setReadAhead(mPrefs.importReadAhead);
 
    if (!parser.loadFile(fileName))
    {
@@ -56,10 +138,18 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
       return false;
    }
 
-   QProgressDialog progressDialog("Importing...", "Cancel", 0, 100, parent);
-   progressDialog.setWindowModality(Qt::WindowModal);
-   progressDialog.setFixedSize(progressDialog.sizeHint());
-   progressDialog.show();
+   // Any objects still sharing our previous data keep it as it was.
+   mData = new GCodeObjectData();
+
+   // There is nowhere to show our progress when running without a gui.
+   QScopedPointer<QProgressDialog> progressDialog;
+   if (QApplication::type() != QApplication::Tty)
+   {
+      progressDialog.reset(new QProgressDialog("Importing...", "Cancel", 0, 100, parent));
+      progressDialog->setWindowModality(Qt::WindowModal);
+      progressDialog->setFixedSize(progressDialog->sizeHint());
+      progressDialog->show();
+   }
 
    bool queueFinalizeTempBuffer = false;
    std::vector<GCodeCommand> tempLayerBuffer;
@@ -89,12 +179,15 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
    // and included in the final product as is.
    while (parser.parseNext())
    {
-      progressDialog.setValue(int(parser.getProgress() * 100.0));
-
-      if (progressDialog.wasCanceled())
+      if (progressDialog)
       {
-         mError = "";
-         return false;
+         progressDialog->setValue(int(parser.getProgress() * 100.0));
+
+         if (progressDialog->wasCanceled())
+         {
+            mError = "";
+            return false;
+         }
       }
 
       code.clear();
@@ -111,10 +204,15 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
 
          // Codes we care about:
          // 0 or 1: Extruder movement.
-         if (lValue == GCODE_EXTRUDER_MOVEMENT0 || lValue == GCODE_EXTRUDER_MOVEMENT1)
+         // 2 or 3: Clockwise or counter clockwise arc movement.
+         if (lValue == GCODE_EXTRUDER_MOVEMENT0 || lValue == GCODE_EXTRUDER_MOVEMENT1 ||
+             lValue == GCODE_CW_ARC || lValue == GCODE_CCW_ARC)
          {
             code.hasAxis = true;
 
+            bool isArc = lValue == GCODE_CW_ARC || lValue == GCODE_CCW_ARC;
+            double startPos[AXIS_NUM_NO_E] = {currentPos[X], currentPos[Y], currentPos[Z]};
+
             for (int axis = 0; axis < AXIS_NUM; ++axis)
             {
                if (parser.codeSeen(QString(AXIS_NAME[axis])))
@@ -128,11 +226,49 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
                      currentPos[axis] += (parser.codeValueDouble() * coordConversion);
                   }
                }
-               code.axisValue[axis] = currentPos[axis];
+               code.axisValue[axis] = (qint32)toFixed(currentPos[axis], axis);
             }
-            code.axisValue[E] = code.axisValue[E] - lastE;
+            // Taking the difference between the rounded positions
+            // keeps the relative extrusion from drifting.
+            code.axisValue[E] = (qint32)(toFixed(currentPos[E], E) - toFixed(lastE, E));
             lastE = currentPos[E];
 
+            // Arcs are kept as arcs, with their center relative to where
+            // they start so they move along with the rest of the object.
+            if (isArc)
+            {
+               double centerOffset[2] = {0.0, 0.0};
+               if (parser.codeSeen("I") || parser.codeSeen("J"))
+               {
+                  if (parser.codeSeen("I")) centerOffset[X] = parser.codeValueDouble() * coordConversion;
+                  if (parser.codeSeen("J")) centerOffset[Y] = parser.codeValueDouble() * coordConversion;
+               }
+               else if (parser.codeSeen("R"))
+               {
+                  // The center lies on the line halfway across the arc, to the
+                  // right of a clockwise arc, or the left when the radius is
+                  // negative and the arc goes more than halfway around.
+                  double radius = parser.codeValueDouble() * coordConversion;
+                  double deltaX = currentPos[X] - startPos[X];
+                  double deltaY = currentPos[Y] - startPos[Y];
+                  double chord = sqrt(deltaX * deltaX + deltaY * deltaY);
+                  if (chord > 0.0 && fabs(radius) >= chord / 2.0)
+                  {
+                     double height = sqrt(radius * radius - chord * chord / 4.0);
+                     if ((lValue == GCODE_CW_ARC) != (radius > 0.0))
+                     {
+                        height = -height;
+                     }
+
+                     centerOffset[X] = deltaX / 2.0 + height * deltaY / chord;
+                     centerOffset[Y] = deltaY / 2.0 - height * deltaX / chord;
+                  }
+               }
+
+               code.arcOffset[X] = (qint32)toFixed(centerOffset[X], X);
+               code.arcOffset[Y] = (qint32)toFixed(centerOffset[Y], Y);
+            }
+
             if (parser.codeSeen("F"))
             {
                code.f = parser.codeValueDouble();
@@ -141,7 +277,7 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
 
             // Our first extruder move command should
             // not be part of our header data.
-            if (mData.empty())
+            if (mData->layers.empty())
             {
                // Move our temp code to our current layer code
                // and iterate to our next layer.
@@ -157,7 +293,7 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
                if (layerZ < currentPos[Z])
                {
                   double height = currentPos[Z] - layerZ;
-                  mAverageLayerHeight += height;
+                  mData->averageLayerHeight += height;
                   averageCount++;
 
                   layerZ = currentPos[Z];
@@ -177,29 +313,45 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
                   }
                }
 
-               // Update the bounding volume.
-               if (!firstBounds)
+               // Update the bounding volume, with points along
+               // the way when moving around an arc.
+               int pointCount = 1;
+               if (isArc)
                {
-                  for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+                  pointCount = qMax(1, (int)ceil(getArcLength(code, startPos) / ARC_SAMPLE_LENGTH));
+               }
+
+               for (int pointIndex = 1; pointIndex <= pointCount; ++pointIndex)
+               {
+                  double point[AXIS_NUM_NO_E] = {currentPos[X], currentPos[Y], currentPos[Z]};
+                  if (isArc)
                   {
-                     if (mMinBounds[axis] > currentPos[axis])
-                     {
-                        mMinBounds[axis] = currentPos[axis];
-                     }
-                     if (mMaxBounds[axis] < currentPos[axis])
+                     getArcPoint(code, startPos, (double)pointIndex / pointCount, point);
+                  }
+
+                  if (!firstBounds)
+                  {
+                     for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
                      {
-                        mMaxBounds[axis] = currentPos[axis];
+                        if (mData->minBounds[axis] > point[axis])
+                        {
+                           mData->minBounds[axis] = point[axis];
+                        }
+                        if (mData->maxBounds[axis] < point[axis])
+                        {
+                           mData->maxBounds[axis] = point[axis];
+                        }
                      }
                   }
-               }
-               else
-               {
-                  for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+                  else
                   {
-                     mMinBounds[axis] = currentPos[axis];
-                     mMaxBounds[axis] = currentPos[axis];
+                     for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+                     {
+                        mData->minBounds[axis] = point[axis];
+                        mData->maxBounds[axis] = point[axis];
+                     }
+                     firstBounds = false;
                   }
-                  firstBounds = false;
                }
             }
             // Extruder has increased height.
@@ -238,7 +390,7 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
             code.hasAxis = true;
 
             // The extruder position does not change from this command.
-            code.axisValue[E] = 0.0;
+            code.axisValue[E] = 0;
 
             bool foundAny = false;
             for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
@@ -260,7 +412,7 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
                   }
                }
 
-               code.axisValue[axis] = currentPos[axis];
+               code.axisValue[axis] = (qint32)toFixed(currentPos[axis], axis);
             }
 
             // If the code was used without specifying any
@@ -269,7 +421,7 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
             {
                for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
                {
-                  code.axisValue[axis] = 0.0;
+                  code.axisValue[axis] = 0;
                   currentPos[axis] = 0.0;
                   offsetPos[axis] = 0.0;
                }
@@ -449,6 +601,12 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
       }
    }
 
+   if (!parser.getError().isEmpty())
+   {
+      mError = parser.getError();
+      return false;
+   }
+
    // Finalize any remaining temp codes.
    finalizeTempBuffer(tempLayerBuffer, layer, false);
 
@@ -461,17 +619,14 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
    // Calculate our bounding center.
    for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
    {
-      mCenter[axis] = mMinBounds[axis] + ((mMaxBounds[axis] - mMinBounds[axis]) / 2.0);
+      mData->center[axis] = mData->minBounds[axis] + ((mData->maxBounds[axis] - mData->minBounds[axis]) / 2.0);
    }
 
-   // Offset the object so it is in the center of the build platform.
-   mOffsetPos[X] = (mPrefs.platformWidth / 2.0) - mCenter[X];
-   mOffsetPos[Y] = (mPrefs.platformHeight / 2.0) - mCenter[Y];
-   mOffsetPos[Z] = 0.0;
+   centerOnPlatform();
 
    if (averageCount > 1)
    {
-      mAverageLayerHeight /= averageCount;
+      mData->averageLayerHeight /= averageCount;
    }
 
    // We need to 'heal' our layers to remove any extruder
@@ -480,25 +635,76 @@ bool GCodeObject::loadFile(const QString &fileName, QWidget* parent)
    // separated, we need to remove them entirely because
    // we can't guarantee that those two layers will be
    // spliced together consecutively again.
-   return healLayerRetraction();
+   if (!healLayerRetraction())
+   {
+      return false;
+   }
+
+   buildFootprint();
+
+   // Remember where our data came from so it can be shared with
+   // any later import of the same file.
+   QFileInfo fileInfo(fileName);
+   mData->fileName = fileInfo.absoluteFilePath();
+   mData->lastModified = fileInfo.lastModified();
+   mData->importRetraction = mPrefs.importRetraction;
+   mData->importPrimer = mPrefs.importPrimer;
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeObject::isLoadedFrom(const QString& fileName) const
+{
+   if (mData->fileName.isEmpty())
+   {
+      return false;
+   }
+
+   // Our import preferences change the way the layers are healed,
+   // so the data can only be reused if they are still the same.
+   QFileInfo fileInfo(fileName);
+   return mData->fileName == fileInfo.absoluteFilePath() &&
+          mData->lastModified == fileInfo.lastModified() &&
+          mData->importRetraction == mPrefs.importRetraction &&
+          mData->importPrimer == mPrefs.importPrimer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const GCodeObjectData* GCodeObject::getData() const
+{
+   return mData.constData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeObject::centerOnPlatform()
+{
+   mOffsetPos[X] = (mPrefs.platformWidth / 2.0) - mData->center[X];
+   mOffsetPos[Y] = (mPrefs.platformHeight / 2.0) - mData->center[Y];
+   mOffsetPos[Z] = 0.0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 const double* GCodeObject::getMinBounds() const
 {
-   return mMinBounds;
+   return mData->minBounds;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 const double* GCodeObject::getMaxBounds() const
 {
-   return mMaxBounds;
+   return mData->maxBounds;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 const double* GCodeObject::getCenter() const
 {
-   return mCenter;
+   return mData->center;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const std::vector<QPointF>& GCodeObject::getFootprint() const
+{
+   return mData->footprint;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -530,57 +736,74 @@ int GCodeObject::getExtruder() const
 ////////////////////////////////////////////////////////////////////////////////
 double GCodeObject::getAverageLayerHeight() const
 {
-   return mAverageLayerHeight;
+   return mData->averageLayerHeight;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 int GCodeObject::getLayerCount() const
 {
-   return (int)mData.size();
+   return (int)mData->layers.size();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 const LayerData& GCodeObject::getLayer(int levelIndex) const
 {
-   return mData[levelIndex];
+   return mData->layers[levelIndex];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeObject::getLayerAtHeight(std::vector<GCodeCommand>& outLayer, double height) const
+bool GCodeObject::getLayerAtHeight(const LayerData*& outLayer, qint32 height) const
 {
-   int layerCount = (int)mData.size();
-   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   // Our layers are sorted by height, so we can search them
+   // instead of walking through every one of them.
+   qint32 layerHeight = height - (qint32)toFixed(mOffsetPos[Z], Z);
+   std::vector<LayerData>::const_iterator layer =
+      std::lower_bound(mData->layers.begin(), mData->layers.end(), layerHeight, LayerHeightLess());
+
+   if (layer != mData->layers.end() && layer->height == layerHeight)
    {
-      const LayerData& data = mData[layerIndex];
-      if (fabs(data.height + mOffsetPos[Z] - height) < 0.001)
-      {
-         outLayer.insert(outLayer.end(), data.codes.begin(), data.codes.end());
-         return true;
-      }
-      else if (data.height + mOffsetPos[Z] > height)
-      {
-         return false;
-      }
+      outLayer = &(*layer);
+      return true;
+   }
+
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeObject::getLayerAboveHeight(const LayerData*& outLayer, qint32 height) const
+{
+   qint32 layerHeight = height - (qint32)toFixed(mOffsetPos[Z], Z);
+   std::vector<LayerData>::const_iterator layer =
+      std::upper_bound(mData->layers.begin(), mData->layers.end(), layerHeight, LayerHeightLess());
+
+   if (layer != mData->layers.end())
+   {
+      outLayer = &(*layer);
+      return true;
    }
 
    return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeObject::getLayerAboveHeight(const LayerData*& outLayer, double height) const
+void GCodeObject::getMemoryUsage(MemoryUsage& usage) const
 {
-   int layerCount = (int)mData.size();
+   usage.layerCommands += mData->layers.capacity() * sizeof(LayerData);
+
+   int layerCount = (int)mData->layers.size();
    for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      const LayerData& data = mData[layerIndex];
-      if (data.height + mOffsetPos[Z] > height)
+      const std::vector<GCodeCommand>& codes = mData->layers[layerIndex].codes;
+      usage.layerCommands += codes.capacity() * sizeof(GCodeCommand);
+
+      int codeCount = (int)codes.size();
+      for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
       {
-         outLayer = &data;
-         return true;
+         const GCodeCommand& code = codes[codeIndex];
+         usage.layerCommands += code.command.capacity() * sizeof(QChar);
+         usage.commentStrings += code.comment.capacity() * sizeof(QChar);
       }
    }
-
-   return false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -592,6 +815,8 @@ const QString& GCodeObject::getError() const
 ////////////////////////////////////////////////////////////////////////////////
 void GCodeObject::finalizeTempBuffer(std::vector<GCodeCommand>& tempBuffer, std::vector<GCodeCommand>& finalBuffer, bool cullComments)
 {
+   TRACE_SPAN("GCodeObject::finalizeTempBuffer");
+
    if (tempBuffer.empty())
    {
       return;
@@ -623,19 +848,23 @@ void GCodeObject::finalizeTempBuffer(std::vector<GCodeCommand>& tempBuffer, std:
 ////////////////////////////////////////////////////////////////////////////////
 void GCodeObject::addLayer(std::vector<GCodeCommand>& layer)
 {
+   TRACE_SPAN("GCodeObject::addLayer");
+
    LayerData data;
    data.codes = layer;
 
-   double height = 0.0;
+   qint32 height = 0;
 
-   double eValue = 0.0;
+   qint32 eValue = 0;
    bool firstEChange = false;
    int count = (int)layer.size();
    for (int index = 0; index < count; ++index)
    {
       GCodeCommand& code = layer[index];
       if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
-          code.type == GCODE_EXTRUDER_MOVEMENT1)
+          code.type == GCODE_EXTRUDER_MOVEMENT1 ||
+          code.type == GCODE_CW_ARC ||
+          code.type == GCODE_CCW_ARC)
       {
          if (!firstEChange)
          {
@@ -654,27 +883,29 @@ void GCodeObject::addLayer(std::vector<GCodeCommand>& layer)
    }
 
    data.height = height;
-   mData.push_back(data);
+   mData->layers.push_back(data);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 bool GCodeObject::healLayerRetraction()
 {
-   double extrusionValue = 0.0;
-   double previousPrimer = 0.0;
+   TRACE_SPAN("GCodeObject::healLayerRetraction");
+
+   qint64 extrusionValue = 0;
+   qint64 previousPrimer = 0;
 
    bool findPrimer = false;
-   int layerCount = (int)mData.size();
+   int layerCount = (int)mData->layers.size();
    for (int layerIndex = 1; layerIndex < layerCount; ++layerIndex)
    {
-      LayerData& layer = mData[layerIndex];
+      LayerData& layer = mData->layers[layerIndex];
 
       // If a previous layer is missing its primer, attempt
       // to find it.
       if (findPrimer)
       {
          findPrimer = false;
-         previousPrimer = 0.0;
+         previousPrimer = 0;
 
          int codeCount = (int)layer.codes.size();
          for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
@@ -682,7 +913,9 @@ bool GCodeObject::healLayerRetraction()
             GCodeCommand& code = layer.codes[codeIndex];
 
             if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
-               code.type == GCODE_EXTRUDER_MOVEMENT1)
+               code.type == GCODE_EXTRUDER_MOVEMENT1 ||
+               code.type == GCODE_CW_ARC ||
+               code.type == GCODE_CCW_ARC)
             {
                extrusionValue += code.axisValue[E];
 
@@ -690,19 +923,19 @@ bool GCodeObject::healLayerRetraction()
                // we have primed, there may be something wrong with
                // the slicer that made this gcode file as this
                // should not happen.
-               if (code.axisValue[E] < 0.0)
+               if (code.axisValue[E] < 0)
                {
                   mError = "A retraction was found that was not followed properly by a primer.";
                   return false;
                }
-               else if (code.axisValue[E] > 0.0)
+               else if (code.axisValue[E] > 0)
                {
-                  double retractionAmount = mPrefs.importRetraction;
+                  qint64 retractionAmount = toFixed(mPrefs.importRetraction, E);
                   if (mPrefs.importRetraction < 0.0)
                   {
                      retractionAmount = code.axisValue[E];
                   }
-                  double primeAmount = mPrefs.importPrimer;
+                  qint64 primeAmount = toFixed(mPrefs.importPrimer, E);
                   if (mPrefs.importPrimer < 0.0)
                   {
                      primeAmount = code.axisValue[E];
@@ -713,7 +946,7 @@ bool GCodeObject::healLayerRetraction()
                   // primer is broken up between multiple movements.
                   if (extrusionValue + previousPrimer >= primeAmount - retractionAmount)
                   {
-                     code.axisValue[E] = 0.0;
+                     code.axisValue[E] = 0;
                      break;
                   }
 
@@ -727,14 +960,16 @@ bool GCodeObject::healLayerRetraction()
 
       // Search this layer, starting from the end, for any
       // retraction that does not get primed again.
-      extrusionValue = 0.0;
+      extrusionValue = 0;
       int codeCount = (int)layer.codes.size();
       for (int codeIndex = codeCount-1; codeIndex >= 0; --codeIndex)
       {
          GCodeCommand& code = layer.codes[codeIndex];
 
          if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
-             code.type == GCODE_EXTRUDER_MOVEMENT1)
+             code.type == GCODE_EXTRUDER_MOVEMENT1 ||
+             code.type == GCODE_CW_ARC ||
+             code.type == GCODE_CCW_ARC)
          {
             extrusionValue += code.axisValue[E];
 
@@ -743,14 +978,14 @@ bool GCodeObject::healLayerRetraction()
             // we find that this retraction is more than what
             // gets extruded after within this layer, then we
             // need to check the next layer for the prime.
-            if (code.axisValue[E] < 0.0)
+            if (code.axisValue[E] < 0)
             {
-               double retractionAmount = mPrefs.importRetraction;
+               qint64 retractionAmount = toFixed(mPrefs.importRetraction, E);
                if (mPrefs.importRetraction < 0.0)
                {
                   retractionAmount = -code.axisValue[E];
                }
-               double primeAmount = mPrefs.importPrimer;
+               qint64 primeAmount = toFixed(mPrefs.importPrimer, E);
                if (mPrefs.importPrimer < 0.0)
                {
                   primeAmount = -code.axisValue[E];
@@ -762,7 +997,7 @@ bool GCodeObject::healLayerRetraction()
                // layer for the primer that matches this.
                if (extrusionValue < primeAmount - retractionAmount)
                {
-                  code.axisValue[E] = 0.0;
+                  code.axisValue[E] = 0;
                   findPrimer = true;
                }
                break;
@@ -775,3 +1010,129 @@ bool GCodeObject::healLayerRetraction()
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+void GCodeObject::buildFootprint()
+{
+   TRACE_SPAN("GCodeObject::buildFootprint");
+
+   std::vector<QPointF>& footprint = mData->footprint;
+   footprint.clear();
+
+   // Only the outermost points can be part of our hull, so we first narrow
+   // every extruded point down to the leftmost and rightmost point of each
+   // thin row.  This keeps the hull quick to build for very large files.
+   double minY = mData->minBounds[Y];
+   int rowCount = (int)((mData->maxBounds[Y] - minY) / FOOTPRINT_ROW_SIZE) + 1;
+   std::vector<QPointF> leftPoints(rowCount);
+   std::vector<QPointF> rightPoints(rowCount);
+   std::vector<bool> rowUsed(rowCount, false);
+
+   QPointF lastPos;
+   int layerCount = (int)mData->layers.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      const std::vector<GCodeCommand>& codes = mData->layers[layerIndex].codes;
+
+      int codeCount = (int)codes.size();
+      for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
+      {
+         const GCodeCommand& code = codes[codeIndex];
+         if (!code.hasAxis)
+         {
+            continue;
+         }
+
+         QPointF pos(fromFixed(code.axisValue[X], X), fromFixed(code.axisValue[Y], Y));
+
+         // Both ends of every extruded line are part of the footprint,
+         // along with points along the way around an arc.
+         if (code.axisValue[E] > 0)
+         {
+            bool isArc = code.type == GCODE_CW_ARC || code.type == GCODE_CCW_ARC;
+            double start[AXIS_NUM_NO_E] = {lastPos.x(), lastPos.y(), 0.0};
+
+            int segmentCount = 1;
+            if (isArc)
+            {
+               segmentCount = qMax(1, (int)ceil(getArcLength(code, start) / ARC_SAMPLE_LENGTH));
+            }
+
+            for (int pointIndex = 0; pointIndex <= segmentCount; ++pointIndex)
+            {
+               QPointF point = pointIndex == 0? lastPos: pos;
+               if (isArc && pointIndex > 0 && pointIndex < segmentCount)
+               {
+                  double arcPoint[AXIS_NUM_NO_E];
+                  getArcPoint(code, start, (double)pointIndex / segmentCount, arcPoint);
+                  point = QPointF(arcPoint[X], arcPoint[Y]);
+               }
+
+               int row = qBound(0, (int)((point.y() - minY) / FOOTPRINT_ROW_SIZE), rowCount - 1);
+               if (!rowUsed[row])
+               {
+                  leftPoints[row] = point;
+                  rightPoints[row] = point;
+                  rowUsed[row] = true;
+               }
+               else if (point.x() < leftPoints[row].x())
+               {
+                  leftPoints[row] = point;
+               }
+               else if (point.x() > rightPoints[row].x())
+               {
+                  rightPoints[row] = point;
+               }
+            }
+         }
+
+         lastPos = pos;
+      }
+   }
+
+   std::vector<QPointF> points;
+   for (int row = 0; row < rowCount; ++row)
+   {
+      if (rowUsed[row])
+      {
+         points.push_back(leftPoints[row]);
+         points.push_back(rightPoints[row]);
+      }
+   }
+
+   // Build the hull with Andrew's monotone chain, first the lower
+   // half from left to right, then the upper half back again.
+   std::sort(points.begin(), points.end(), PointLess());
+   points.erase(std::unique(points.begin(), points.end()), points.end());
+
+   int pointCount = (int)points.size();
+   if (pointCount < 3)
+   {
+      footprint = points;
+      return;
+   }
+
+   footprint.resize(pointCount * 2);
+   int hullCount = 0;
+   for (int pointIndex = 0; pointIndex < pointCount; ++pointIndex)
+   {
+      while (hullCount >= 2 && getTurn(footprint[hullCount - 2], footprint[hullCount - 1], points[pointIndex]) <= 0.0)
+      {
+         hullCount--;
+      }
+      footprint[hullCount++] = points[pointIndex];
+   }
+
+   int lowerCount = hullCount + 1;
+   for (int pointIndex = pointCount - 2; pointIndex >= 0; --pointIndex)
+   {
+      while (hullCount >= lowerCount && getTurn(footprint[hullCount - 2], footprint[hullCount - 1], points[pointIndex]) <= 0.0)
+      {
+         hullCount--;
+      }
+      footprint[hullCount++] = points[pointIndex];
+   }
+
+   // The last point is the same as our first.
+   footprint.resize(hullCount - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -19,14 +19,40 @@
 
 
 #include <GCodeParser.h>
+#include <GCodeEmitter.h>
+#include <ReadAheadReader.h>
 
 #include <QDataStream>
+#include <QtEndian>
 
+#include <zlib.h>
+#include <string.h>
+
+// The number of lines recorded by each parse trace span.
+const static int TRACE_PARSE_BATCH_SIZE = 10000;
+
+// The size of each chunk read from a compressed file and
+// the most it can inflate to in a single pass.
+const static int INFLATE_READ_SIZE = 64 * 1024;
+const static int INFLATE_CHUNK_SIZE = 256 * 1024;
+
+// The size of each chunk of a plain text file taken from the read ahead thread.
+const static int READ_AHEAD_CHUNK_SIZE = 64 * 1024;
 
 ////////////////////////////////////////////////////////////////////////////////
 GCodeParser::GCodeParser()
-   : mCommentPos(-1)
+   : mReadAhead(false)
+   , mReader(NULL)
+   , mFormat(FORMAT_TEXT)
+   , mChecksum(false)
+   , mStream(NULL)
+   , mLinePos(0)
+   , mStreamEnd(false)
+   , mLineStart(0)
+   , mTextPos(0)
+   , mCommentPos(-1)
    , mCodePos(-1)
+   , mParseTraceStart(0)
 {
    mCommentMarkers.append(';');
    mCommentMarkers.append('(');
@@ -50,6 +76,49 @@ bool GCodeParser::loadFile(const QString &fileName)
       return false;
    }
 
+   // Gzip files are recognized by their magic number rather than their extension.
+   if (mFile.peek(2) == QByteArray("\x1f\x8b"))
+   {
+      mStream = new z_stream;
+      memset(mStream, 0, sizeof(z_stream));
+
+      // Adding 16 to the window bits makes zlib expect a gzip header.
+      if (inflateInit2(mStream, 16 + MAX_WBITS) != Z_OK)
+      {
+         delete mStream;
+         mStream = NULL;
+         mFile.close();
+         return false;
+      }
+
+      mFormat = FORMAT_GZIP;
+   }
+   else if (mFile.peek(4) == QByteArray(BINARY_MAGIC, 4))
+   {
+      QByteArray header = mFile.read(10);
+      if (header.size() < 10 ||
+         qFromLittleEndian<quint32>((const uchar*)header.constData() + 4) != BINARY_VERSION ||
+         qFromLittleEndian<quint16>((const uchar*)header.constData() + 8) > BINARY_CHECKSUM_CRC32)
+      {
+         mFile.close();
+         return false;
+      }
+
+      mFormat = FORMAT_BINARY;
+      mChecksum = qFromLittleEndian<quint16>((const uchar*)header.constData() + 8) == BINARY_CHECKSUM_CRC32;
+   }
+
+   // The rest of the file is read by the reader, past any header we have already read.
+   if (mReadAhead)
+   {
+      mReader = new ReadAheadReader();
+      if (!mReader->open(fileName, mFile.pos()))
+      {
+         closeFile();
+         return false;
+      }
+   }
+
    return true;
 }
 
@@ -58,9 +127,33 @@ bool GCodeParser::closeFile()
 {
    if (mFile.isOpen())
    {
+      flushTrace();
       mFile.close();
    }
 
+   if (mReader)
+   {
+      delete mReader;
+      mReader = NULL;
+   }
+
+   if (mStream)
+   {
+      inflateEnd(mStream);
+      delete mStream;
+      mStream = NULL;
+   }
+
+   mFormat = FORMAT_TEXT;
+   mChecksum = false;
+   mCompressedBuffer.clear();
+   mLineBuffer.clear();
+   mLinePos = 0;
+   mStreamEnd = false;
+   mLineStart = 0;
+   mTextPos = 0;
+   mError.clear();
+
    return true;
 }
 
@@ -70,6 +163,12 @@ bool GCodeParser::isOpen() const
    return mFile.isOpen();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void GCodeParser::setReadAhead(bool enabled)
+{
+   mReadAhead = enabled;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void GCodeParser::setCommentMarkers(const QByteArray& markers)
 {
@@ -84,12 +183,20 @@ bool GCodeParser::parseNext()
       return false;
    }
 
-   if (mFile.atEnd())
+   if (atEnd())
    {
       return false;
    }
 
-   mToken = mFile.readLine();
+   if (Trace::isEnabled() && mParseTrace.getCount() == 0)
+   {
+      mParseTraceStart = Trace::getTime();
+   }
+   mParseTrace.begin();
+
+   mToken = readLine();
+   mLineStart = mTextPos;
+   mTextPos += mToken.size();
    mComment.clear();
 
    // Check for comments
@@ -117,6 +224,12 @@ bool GCodeParser::parseNext()
 
    mCodePos = -1;
 
+   mParseTrace.end();
+   if (mParseTrace.getCount() >= TRACE_PARSE_BATCH_SIZE)
+   {
+      flushTrace();
+   }
+
    return true;
 }
 
@@ -316,16 +429,323 @@ QString GCodeParser::getComment()
    return mComment;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+qint64 GCodeParser::getLinePos() const
+{
+   return mLineStart;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 double GCodeParser::getProgress() const
 {
    // Update the progress of the parse.
    if (mFile.size() > 0)
    {
-      return (double)mFile.pos() / (double)mFile.size();
+      return (double)getFilePos() / (double)mFile.size();
    }
 
    return 0.0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+const QString& GCodeParser::getError() const
+{
+   return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+QByteArray GCodeParser::readLine()
+{
+   if (mFormat == FORMAT_TEXT && !mReader)
+   {
+      return mFile.readLine();
+   }
+
+   while (true)
+   {
+      int endPos = mLineBuffer.indexOf('\n', mLinePos);
+      if (endPos > -1)
+      {
+         QByteArray line = mLineBuffer.mid(mLinePos, endPos + 1 - mLinePos);
+         mLinePos = endPos + 1;
+         return line;
+      }
+
+      // The last line of the file may not end with a new line.
+      if (!decodeNext())
+      {
+         QByteArray line = mLineBuffer.mid(mLinePos);
+         mLinePos = mLineBuffer.size();
+         return line;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeParser::atEnd()
+{
+   if (mFormat == FORMAT_TEXT && !mReader)
+   {
+      return mFile.atEnd();
+   }
+
+   while (mLinePos >= mLineBuffer.size())
+   {
+      if (!decodeNext())
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+QByteArray GCodeParser::readFile(int maxSize)
+{
+   if (!mReader)
+   {
+      return mFile.read(maxSize);
+   }
+
+   QByteArray data;
+   data.resize(maxSize);
+   data.resize(mReader->read(data.data(), maxSize));
+
+   if (data.size() < maxSize && mError.isEmpty())
+   {
+      mError = mReader->getError();
+   }
+   return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 GCodeParser::getFilePos() const
+{
+   return mReader? mReader->pos(): mFile.pos();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeParser::fileAtEnd()
+{
+   if (!mReader)
+   {
+      return mFile.atEnd();
+   }
+
+   if (mReader->atEnd())
+   {
+      if (mError.isEmpty())
+      {
+         mError = mReader->getError();
+      }
+      return true;
+   }
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeParser::decodeNext()
+{
+   if (!mError.isEmpty())
+   {
+      return false;
+   }
+
+   // Drop the lines we have already parsed.
+   mLineBuffer.remove(0, mLinePos);
+   mLinePos = 0;
+
+   if (mFormat == FORMAT_BINARY)
+   {
+      return readBlock();
+   }
+
+   // Plain text only comes through here when it is read ahead.
+   if (mFormat == FORMAT_TEXT)
+   {
+      QByteArray chunk = readFile(READ_AHEAD_CHUNK_SIZE);
+      mLineBuffer.append(chunk);
+      return !chunk.isEmpty();
+   }
+
+   return inflateNext();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeParser::inflateNext()
+{
+   while (true)
+   {
+      if (mStream->avail_in == 0)
+      {
+         if (fileAtEnd())
+         {
+            if (!mStreamEnd)
+            {
+               mError = "Compressed file is truncated.";
+            }
+            return false;
+         }
+
+         mCompressedBuffer = readFile(INFLATE_READ_SIZE);
+         mStream->next_in = (Bytef*)mCompressedBuffer.data();
+         mStream->avail_in = (uInt)mCompressedBuffer.size();
+      }
+
+      // Files appended to after compression hold more than one gzip member.
+      if (mStreamEnd)
+      {
+         inflateReset(mStream);
+         mStreamEnd = false;
+      }
+
+      int oldSize = mLineBuffer.size();
+      mLineBuffer.resize(oldSize + INFLATE_CHUNK_SIZE);
+      mStream->next_out = (Bytef*)mLineBuffer.data() + oldSize;
+      mStream->avail_out = INFLATE_CHUNK_SIZE;
+
+      int result = inflate(mStream, Z_NO_FLUSH);
+      mLineBuffer.resize(oldSize + INFLATE_CHUNK_SIZE - mStream->avail_out);
+
+      if (result == Z_STREAM_END)
+      {
+         mStreamEnd = true;
+      }
+      else if (result != Z_OK && result != Z_BUF_ERROR)
+      {
+         mError = "Compressed file is corrupt.";
+         return false;
+      }
+
+      if (mLineBuffer.size() > oldSize)
+      {
+         return true;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeParser::readBlock()
+{
+   while (!fileAtEnd())
+   {
+      QByteArray block = readFile(8);
+      if (block.size() < 8)
+      {
+         mError = "Binary file is truncated.";
+         return false;
+      }
+
+      quint16 type = qFromLittleEndian<quint16>((const uchar*)block.constData());
+      quint16 compression = qFromLittleEndian<quint16>((const uchar*)block.constData() + 2);
+      quint32 size = qFromLittleEndian<quint32>((const uchar*)block.constData() + 4);
+      quint32 dataSize = size;
+
+      if (compression != BINARY_COMPRESSION_NONE)
+      {
+         QByteArray compressedSize = readFile(4);
+         if (compressedSize.size() < 4)
+         {
+            mError = "Binary file is truncated.";
+            return false;
+         }
+
+         block += compressedSize;
+         dataSize = qFromLittleEndian<quint32>((const uchar*)compressedSize.constData());
+      }
+
+      // Thumbnails have a format, width and height where the rest only have an encoding.
+      int paramSize = type == BINARY_BLOCK_THUMBNAIL? 6: 2;
+      int headerSize = block.size();
+
+      // Sizes come straight from the file, so make sure they are sane
+      // before we allocate anything for them.
+      qint64 maxSize = type == BINARY_BLOCK_GCODE? BINARY_BLOCK_SIZE: BINARY_MAX_BLOCK_SIZE;
+      if ((qint64)size > maxSize || (qint64)dataSize > maxSize)
+      {
+         mError = "Binary file is corrupt.";
+         return false;
+      }
+
+      if ((qint64)paramSize + dataSize > mFile.size() - getFilePos())
+      {
+         mError = "Binary file is truncated.";
+         return false;
+      }
+
+      block += readFile(paramSize + (int)dataSize);
+      if (block.size() < headerSize + paramSize + (int)dataSize)
+      {
+         mError = "Binary file is truncated.";
+         return false;
+      }
+
+      if (mChecksum)
+      {
+         QByteArray checksum = readFile(4);
+         if (checksum.size() < 4 ||
+            qFromLittleEndian<quint32>((const uchar*)checksum.constData()) != crc32(0, (const Bytef*)block.constData(), (uInt)block.size()))
+         {
+            mError = "Binary file failed its checksum.";
+            return false;
+         }
+      }
+
+      if (type != BINARY_BLOCK_GCODE)
+      {
+         continue;
+      }
+
+      if (qFromLittleEndian<quint16>((const uchar*)block.constData() + headerSize) != 0)
+      {
+         mError = "Binary file uses an unsupported gcode encoding.";
+         return false;
+      }
+
+      const char* data = block.constData() + headerSize + paramSize;
+      if (compression == BINARY_COMPRESSION_NONE)
+      {
+         mLineBuffer.append(data, (int)size);
+      }
+      else if (compression == BINARY_COMPRESSION_DEFLATE)
+      {
+         int oldSize = mLineBuffer.size();
+         mLineBuffer.resize(oldSize + (int)size);
+
+         uLongf inflatedSize = size;
+         if (uncompress((Bytef*)mLineBuffer.data() + oldSize, &inflatedSize, (const Bytef*)data, dataSize) != Z_OK ||
+            inflatedSize != size)
+         {
+            mError = "Binary file is corrupt.";
+            return false;
+         }
+      }
+      else
+      {
+         mError = "Binary file uses an unsupported compression.";
+         return false;
+      }
+
+      if (size > 0)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeParser::flushTrace()
+{
+   if (Trace::isEnabled() && mParseTrace.getCount() > 0)
+   {
+      Trace::addEvent("GCodeParser::parseNext", mParseTraceStart, Trace::getTime() - mParseTraceStart,
+         QString("\"lines\": %1, \"parse_us\": %2").arg(mParseTrace.getCount()).arg(mParseTrace.getTotal()));
+   }
+
+   mParseTrace.reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -19,14 +19,120 @@
 
 
 #include <GCodeSplicer.h>
+#include <GCodeEmitter.h>
 #include <GCodeParser.h>
 #include <GCodeObject.h>
+#include <GCodeTimeEstimator.h>
+#include <Trace.h>
 
 #include <QtGui/QtGui>
 
+#include <algorithm>
+#include <math.h>
+
+// The most extruders in one layer we search every visiting order for.
+const static int ORDER_MAX_EXTRUDERS = 6;
+
+// The most blocks in a run, and passes over them, we improve with 2-opt.
+const static int TRAVEL_MAX_STOPS = 500;
+const static int TRAVEL_MAX_PASSES = 10;
+
+// The fewest and most moves we replace with a single arc.
+const static int ARC_MIN_MOVES = 3;
+const static int ARC_MAX_MOVES = 256;
+
+// Arcs any larger than this, in mm, are as good as straight.
+const static double ARC_MAX_RADIUS = 1000.0;
+
+// How far the extrusion per mm of each move may differ from the arc's.
+const static double ARC_EXTRUSION_TOLERANCE = 0.1;
+
+// How far above the tallest part printed so far, in mm, we travel when
+// grouped layers have us come back down to print a lower layer.
+const static double SCHEDULE_Z_CLEARANCE = 1.0;
+
+// How far, in mm, a resumed print first lifts off of the failed print, and
+// how far above the tallest indexed layer it travels back into place.
+const static double RESUME_Z_LIFT = 5.0;
+const static double RESUME_Z_CLEARANCE = 2.0;
+
+// The extension added to a spliced file's name for its layer index.
+const static QString LAYER_INDEX_EXTENSION = ".index";
+
+// The size of each chunk copied when resuming or merging files.
+const static int RESUME_COPY_SIZE = 256 * 1024;
+
+/**
+ * Where the head enters and leaves a block, in printer space.
+ */
+struct TravelStop
+{
+   QPointF entry;
+   QPointF exit;
+};
+
+/**
+ * Retrieves the distance between two points.
+ */
+static double getDistance(const QPointF& a, const QPointF& b)
+{
+   double deltaX = b.x() - a.x();
+   double deltaY = b.y() - a.y();
+   return sqrt(deltaX * deltaX + deltaY * deltaY);
+}
+
+/**
+ * Retrieves the circle that passes through three points.
+ */
+static bool getCircle(const QPointF& a, const QPointF& b, const QPointF& c, QPointF& center, double& radius)
+{
+   double divisor = 2.0 * (a.x() * (b.y() - c.y()) + b.x() * (c.y() - a.y()) + c.x() * (a.y() - b.y()));
+   if (fabs(divisor) < 0.000001)
+   {
+      // The points are in a line.
+      return false;
+   }
+
+   double aSquared = a.x() * a.x() + a.y() * a.y();
+   double bSquared = b.x() * b.x() + b.y() * b.y();
+   double cSquared = c.x() * c.x() + c.y() * c.y();
+
+   center.setX((aSquared * (b.y() - c.y()) + bSquared * (c.y() - a.y()) + cSquared * (a.y() - b.y())) / divisor);
+   center.setY((aSquared * (c.x() - b.x()) + bSquared * (a.x() - c.x()) + cSquared * (b.x() - a.x())) / divisor);
+   radius = getDistance(center, a);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Retrieves whether a file is compressed or binary rather than plain text.
+ */
+static bool isEncodedFile(QFile& file)
+{
+   QByteArray magic = file.peek(4);
+   return magic.startsWith("\x1f\x8b") || magic == QByteArray(BINARY_MAGIC, 4);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 GCodeSplicer::GCodeSplicer(const PreferenceData& prefs)
    : mPrefs(prefs)
+   , mEstimatedTime(0.0)
+   , mSwapCount(0)
+   , mBaselineSwapCount(0)
+   , mSwapTimeSaved(0.0)
+   , mTravelDistance(0.0)
+   , mBaselineTravelDistance(0.0)
+   , mFeedRate(-1.0)
+   , mPendingFeedRate(-1.0)
+   , mFanSpeed(-1.0)
+   , mArcCount(0)
+   , mArcMoveCount(0)
+   , mFirstLayer(1)
+   , mLastLayer(-1)
+   , mEnteringExtruder(-1)
+   , mShardEnteringExtruder(-1)
+   , mShardLeavingExtruder(-1)
+   , mShardLayerCount(0)
 {
 }
 
@@ -74,631 +180,2652 @@ bool GCodeSplicer::addObject(const GCodeObject* object)
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::setLayerRange(int firstLayer, int lastLayer)
+{
+   mFirstLayer = firstLayer;
+   mLastLayer = lastLayer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::setEnteringExtruder(int extruder)
+{
+   mEnteringExtruder = extruder;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 bool GCodeSplicer::build(const QString& fileName, QWidget* parent)
 {
+   TRACE_SPAN("GCodeSplicer::build");
+
    if (mObjectList.empty())
    {
       mError = "No objects to export.";
       return false;
    }
 
-   QFile file;
-   file.setFileName(fileName);
-   if (!file.open(QIODevice::WriteOnly))
+   // The format we write is chosen by the extension of the file.
+   QScopedPointer<GCodeEmitter> emitter(GCodeEmitter::create(fileName));
+   if (!emitter->open())
    {
       mError = "Could not open file \'" + fileName + "\' for writing.";
       return false;
    }
 
-   QProgressDialog progressDialog("Splicing...", "Cancel", 0, 100, parent);
-   progressDialog.setWindowModality(Qt::WindowModal);
-   progressDialog.setFixedSize(progressDialog.sizeHint());
-   progressDialog.show();
+   // There is nowhere to show our progress when running without a gui.
+   QScopedPointer<QProgressDialog> progressDialog;
+   if (QApplication::type() != QApplication::Tty)
+   {
+      progressDialog.reset(new QProgressDialog("Splicing...", "Cancel", 0, 100, parent));
+      progressDialog->setWindowModality(Qt::WindowModal);
+      progressDialog->setFixedSize(progressDialog->sizeHint());
+      progressDialog->show();
+   }
+
+   // Work out everything we are going to print, layer by layer, before
+   // writing any of it so we know how far ahead each swap is.
+   std::vector<SpliceLayer> layerList;
+   buildLayerList(layerList);
+
+   double baselineSwapTime = 0.0;
+   mBaselineSwapCount = countSwaps(layerList, baselineSwapTime);
+
+   orderExtruders(layerList);
+   scheduleLayers(layerList);
+
+   double swapTime = 0.0;
+   mSwapCount = countSwaps(layerList, swapTime);
+   mSwapTimeSaved = baselineSwapTime - swapTime;
+
+   mBaselineTravelDistance = getTravelDistance(layerList);
+   optimizeTravel(layerList);
+   mTravelDistance = getTravelDistance(layerList);
+
+   schedulePreheats(layerList);
+
+   // A shard only writes part of the layers, leaving the header to the
+   // first shard and the end codes to the last.
+   int layerCount = (int)layerList.size();
+   int firstLayer = qMax(mFirstLayer, 1) - 1;
+   int lastLayer = mLastLayer > 0? qMin(mLastLayer, layerCount) - 1: layerCount - 1;
+   if (firstLayer > lastLayer)
+   {
+      mError = QString("The layer range is outside the %1 layers of this splice.").arg(layerCount);
+      return false;
+   }
+
+   bool isShard = firstLayer > 0 || lastLayer < layerCount - 1;
 
-   if (!buildHeader(file))
+   if (firstLayer == 0 && !buildHeader(*emitter))
    {
       mError = "Failed to build header codes for splice.";
       return false;
    }
 
-   double currentPos[AXIS_NUM] = {0.0,};
+   // Nothing is known of the printer state until we set it.
+   mFeedRate = -1.0;
+   mPendingFeedRate = -1.0;
+   mFanSpeed = -1.0;
+   mTemperatures.assign(mPrefs.extruderList.size(), -1.0);
+
+   mArcCount = 0;
+   mArcMoveCount = 0;
+
+   mEstimatedTime = 0.0;
+   mLayerTimes.clear();
+   mLayerStates.clear();
+   mLayerStates.reserve(layerList.size());
+
+   // Every layer begins by resetting the extrusion, so all a shard needs
+   // from the layers before it is where they left the printer.
+   qint64 currentPos[AXIS_NUM] = {0,};
+   int lastExtruder = getLayerEntryState(layerList, firstLayer, currentPos);
+   if (mEnteringExtruder >= 0 && mEnteringExtruder < (int)mPrefs.extruderList.size())
+   {
+      lastExtruder = mEnteringExtruder;
+   }
+   mShardEnteringExtruder = lastExtruder;
+   mShardLayerCount = layerCount;
 
-   double currentLayerHeight = 0.0;
-   int lastExtruder = 0;
-   int layerIndex = 1;
-   bool initExtruders = true;
+   // The tallest anything has been printed to, which grouped layers
+   // may have us come back down below.
+   qint32 highestHeight = 0;
+   for (int layerIndex = 0; layerIndex < firstLayer; ++layerIndex)
+   {
+      highestHeight = qMax(highestHeight, layerList[layerIndex].height);
+   }
 
-   progressDialog.setMaximum(getTotalLayerCount());
+   if (progressDialog)
+   {
+      progressDialog->setRange(firstLayer, lastLayer + 1);
+   }
 
    // Iterate through each layer.
-   while (getNextLayer(currentLayerHeight, currentLayerHeight))
+   for (int layerIndex = firstLayer; layerIndex <= lastLayer; ++layerIndex)
    {
+      const SpliceLayer& spliceLayer = layerList[layerIndex];
+
+      // Movements are far too numerous to trace one by one, so
+      // we total them up for each layer instead.
+      qint64 layerTraceStart = Trace::isEnabled()? Trace::getTime(): 0;
+      TraceAccumulator movementTrace;
+
+      // Remember where each layer begins so a failed print can be resumed from it.
+      SpliceLayerState state;
+      state.layer = layerIndex + 1;
+      state.offset = emitter->getPosition();
+      state.height = spliceLayer.height;
+      state.extruder = lastExtruder;
+      for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+      {
+         state.pos[axis] = currentPos[axis];
+      }
+      state.feedRate = mFeedRate;
+      state.fanSpeed = mFanSpeed;
+      state.temperatures = mTemperatures;
+      mLayerStates.push_back(state);
+
       if (mPrefs.exportComments)
       {
-         file.write("; ++++++++++++++++++++++++++++++++++++++\n; Begin Layer ");
-         file.write(QString::number(layerIndex).toAscii());
-         file.write(" with height = ");
-         file.write(QString::number(currentLayerHeight).toAscii());
-         file.write("\n; ++++++++++++++++++++++++++++++++++++++\n");
+         emitter->write("; ++++++++++++++++++++++++++++++++++++++\n; Begin Layer ");
+         emitter->write(QString::number(layerIndex + 1).toAscii());
+         emitter->write(" with height = ");
+         QByteArray height;
+         appendFixed(height, spliceLayer.height, Z);
+         emitter->write(height);
+         emitter->write("\n; ++++++++++++++++++++++++++++++++++++++\n");
       }
 
-      int currentExtruder = lastExtruder;
-      double offset[AXIS_NUM] = {0,};
+      qint64 offset[AXIS_NUM] = {0,};
 
-      file.write("G92 E0");
-      if (mPrefs.exportComments) file.write("; Reset extrusion");
-      file.write("\n");
-      offset[E] = 0.0;
+      emitter->write("G92 E0");
+      if (mPrefs.exportComments) emitter->write("; Reset extrusion");
+      emitter->write("\n");
+      offset[E] = 0;
 
-      // Iterate through each extruder.  We try to start with the last
-      // extruder we used previously in an attempt to reduce the total
-      // number of extruder changes done throughout the print.
-      for (int extruderIndex = 0; extruderIndex < (int)mPrefs.extruderList.size(); ++extruderIndex)
+      // Before anything else is printed, we need to set our extruders up
+      // to be idle except for the one we are starting the print with.
+      if (layerIndex == 0)
       {
-         int objectCount = (int)mObjectList.size();
-         for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+         if (!buildExtruderInit(*emitter, lastExtruder))
          {
-            const GCodeObject* object = mObjectList[objectIndex];
-            if (object && (initExtruders || object->getExtruder() == currentExtruder))
+            mError = "Failed to build extruder initialization code.";
+            return false;
+         }
+      }
+
+      int blockCount = (int)spliceLayer.blocks.size();
+      for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+      {
+         const SpliceBlock& block = spliceLayer.blocks[blockIndex];
+         const GCodeObject* object = block.object;
+         int currentExtruder = block.extruder;
+
+         // Begin by processing the extruder change if necessary.
+         if (lastExtruder != currentExtruder)
+         {
+            if (!buildExtruderSwap(*emitter, lastExtruder, currentExtruder, offset[E]))
             {
-               // If we are still waiting to initialize our extruders,
-               // we need to set them up to be idle except for the
-               // one we are starting the print with.
-               if (initExtruders)
-               {
-                  initExtruders = false;
-                  currentExtruder = object->getExtruder();
+               mError = "Failed to build extruder swap code.";
+               return false;
+            }
 
-                  if (!buildExtruderInit(file, currentExtruder))
-                  {
-                     mError = "Failed to build extruder initialization code.";
-                     return false;
-                  }
-               }
-               std::vector<GCodeCommand> layer;
-               object->getLayerAtHeight(layer, currentLayerHeight);
+            lastExtruder = currentExtruder;
+         }
 
-               // If we found some codes for this layer using our current extruder...
-               if (!layer.empty())
-               {
-                  // Begin by processing the extruder change if necessary.
-                  if (lastExtruder != currentExtruder)
-                  {
-                     if (!buildExtruderSwap(file, lastExtruder, currentExtruder, offset[E]))
-                     {
-                        mError = "Failed to build extruder swap code.";
-                        return false;
-                     }
+         // Setup the offset based on the offset of the current extruder
+         // and the offset position to place the object.
+         for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+         {
+            offset[axis] = toFixed(object->getOffsetPos()[axis] + mPrefs.extruderList[lastExtruder].offset[axis], axis);
+         }
 
-                     lastExtruder = currentExtruder;
-                  }
+         // Heading straight down to a lower layer would drag the nozzle
+         // through whatever was printed above it, so we go over instead.
+         if (block.height < highestHeight)
+         {
+            QPointF entry;
+            QPointF exit;
+            getBlockEnds(block, entry, exit);
 
-                  // Setup the offset based on the offset of the current extruder
-                  // and the offset position to place the object.
-                  for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
-                  {
-                     offset[axis] = object->getOffsetPos()[axis] + mPrefs.extruderList[lastExtruder].offset[axis];
-                  }
+            qint64 clearZ = highestHeight + toFixed(SCHEDULE_Z_CLEARANCE + mPrefs.extruderList[currentExtruder].offset[Z], Z);
+            buildClearanceTravel(*emitter, clearZ, entry, currentExtruder, currentPos);
+         }
+         highestHeight = qMax(highestHeight, block.height);
 
-                  int codeCount = (int)layer.size();
-                  for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
-                  {
-                     const GCodeCommand& code = layer[codeIndex];
+         // The layer is shared between every instance of the object,
+         // so it is written out through our offset rather than copied.
+         int preheatIndex = 0;
+         int preheatCount = (int)block.preheats.size();
+         int codeCount = (int)block.layer->codes.size();
+         for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
+         {
+            const GCodeCommand& code = block.layer->codes[codeIndex];
 
-                     if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
-                         code.type == GCODE_EXTRUDER_MOVEMENT1)
-                     {
-                        buildExtruderMovement(file, code, currentExtruder, offset, currentPos);
-                     }
-                     // Commands to skip.
-                     else if (code.type == GCODE_HOME ||
-                        code.type == MCODE_DISABLE_STEPPERS)
-                     {
-                        continue;
-                     }
-                     else
-                     {
-                        file.write(code.command.toAscii());
-                     }
+            while (preheatIndex < preheatCount && block.preheats[preheatIndex].codeIndex <= codeIndex)
+            {
+               buildExtruderPreheat(*emitter, block.preheats[preheatIndex].extruder);
+               preheatIndex++;
+            }
+
+            if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
+                code.type == GCODE_EXTRUDER_MOVEMENT1 ||
+                code.type == GCODE_CW_ARC ||
+                code.type == GCODE_CCW_ARC)
+            {
+               movementTrace.begin();
+               buildExtruderMovement(*emitter, code, currentExtruder, offset, currentPos);
+               movementTrace.end();
+
+               // Replace as many of the moves that follow with arcs as we can.
+               QPointF center;
+               bool clockwise = false;
+               int arcEnd = codeIndex;
+               while (mPrefs.arcTolerance > 0.0 &&
+                  (arcEnd = fitArc(block.layer->codes, codeIndex, center, clockwise)) > codeIndex)
+               {
+                  // Finish the line of the move the arc starts from.
+                  if (mPrefs.exportComments) emitter->write(block.layer->codes[codeIndex].comment.toAscii());
+                  emitter->write("\n");
 
-                     if (mPrefs.exportComments) file.write(code.comment.toAscii());
-                     file.write("\n");
+                  while (preheatIndex < preheatCount && block.preheats[preheatIndex].codeIndex <= arcEnd)
+                  {
+                     buildExtruderPreheat(*emitter, block.preheats[preheatIndex].extruder);
+                     preheatIndex++;
                   }
+
+                  buildArcMovement(*emitter, block.layer->codes, codeIndex, arcEnd, center, clockwise, currentExtruder, offset, currentPos);
+                  mArcCount++;
+                  mArcMoveCount += arcEnd - codeIndex;
+                  codeIndex = arcEnd;
                }
             }
-         }
+            // Commands to skip.
+            else if (code.type == GCODE_HOME ||
+               code.type == MCODE_DISABLE_STEPPERS ||
+               isRepeatedCommand(code, currentExtruder))
+            {
+               continue;
+            }
+            else
+            {
+               emitter->write(code.command.toAscii());
+            }
 
-         // Iterate to the next extruder.
-         currentExtruder++;
-         if (currentExtruder >= (int)mPrefs.extruderList.size())
-         {
-            currentExtruder = 0;
+            if (mPrefs.exportComments) emitter->write(block.layer->codes[codeIndex].comment.toAscii());
+            emitter->write("\n");
          }
       }
    
-      layerIndex++;
+      if (Trace::isEnabled())
+      {
+         Trace::addEvent("GCodeSplicer::buildLayer", layerTraceStart, Trace::getTime() - layerTraceStart,
+            QString("\"layer\": %1, \"buildExtruderMovement_count\": %2, \"buildExtruderMovement_us\": %3")
+            .arg(layerIndex + 1).arg(movementTrace.getCount()).arg(movementTrace.getTotal()));
+      }
 
-      progressDialog.setValue(layerIndex);
-      if (progressDialog.wasCanceled())
+      if (progressDialog)
       {
-         mError = "";
-         file.close();
-         return false;
+         progressDialog->setValue(layerIndex + 1);
+         if (progressDialog->wasCanceled())
+         {
+            mError = "";
+            emitter->close();
+            return false;
+         }
       }
    }
 
-   // Now cool down all of our extruders and disable motors on the printer.
-   int extruderCount = (int)mPrefs.extruderList.size();
-   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
-   {
-      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
-
-      file.write("T");
-      file.write(QString::number(extruderIndex).toAscii());
-      file.write("\n");
+   flushFeedRate(*emitter);
+   mShardLeavingExtruder = lastExtruder;
 
-      file.write("M104 S0\n");
+   if (lastLayer == layerCount - 1)
+   {
+      buildFooter(*emitter);
    }
 
-   file.write("M84");
-   if (mPrefs.exportComments) file.write("; Disable motors");
-   file.write("\n");
+   emitter->close();
 
-   // Now supply the custom end code.
-   if (!mPrefs.postfixCode.isEmpty())
+   // Estimate how long the print takes from what we actually wrote,
+   // swaps and heating included.  A shard is only part of a print, so
+   // it is left to be estimated once merged.
+   GCodeTimeEstimator estimator(mPrefs);
+   std::vector<qint64> layerOffsets = getLayerOffsets();
+   if (!isShard && estimator.estimateFile(fileName, &layerOffsets))
    {
-      file.write(mPrefs.postfixCode.toAscii());
-      file.write("\n");
+      mEstimatedTime = estimator.getTotalTime();
+      mLayerTimes = estimator.getSectionTimes();
+
+      if (mPrefs.exportComments && emitter->open(true))
+      {
+         emitter->write("; Estimated print time: ");
+         emitter->write(GCodeTimeEstimator::formatTime(mEstimatedTime).toAscii());
+         emitter->write("\n");
+         emitter->write("; Extruder swaps: ");
+         emitter->write(QString::number(mSwapCount).toAscii());
+         emitter->write(" (");
+         emitter->write(QString::number(mBaselineSwapCount).toAscii());
+         emitter->write(" without layer grouping)\n");
+         emitter->write("; Travel between objects: ");
+         emitter->write(QString::number(mTravelDistance, 'f', 0).toAscii());
+         emitter->write("mm (");
+         emitter->write(QString::number(mBaselineTravelDistance, 'f', 0).toAscii());
+         emitter->write("mm unordered)\n");
+
+         if (mArcCount > 0)
+         {
+            emitter->write("; Arc fitting replaced ");
+            emitter->write(QString::number(mArcMoveCount).toAscii());
+            emitter->write(" moves with ");
+            emitter->write(QString::number(mArcCount).toAscii());
+            emitter->write(" arcs\n");
+         }
+         emitter->close();
+      }
    }
 
-   file.close();
+   if (!writeLayerIndex(fileName, isShard))
+   {
+      mError = "Could not write the layer index \'" + fileName + LAYER_INDEX_EXTENSION + "\'.";
+      return false;
+   }
 
    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeSplicer::buildHeader(QFile& file)
+bool GCodeSplicer::loadLayerIndex(const QString& fileName)
 {
-   file.write("; Spliced using LocheGSplicer ");
-   file.write(VERSION.toAscii());
-   file.write("\n");
+   mLayerStates.clear();
+   mShardEnteringExtruder = -1;
+   mShardLeavingExtruder = -1;
+   mShardLayerCount = 0;
 
-   // Start by assembling the initialization code.  Start with
-   // the header code from the first object, then include our
-   // custom header code, and last include our final settings.
-   const GCodeObject* object = mObjectList[0];
-   if (object && object->getLayerCount())
+   GCodeParser parser;
+   if (!parser.loadFile(fileName + LAYER_INDEX_EXTENSION))
    {
-      const std::vector<GCodeCommand>& header = object->getLayer(0).codes;
-      int count = (int)header.size();
-      for (int index = 0; index < count; ++index)
+      mError = "Could not open the layer index of \'" + fileName + "\', it is written each time a file is spliced.";
+      return false;
+   }
+
+   while (parser.parseNext())
+   {
+      if (parser.codeSeen("Shard:"))
       {
-         const GCodeCommand& code = header[index];
+         mShardEnteringExtruder = parser.codeSeen("Enter:")? parser.codeValueInt(): -1;
+         mShardLeavingExtruder = parser.codeSeen("Leave:")? parser.codeValueInt(): -1;
+         mShardLayerCount = parser.codeSeen("Total:")? parser.codeValueInt(): 0;
+         continue;
+      }
 
-         // We only care about certain codes.
-         if (code.type == GCODE_COMMENT ||
-            code.type == GCODE_DWELL ||
-            code.type == GCODE_HOME ||
-            code.type == MCODE_FAN_ENABLE ||
-            code.type == MCODE_FAN_DISABLE)
-         {
-            file.write(code.command.toAscii());
+      if (!parser.codeSeen("Layer:"))
+      {
+         continue;
+      }
 
-            if (mPrefs.exportComments && !code.comment.isEmpty())
-            {
-               file.write(code.comment.toAscii());
-            }
-            file.write("\n");
+      SpliceLayerState state;
+      state.layer = parser.codeValueInt();
+      state.offset = parser.codeSeen("Offset:")? parser.codeValue().toLongLong(): -1;
+      state.height = parser.codeSeen("Height:")? toFixed(parser.codeValueDouble(), Z): 0;
+      state.extruder = parser.codeSeen("Tool:")? parser.codeValueInt(): 0;
+      state.pos[X] = parser.codeSeen("PosX:")? toFixed(parser.codeValueDouble(), X): 0;
+      state.pos[Y] = parser.codeSeen("PosY:")? toFixed(parser.codeValueDouble(), Y): 0;
+      state.pos[Z] = parser.codeSeen("PosZ:")? toFixed(parser.codeValueDouble(), Z): 0;
+      state.feedRate = parser.codeSeen("Feed:")? parser.codeValueDouble(): -1.0;
+      state.fanSpeed = parser.codeSeen("Fan:")? parser.codeValueDouble(): -1.0;
+
+      if (parser.codeSeen("Temps:"))
+      {
+         QStringList temperatures = parser.codeValue().split(',');
+         for (int index = 0; index < temperatures.size(); ++index)
+         {
+            state.temperatures.push_back(temperatures[index].toDouble());
          }
       }
-   }
-
-   if (!mPrefs.prefixCode.isEmpty())
-   {
-      file.write(mPrefs.prefixCode.toAscii());
-      file.write("\n");
-   }
 
-   file.write("G21");
-   if (mPrefs.exportComments) file.write("; Set units to millimeters");
-   file.write("\n");
+      if (state.offset < 0)
+      {
+         mError = "The layer index of \'" + fileName + "\' is corrupt.";
+         mLayerStates.clear();
+         return false;
+      }
 
-   // Now append our constant header codes.
-   if (mPrefs.exportAbsoluteMode)
-   {
-      file.write("G90");
-      if (mPrefs.exportComments) file.write("; Use absolute coordinates");
-   }
-   else
-   {
-      file.write("G91");
-      if (mPrefs.exportComments) file.write("; Use relative coordinates");
+      mLayerStates.push_back(state);
    }
-   file.write("\n");
 
-   if (mPrefs.exportAbsoluteEMode)
+   if (!parser.getError().isEmpty())
    {
-      file.write("M82");
-      if (mPrefs.exportComments) file.write("; Use absolute E coordinates");
+      mError = parser.getError();
+      mLayerStates.clear();
+      return false;
    }
-   else
+
+   if (mLayerStates.empty())
    {
-      file.write("M83");
-      if (mPrefs.exportComments) file.write("; Use relative E coordinates");
+      mError = "The layer index of \'" + fileName + "\' has no layers.";
+      return false;
    }
-   file.write("\n");
+
    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeSplicer::buildExtruderInit(QFile& file, int currentExtruder)
+int GCodeSplicer::getIndexedLayerCount() const
 {
-   // Set all extruders to print temp first so we can
-   // retract them.  Then put the all of them to idle
-   // except the one we are going to print with.
-   if (mPrefs.exportComments)
+   return (int)mLayerStates.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::exportResume(const QString& fileName, int layer, const QString& resumeFileName)
+{
+   TRACE_SPAN("GCodeSplicer::exportResume");
+
+   if (!loadLayerIndex(fileName))
    {
-      file.write("; Do some initialization on our extruders by retracting\n");
-      file.write("; our idle ones and setting our initial temperatures\n");
+      return false;
    }
 
-   // Start with a non-waiting temp change so we can quickly
-   // apply this to all of the extruders at once.
-   int extruderCount = (int)mPrefs.extruderList.size();
-   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   int stateIndex = 0;
+   int stateCount = (int)mLayerStates.size();
+   while (stateIndex < stateCount && mLayerStates[stateIndex].layer != layer)
    {
-      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
-
-      file.write("T");
-      file.write(QString::number(extruderIndex).toAscii());
-      file.write("\n");
-
-      file.write("M104 S");
-      file.write(QString::number(extruder.printTemp).toAscii());
-      file.write("\n");
+      stateIndex++;
    }
 
-   // Once all of the extruders are set to heat up, let's wait
-   // for them to finish heating up.
-   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   if (stateIndex == stateCount)
    {
-      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+      mError = QString("Layer %1 is not in the layer index, which has layers %2 to %3.")
+         .arg(layer).arg(mLayerStates.front().layer).arg(mLayerStates.back().layer);
+      return false;
+   }
 
-      file.write("T");
-      file.write(QString::number(extruderIndex).toAscii());
-      file.write("\n");
+   const SpliceLayerState& state = mLayerStates[stateIndex];
 
-      file.write("M109 S");
-      file.write(QString::number(extruder.printTemp).toAscii());
-      file.write("\n");
+   QFile input(fileName);
+   if (!input.open(QIODevice::ReadOnly))
+   {
+      mError = "Could not open file \'" + fileName + "\' for reading.";
+      return false;
    }
 
-   // Once the extruders reach their temperatures, we can
-   // retract them.
-   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   // Layer offsets count bytes of text, so only plain text can be seeked into.
+   if (isEncodedFile(input))
    {
-      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
-
-      if (extruderIndex != currentExtruder)
-      {
-         file.write("T");
-         file.write(QString::number(extruderIndex).toAscii());
-         file.write("\n");
+      mError = "Only uncompressed text files can be resumed.";
+      return false;
+   }
 
-         file.write("G1 F");
-         file.write(QString::number(extruder.retractSpeed * 60.0).toAscii());
-         file.write("\n");
+   // Every layer begins with either its comment or resetting the extrusion,
+   // anything else means the file has changed since it was indexed.
+   QByteArray start;
+   if (input.seek(state.offset))
+   {
+      start = input.peek(6);
+   }
 
-         file.write("G1 E");
-         file.write(QString::number(-extruder.retraction * extruder.flow).toAscii());
-         file.write("\n");
-      }
+   if (!start.startsWith(';') && start != "G92 E0")
+   {
+      mError = "The layer index does not match \'" + fileName + "\', it may have been changed since it was spliced.";
+      return false;
    }
 
-   // Return all idle extruders to their idle temperatures.
-   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   QScopedPointer<GCodeEmitter> emitter(GCodeEmitter::create(resumeFileName));
+   if (!emitter->open())
    {
-      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+      mError = "Could not open file \'" + resumeFileName + "\' for writing.";
+      return false;
+   }
 
-      if (extruderIndex != currentExtruder &&
-         extruder.idleTemp != extruder.printTemp)
-      {
-         file.write("T");
-         file.write(QString::number(extruderIndex).toAscii());
-         file.write("\n");
+   buildResumeHeader(*emitter, state, layer);
 
-         file.write("M104 S");
-         file.write(QString::number(extruder.idleTemp).toAscii());
-         file.write("\n");
+   // Everything from the layer on is copied as it is.
+   while (!input.atEnd())
+   {
+      QByteArray data = input.read(RESUME_COPY_SIZE);
+      if (data.isEmpty())
+      {
+         mError = "Failed reading file \'" + fileName + "\'.";
+         return false;
       }
+
+      emitter->write(data);
    }
 
-   // Now set it to our first extruder and begin printing.
-   file.write("T");
-   file.write(QString::number(currentExtruder).toAscii());
-   file.write("\n");
+   emitter->close();
    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeSplicer::buildExtruderSwap(QFile& file, int lastExtruder, int currentExtruder, double& extrusionValue)
+bool GCodeSplicer::mergeShards(const QStringList& shardFileNames, const QString& fileName)
 {
-   if (mPrefs.exportComments)
+   TRACE_SPAN("GCodeSplicer::mergeShards");
+
+   if (shardFileNames.isEmpty())
    {
-      file.write("; ++++++++++++++++++++++++++++++++++++++\n; Swap from extruder ");
-      file.write(QString::number(lastExtruder).toAscii());
-      file.write(" to ");
-      file.write(QString::number(currentExtruder).toAscii());
-      file.write("\n; ++++++++++++++++++++++++++++++++++++++\n");
+      mError = "No shards to merge.";
+      return false;
+   }
+
+   // Check every shard belongs to the same splice and that together they
+   // cover all of it before anything is written.
+   int shardCount = shardFileNames.size();
+   std::vector<std::vector<SpliceLayerState> > shardStates(shardCount);
+   std::vector<int> enteringExtruders(shardCount, -1);
+   std::vector<int> leavingExtruders(shardCount, -1);
+   int nextLayer = 1;
+   int layerCount = 0;
+
+   for (int shardIndex = 0; shardIndex < shardCount; ++shardIndex)
+   {
+      const QString& shardFileName = shardFileNames[shardIndex];
+
+      GCodeSplicer shard(mPrefs);
+      if (!shard.loadLayerIndex(shardFileName))
+      {
+         mError = shard.getError();
+         return false;
+      }
+
+      if (shard.mShardEnteringExtruder < 0)
+      {
+         mError = "\'" + shardFileName + "\' was not spliced as a shard.";
+         return false;
+      }
+
+      if (shardIndex == 0)
+      {
+         layerCount = shard.mShardLayerCount;
+      }
+      else if (shard.mShardLayerCount != layerCount)
+      {
+         mError = QString("Shard \'%1\' was spliced with %2 layers where the others have %3, they are not from the same splice.")
+            .arg(shardFileName).arg(shard.mShardLayerCount).arg(layerCount);
+         return false;
+      }
+
+      if (shard.mLayerStates.front().layer != nextLayer)
+      {
+         mError = QString("Shard \'%1\' starts at layer %2 where layer %3 was expected.")
+            .arg(shardFileName).arg(shard.mLayerStates.front().layer).arg(nextLayer);
+         return false;
+      }
+
+      QFile input(shardFileName);
+      if (!input.open(QIODevice::ReadOnly))
+      {
+         mError = "Could not open file \'" + shardFileName + "\' for reading.";
+         return false;
+      }
+
+      if (isEncodedFile(input))
+      {
+         mError = "Only uncompressed text shards can be merged.";
+         return false;
+      }
+
+      shardStates[shardIndex] = shard.mLayerStates;
+      enteringExtruders[shardIndex] = shard.mShardEnteringExtruder;
+      leavingExtruders[shardIndex] = shard.mShardLeavingExtruder;
+      nextLayer = shard.mLayerStates.back().layer + 1;
+   }
+
+   if (nextLayer - 1 != layerCount)
+   {
+      mError = QString("The shards end at layer %1 of %2.").arg(nextLayer - 1).arg(layerCount);
+      return false;
+   }
+
+   QScopedPointer<GCodeEmitter> emitter(GCodeEmitter::create(fileName));
+   if (!emitter->open())
+   {
+      mError = "Could not open file \'" + fileName + "\' for writing.";
+      return false;
+   }
+
+   mEstimatedTime = 0.0;
+   mLayerTimes.clear();
+
+   // Nothing is known of the printer state where two shards meet.
+   mFeedRate = -1.0;
+   mPendingFeedRate = -1.0;
+   mFanSpeed = -1.0;
+   mTemperatures.assign(mPrefs.extruderList.size(), -1.0);
+
+   std::vector<SpliceLayerState> layerStates;
+   int lastExtruder = -1;
+   bool isCopied = true;
+
+   for (int shardIndex = 0; shardIndex < shardCount && isCopied; ++shardIndex)
+   {
+      const QString& shardFileName = shardFileNames[shardIndex];
+
+      QFile input(shardFileName);
+      if (!input.open(QIODevice::ReadOnly))
+      {
+         mError = "Could not open file \'" + shardFileName + "\' for reading.";
+         isCopied = false;
+         break;
+      }
+
+      // A shard spliced from a different extruder than the last one
+      // left with needs a swap between them.
+      int enteringExtruder = enteringExtruders[shardIndex];
+      if (lastExtruder >= 0 && lastExtruder != enteringExtruder &&
+         enteringExtruder < (int)mPrefs.extruderList.size())
+      {
+         qint64 extrusionValue = 0;
+         emitter->write("G92 E0\n");
+         buildExtruderSwap(*emitter, lastExtruder, enteringExtruder, extrusionValue);
+         flushFeedRate(*emitter);
+      }
+
+      // The shard's layers now start further into the file.
+      qint64 shardStart = emitter->getPosition();
+      int stateCount = (int)shardStates[shardIndex].size();
+      for (int stateIndex = 0; stateIndex < stateCount; ++stateIndex)
+      {
+         SpliceLayerState state = shardStates[shardIndex][stateIndex];
+         state.offset += shardStart;
+         layerStates.push_back(state);
+      }
+
+      while (!input.atEnd())
+      {
+         QByteArray data = input.read(RESUME_COPY_SIZE);
+         if (data.isEmpty())
+         {
+            mError = "Failed reading file \'" + shardFileName + "\'.";
+            isCopied = false;
+            break;
+         }
+
+         emitter->write(data);
+      }
+
+      lastExtruder = leavingExtruders[shardIndex];
+   }
+
+   emitter->close();
+
+   // Never leave a partly merged file behind that looks like a whole one.
+   if (!isCopied)
+   {
+      QFile::remove(fileName);
+      return false;
+   }
+
+   mLayerStates = layerStates;
+
+   GCodeTimeEstimator estimator(mPrefs);
+   std::vector<qint64> layerOffsets = getLayerOffsets();
+   if (estimator.estimateFile(fileName, &layerOffsets))
+   {
+      mEstimatedTime = estimator.getTotalTime();
+      mLayerTimes = estimator.getSectionTimes();
+
+      if (mPrefs.exportComments && emitter->open(true))
+      {
+         emitter->write("; Estimated print time: ");
+         emitter->write(GCodeTimeEstimator::formatTime(mEstimatedTime).toAscii());
+         emitter->write("\n");
+         emitter->close();
+      }
+   }
+
+   if (!writeLayerIndex(fileName, false))
+   {
+      mError = "Could not write the layer index \'" + fileName + LAYER_INDEX_EXTENSION + "\'.";
+      QFile::remove(fileName);
+      return false;
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeSplicer::getEstimatedTime() const
+{
+   return mEstimatedTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const std::vector<double>& GCodeSplicer::getLayerTimes() const
+{
+   return mLayerTimes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::getSwapCount() const
+{
+   return mSwapCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::getBaselineSwapCount() const
+{
+   return mBaselineSwapCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeSplicer::getSwapTimeSaved() const
+{
+   return mSwapTimeSaved;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeSplicer::getTravelDistance() const
+{
+   return mTravelDistance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeSplicer::getBaselineTravelDistance() const
+{
+   return mBaselineTravelDistance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::getArcCount() const
+{
+   return mArcCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::getArcMoveCount() const
+{
+   return mArcMoveCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildHeader(GCodeEmitter& emitter)
+{
+   TRACE_SPAN("GCodeSplicer::buildHeader");
+
+   // Binary files carry these in metadata blocks ahead of the gcode.
+   QStringList temperatures;
+   int extruderCount = (int)mPrefs.extruderList.size();
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      temperatures.append(QString::number(mPrefs.extruderList[extruderIndex].printTemp));
+   }
+
+   emitter.addMetadata(METADATA_FILE, "Producer", "LocheGSplicer " + VERSION);
+   emitter.addMetadata(METADATA_PRINTER, "extruder_count", QString::number(extruderCount));
+   emitter.addMetadata(METADATA_PRINTER, "temperature", temperatures.join(","));
+   emitter.addMetadata(METADATA_PRINT, "object_count", QString::number((int)mObjectList.size()));
+   emitter.addMetadata(METADATA_PRINT, "extruder_swaps", QString::number(mSwapCount));
+   emitter.addMetadata(METADATA_SLICER, "absolute_coordinates", mPrefs.exportAbsoluteMode? "1": "0");
+   emitter.addMetadata(METADATA_SLICER, "absolute_e", mPrefs.exportAbsoluteEMode? "1": "0");
+
+   emitter.write("; Spliced using LocheGSplicer ");
+   emitter.write(VERSION.toAscii());
+   emitter.write("\n");
+
+   // Start by assembling the initialization code.  Start with
+   // the header code from the first object, then include our
+   // custom header code, and last include our final settings.
+   const GCodeObject* object = mObjectList[0];
+   if (object && object->getLayerCount())
+   {
+      const std::vector<GCodeCommand>& header = object->getLayer(0).codes;
+      int count = (int)header.size();
+      for (int index = 0; index < count; ++index)
+      {
+         const GCodeCommand& code = header[index];
+
+         // We only care about certain codes.
+         if (code.type == GCODE_COMMENT ||
+            code.type == GCODE_DWELL ||
+            code.type == GCODE_HOME ||
+            code.type == MCODE_FAN_ENABLE ||
+            code.type == MCODE_FAN_DISABLE)
+         {
+            emitter.write(code.command.toAscii());
+
+            if (mPrefs.exportComments && !code.comment.isEmpty())
+            {
+               emitter.write(code.comment.toAscii());
+            }
+            emitter.write("\n");
+         }
+      }
+   }
+
+   if (!mPrefs.prefixCode.isEmpty())
+   {
+      emitter.write(mPrefs.prefixCode.toAscii());
+      emitter.write("\n");
+   }
+
+   emitter.write("G21");
+   if (mPrefs.exportComments) emitter.write("; Set units to millimeters");
+   emitter.write("\n");
+
+   // Now append our constant header codes.
+   if (mPrefs.exportAbsoluteMode)
+   {
+      emitter.write("G90");
+      if (mPrefs.exportComments) emitter.write("; Use absolute coordinates");
+   }
+   else
+   {
+      emitter.write("G91");
+      if (mPrefs.exportComments) emitter.write("; Use relative coordinates");
+   }
+   emitter.write("\n");
+
+   if (mPrefs.exportAbsoluteEMode)
+   {
+      emitter.write("M82");
+      if (mPrefs.exportComments) emitter.write("; Use absolute E coordinates");
+   }
+   else
+   {
+      emitter.write("M83");
+      if (mPrefs.exportComments) emitter.write("; Use relative E coordinates");
+   }
+   emitter.write("\n");
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildFooter(GCodeEmitter& emitter)
+{
+   // Now cool down all of our extruders and disable motors on the printer.
+   int extruderCount = (int)mPrefs.extruderList.size();
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      emitter.write("T");
+      emitter.write(QString::number(extruderIndex).toAscii());
+      emitter.write("\n");
+
+      emitter.write("M104 S0\n");
+   }
+
+   emitter.write("M84");
+   if (mPrefs.exportComments) emitter.write("; Disable motors");
+   emitter.write("\n");
+
+   // Now supply the custom end code.
+   if (!mPrefs.postfixCode.isEmpty())
+   {
+      emitter.write(mPrefs.postfixCode.toAscii());
+      emitter.write("\n");
+   }
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildExtruderInit(GCodeEmitter& emitter, int currentExtruder)
+{
+   TRACE_SPAN("GCodeSplicer::buildExtruderInit");
+
+   // Set all extruders to print temp first so we can
+   // retract them.  Then put the all of them to idle
+   // except the one we are going to print with.
+   if (mPrefs.exportComments)
+   {
+      emitter.write("; Do some initialization on our extruders by retracting\n");
+      emitter.write("; our idle ones and setting our initial temperatures\n");
+   }
+
+   // Start with a non-waiting temp change so we can quickly
+   // apply this to all of the extruders at once.
+   int extruderCount = (int)mPrefs.extruderList.size();
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+
+      emitter.write("T");
+      emitter.write(QString::number(extruderIndex).toAscii());
+      emitter.write("\n");
+
+      emitter.write("M104 S");
+      emitter.write(QString::number(extruder.printTemp).toAscii());
+      emitter.write("\n");
+   }
+
+   // Once all of the extruders are set to heat up, let's wait
+   // for them to finish heating up.
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+
+      emitter.write("T");
+      emitter.write(QString::number(extruderIndex).toAscii());
+      emitter.write("\n");
+
+      emitter.write("M109 S");
+      emitter.write(QString::number(extruder.printTemp).toAscii());
+      emitter.write("\n");
+   }
+
+   // Once the extruders reach their temperatures, we can
+   // retract them.
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+
+      if (extruderIndex != currentExtruder)
+      {
+         emitter.write("T");
+         emitter.write(QString::number(extruderIndex).toAscii());
+         emitter.write("\n");
+
+         emitter.write("G1 F");
+         emitter.write(QString::number(extruder.retractSpeed * 60.0).toAscii());
+         emitter.write("\n");
+
+         emitter.write("G1 E");
+         emitter.write(QString::number(-extruder.retraction * extruder.flow).toAscii());
+         emitter.write("\n");
+      }
+   }
+
+   // Return all idle extruders to their idle temperatures.
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+
+      if (extruderIndex != currentExtruder &&
+         extruder.idleTemp != extruder.printTemp)
+      {
+         emitter.write("T");
+         emitter.write(QString::number(extruderIndex).toAscii());
+         emitter.write("\n");
+
+         emitter.write("M104 S");
+         emitter.write(QString::number(extruder.idleTemp).toAscii());
+         emitter.write("\n");
+      }
+   }
+
+   // Now set it to our first extruder and begin printing.
+   emitter.write("T");
+   emitter.write(QString::number(currentExtruder).toAscii());
+   emitter.write("\n");
+
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      const ExtruderData& extruder = mPrefs.extruderList[extruderIndex];
+      if (extruderIndex != currentExtruder && extruder.idleTemp != extruder.printTemp)
+      {
+         mTemperatures[extruderIndex] = extruder.idleTemp;
+      }
+      else
+      {
+         mTemperatures[extruderIndex] = extruder.printTemp;
+      }
+   }
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildExtruderSwap(GCodeEmitter& emitter, int lastExtruder, int currentExtruder, qint64& extrusionValue)
+{
+   TRACE_SPAN("GCodeSplicer::buildExtruderSwap");
+
+   if (mPrefs.exportComments)
+   {
+      emitter.write("; ++++++++++++++++++++++++++++++++++++++\n; Swap from extruder ");
+      emitter.write(QString::number(lastExtruder).toAscii());
+      emitter.write(" to ");
+      emitter.write(QString::number(currentExtruder).toAscii());
+      emitter.write("\n; ++++++++++++++++++++++++++++++++++++++\n");
+   }
+
+   const ExtruderData& oldExtruder = mPrefs.extruderList[lastExtruder];
+   const ExtruderData& newExtruder = mPrefs.extruderList[currentExtruder];
+
+   // Start by retracting the old extruder if necessary.
+   if (oldExtruder.retraction > 0)
+   {
+      qint64 retraction = toFixed(oldExtruder.retraction * oldExtruder.flow, E);
+
+      QByteArray output = "G1 E";
+      appendFixed(output, extrusionValue - retraction, E);
+      buildFeedRate(emitter, output, oldExtruder.retractSpeed * 60.0);
+      emitter.write(output);
+      if (mPrefs.exportAbsoluteEMode)
+      {
+         extrusionValue -= retraction;
+      }
+      if (mPrefs.exportComments) emitter.write("; Retract the old extruder");
+      emitter.write("\n");
+   }
+
+   // TODO: Wipe excess from the old extruder if necessary.
+
+   // Set the old extruder to idle temperature if necessary.
+   if (oldExtruder.idleTemp > 0.0 && oldExtruder.idleTemp != oldExtruder.printTemp &&
+      !(mPrefs.exportCompact && mTemperatures[lastExtruder] == oldExtruder.idleTemp))
+   {
+      mTemperatures[lastExtruder] = oldExtruder.idleTemp;
+
+      emitter.write("M104 S");
+      emitter.write(QString::number(oldExtruder.idleTemp).toAscii());
+      if (mPrefs.exportComments) emitter.write("; Set the old extruder to idle temp");
+      emitter.write("\n");
+   }
+
+   // Swap extruders.
+   emitter.write("T");
+   emitter.write(QString::number(currentExtruder).toAscii());
+   if (mPrefs.exportComments) emitter.write("; Perform the extruder swap");
+   emitter.write("\n");
+
+   // Set the new extruder to print temperature if necessary.
+   if (newExtruder.printTemp > 0.0 && newExtruder.idleTemp != newExtruder.printTemp)
+   {
+      mTemperatures[currentExtruder] = newExtruder.printTemp;
+
+      emitter.write("M109 S");
+      emitter.write(QString::number(newExtruder.printTemp).toAscii());
+      if (mPrefs.exportComments) emitter.write("; Set the new extruder to print temp");
+      emitter.write("\n");
+   }
+
+   // Prime the extruder if necessary.
+   if (newExtruder.primer * newExtruder.flow > 0 || newExtruder.retraction * newExtruder.flow > 0)
+   {
+      double primer = newExtruder.primer;
+      if (newExtruder.primer <= 0.0)
+      {
+         primer = newExtruder.retraction;
+      }
+
+      qint64 fixedPrimer = toFixed(primer * newExtruder.flow, E);
+
+      QByteArray output = "G1 E";
+      appendFixed(output, extrusionValue + fixedPrimer, E);
+      buildFeedRate(emitter, output, newExtruder.retractSpeed * 60.0);
+      emitter.write(output);
+      if (mPrefs.exportAbsoluteEMode)
+      {
+         extrusionValue += fixedPrimer;
+      }
+      if (mPrefs.exportComments) emitter.write("; Prime the new extruder");
+      emitter.write("\n");
+   }
+
+   emitter.write("G92 E0");
+   if (mPrefs.exportComments) emitter.write("; Reset extrusion");
+   emitter.write("\n");
+   extrusionValue = 0;
+
+   // The next move only needs our travel speed if it has none of its own.
+   mPendingFeedRate = oldExtruder.travelSpeed * 60.0;
+   if (!mPrefs.exportCompact)
+   {
+      flushFeedRate(emitter);
+   }
+
+   if (!mPrefs.swapCode.isEmpty())
+   {
+      flushFeedRate(emitter);
+      emitter.write(mPrefs.swapCode.toAscii());
+      emitter.write("\n");
+      mFeedRate = -1.0;
+   }
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildExtruderPreheat(GCodeEmitter& emitter, int extruder)
+{
+   const ExtruderData& data = mPrefs.extruderList[extruder];
+
+   if (mPrefs.exportCompact && mTemperatures[extruder] == data.printTemp)
+   {
+      return true;
+   }
+   mTemperatures[extruder] = data.printTemp;
+
+   // Heat without waiting, so the extruder reaches its
+   // print temperature while the current one keeps printing.
+   emitter.write("M104 T");
+   emitter.write(QString::number(extruder).toAscii());
+   emitter.write(" S");
+   emitter.write(QString::number(data.printTemp).toAscii());
+   if (mPrefs.exportComments) emitter.write("; Preheat the next extruder");
+   emitter.write("\n");
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildExtruderMovement(GCodeEmitter& emitter, const GCodeCommand& code, int currentExtruder, qint64* offset, qint64* currentPos)
+{
+   QByteArray output;
+   if (code.type == GCODE_EXTRUDER_MOVEMENT0)   output = "G0";
+   else if (code.type == GCODE_CW_ARC)          output = "G2";
+   else if (code.type == GCODE_CCW_ARC)         output = "G3";
+   else                                         output = "G1";
+
+   bool isArc = code.type == GCODE_CW_ARC || code.type == GCODE_CCW_ARC;
+
+   double flow = mPrefs.extruderList[currentExtruder].flow;
+
+   bool hasChanged = false;
+   for (int axis = 0; axis < AXIS_NUM; ++axis)
+   {
+      // Only export this axis if it has changed, or if we
+      // have the preference to re-export duplicate axes.
+      // Positions are compared where they end up on the printer, as
+      // the same position in two objects is rarely the same place.
+      qint64 value = code.axisValue[axis];
+      if (axis != E)
+      {
+         value += offset[axis];
+      }
+
+      // Arcs always give where they end, as leaving it out
+      // would have them go all the way around a circle.
+      if ((mPrefs.exportAllAxes && !mPrefs.exportCompact) ||
+         (isArc && (axis == X || axis == Y)) ||
+         (axis != E && value != currentPos[axis]) ||
+         (axis == E && code.axisValue[axis] != 0))
+      {
+         output += ' ';
+         output += AXIS_NAME[axis];
+
+         if (axis == E)
+         {
+            if (flow != 1.0)
+            {
+               // Offset the extrusion value by our extruders flow ratio.
+               value = qRound64(value * flow);
+            }
+            value += offset[axis];
+            if (mPrefs.exportAbsoluteEMode)
+            {
+               offset[E] = value;
+            }
+         }
+
+         appendFixed(output, value, axis);
+         hasChanged = true;
+      }
+
+      if (axis != E)
+      {
+         currentPos[axis] = value;
+      }
+   }
+
+   // The center of an arc is relative to its start, so it needs no offset.
+   if (isArc)
+   {
+      output += " I";
+      appendFixed(output, code.arcOffset[X], X);
+      output += " J";
+      appendFixed(output, code.arcOffset[Y], Y);
+   }
+
+   if (appendMoveFeedRate(output, code))
+   {
+      hasChanged = true;
+   }
+
+   if (hasChanged)
+   {
+      emitter.write(output);
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildArcMovement(GCodeEmitter& emitter, const std::vector<GCodeCommand>& codes, int startIndex, int endIndex, const QPointF& center, bool clockwise, int currentExtruder, qint64* offset, qint64* currentPos)
+{
+   const GCodeCommand& start = codes[startIndex];
+   const GCodeCommand& end = codes[endIndex];
+
+   QByteArray output = clockwise? "G2": "G3";
+
+   for (int axis = X; axis <= Y; ++axis)
+   {
+      qint64 value = end.axisValue[axis] + offset[axis];
+
+      output += ' ';
+      output += AXIS_NAME[axis];
+      appendFixed(output, value, axis);
+
+      currentPos[axis] = value;
+   }
+
+   // The center is relative to where the arc starts.
+   output += " I";
+   appendFixed(output, toFixed(center.x(), X) - start.axisValue[X], X);
+   output += " J";
+   appendFixed(output, toFixed(center.y(), Y) - start.axisValue[Y], Y);
+
+   // Extrude everything the moves would have, which the
+   // firmware spreads evenly along the arc.
+   double flow = mPrefs.extruderList[currentExtruder].flow;
+   qint64 extrusion = 0;
+   for (int codeIndex = startIndex + 1; codeIndex <= endIndex; ++codeIndex)
+   {
+      qint64 value = codes[codeIndex].axisValue[E];
+      if (flow != 1.0)
+      {
+         value = qRound64(value * flow);
+      }
+      extrusion += value;
+   }
+
+   extrusion += offset[E];
+   if (mPrefs.exportAbsoluteEMode)
+   {
+      offset[E] = extrusion;
+   }
+
+   output += " E";
+   appendFixed(output, extrusion, E);
+
+   appendMoveFeedRate(output, codes[startIndex + 1]);
+
+   emitter.write(output);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::buildClearanceTravel(GCodeEmitter& emitter, qint64 clearZ, const QPointF& entry, int currentExtruder, qint64* currentPos)
+{
+   double travelSpeed = mPrefs.extruderList[currentExtruder].travelSpeed * 60.0;
+
+   if (currentPos[Z] < clearZ)
+   {
+      QByteArray output = "G1 Z";
+      appendFixed(output, clearZ, Z);
+      buildFeedRate(emitter, output, travelSpeed);
+      emitter.write(output);
+      if (mPrefs.exportComments) emitter.write("; Rise above the taller parts");
+      emitter.write("\n");
+      currentPos[Z] = clearZ;
+   }
+
+   // The block's first move then takes us straight down into place.
+   currentPos[X] = toFixed(entry.x(), X);
+   currentPos[Y] = toFixed(entry.y(), Y);
+
+   QByteArray output = "G1 X";
+   appendFixed(output, currentPos[X], X);
+   output += " Y";
+   appendFixed(output, currentPos[Y], Y);
+   buildFeedRate(emitter, output, travelSpeed);
+   emitter.write(output);
+   if (mPrefs.exportComments) emitter.write("; Travel over to the lower layer");
+   emitter.write("\n");
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::fitArc(const std::vector<GCodeCommand>& codes, int startIndex, QPointF& center, bool& clockwise) const
+{
+   const GCodeCommand& start = codes[startIndex];
+   double tolerance = mPrefs.arcTolerance;
+
+   std::vector<QPointF> points;
+   points.push_back(QPointF(fromFixed(start.axisValue[X], X), fromFixed(start.axisValue[Y], Y)));
+
+   double totalLength = 0.0;
+   double totalExtrusion = 0.0;
+   int bestEnd = startIndex;
+
+   int codeCount = (int)codes.size();
+   for (int codeIndex = startIndex + 1; codeIndex < codeCount && codeIndex - startIndex <= ARC_MAX_MOVES; ++codeIndex)
+   {
+      // Only extruding moves along the same height, with the
+      // feed rate of the first, can become a single arc.
+      const GCodeCommand& code = codes[codeIndex];
+      if (code.type != GCODE_EXTRUDER_MOVEMENT1 ||
+         code.axisValue[E] <= 0 ||
+         code.axisValue[Z] != start.axisValue[Z] ||
+         (code.hasF && codeIndex > startIndex + 1))
+      {
+         break;
+      }
+
+      QPointF point(fromFixed(code.axisValue[X], X), fromFixed(code.axisValue[Y], Y));
+      double length = getDistance(points.back(), point);
+      if (length <= 0.0)
+      {
+         break;
+      }
+
+      points.push_back(point);
+      totalLength += length;
+      totalExtrusion += fromFixed(code.axisValue[E], E);
+
+      int moveCount = (int)points.size() - 1;
+      if (moveCount < ARC_MIN_MOVES)
+      {
+         continue;
+      }
+
+      QPointF arcCenter;
+      double radius = 0.0;
+      if (!getCircle(points.front(), points[points.size() / 2], points.back(), arcCenter, radius) ||
+         radius > ARC_MAX_RADIUS)
+      {
+         break;
+      }
+
+      // Every point must lie on the circle, with every move turning
+      // the same way, bulging no further than our tolerance from it
+      // and extruding as much per mm as the rest.
+      double extrusionRate = totalExtrusion / totalLength;
+      double totalAngle = 0.0;
+      double turn = 0.0;
+      bool fits = true;
+      for (int moveIndex = 0; moveIndex < moveCount && fits; ++moveIndex)
+      {
+         const QPointF& from = points[moveIndex];
+         const QPointF& to = points[moveIndex + 1];
+
+         if (fabs(getDistance(arcCenter, to) - radius) > tolerance)
+         {
+            fits = false;
+            break;
+         }
+
+         double moveLength = getDistance(from, to);
+         double halfLength = moveLength / 2.0;
+         if (halfLength > radius || radius - sqrt(radius * radius - halfLength * halfLength) > tolerance)
+         {
+            fits = false;
+            break;
+         }
+
+         QPointF fromOffset = from - arcCenter;
+         QPointF toOffset = to - arcCenter;
+         double cross = fromOffset.x() * toOffset.y() - fromOffset.y() * toOffset.x();
+         double dot = fromOffset.x() * toOffset.x() + fromOffset.y() * toOffset.y();
+         if (cross == 0.0 || (turn != 0.0 && (cross > 0.0) != (turn > 0.0)))
+         {
+            fits = false;
+            break;
+         }
+         turn = cross;
+         totalAngle += fabs(atan2(cross, dot));
+
+         double moveExtrusion = fromFixed(codes[startIndex + 1 + moveIndex].axisValue[E], E);
+         if (fabs(moveExtrusion / moveLength - extrusionRate) > extrusionRate * ARC_EXTRUSION_TOLERANCE)
+         {
+            fits = false;
+         }
+      }
+
+      // A full circle would end where it starts, which reads as no arc at all.
+      if (!fits || totalAngle >= 2.0 * M_PI * 0.99)
+      {
+         break;
+      }
+
+      bestEnd = codeIndex;
+      center = arcCenter;
+      clockwise = turn < 0.0;
+   }
+
+   return bestEnd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::appendMoveFeedRate(QByteArray& output, const GCodeCommand& code)
+{
+   // Use our own feed rate, or the one we were left to set.
+   double feedRate = code.hasF? code.f: mPendingFeedRate;
+   mPendingFeedRate = -1.0;
+   if (feedRate < 0.0)
+   {
+      return false;
+   }
+
+   bool isChanged = feedRate != mFeedRate;
+   mFeedRate = feedRate;
+   if (!mPrefs.exportCompact || isChanged)
+   {
+      output += " F" + QByteArray::number(feedRate);
+      return true;
+   }
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::buildFeedRate(GCodeEmitter& emitter, QByteArray& output, double feedRate)
+{
+   if (mPrefs.exportCompact)
+   {
+      // Set on the move itself, and only when it changes.
+      if (feedRate != mFeedRate)
+      {
+         output += " F" + QByteArray::number(feedRate);
+      }
+   }
+   else
+   {
+      emitter.write("G1 F");
+      emitter.write(QString::number(feedRate).toAscii());
+      emitter.write("\n");
+   }
+
+   mFeedRate = feedRate;
+   mPendingFeedRate = -1.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::flushFeedRate(GCodeEmitter& emitter)
+{
+   if (mPendingFeedRate < 0.0)
+   {
+      return;
+   }
+
+   if (!mPrefs.exportCompact || mPendingFeedRate != mFeedRate)
+   {
+      emitter.write("G1 F");
+      emitter.write(QString::number(mPendingFeedRate).toAscii());
+      emitter.write("\n");
+   }
+
+   mFeedRate = mPendingFeedRate;
+   mPendingFeedRate = -1.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::isRepeatedCommand(const GCodeCommand& code, int currentExtruder)
+{
+   if (code.type == MCODE_SET_EXTRUDER_TEMP ||
+      code.type == MCODE_SET_EXTRUDER_TEMP_WAIT)
+   {
+      // Temperatures aimed at another extruder are not followed.
+      if (!code.hasS || code.command.contains('T', Qt::CaseInsensitive))
+      {
+         mTemperatures.assign(mTemperatures.size(), -1.0);
+         return false;
+      }
+
+      // Waiting is never repeated, as the extruder may still be heating.
+      bool isRepeated = code.type == MCODE_SET_EXTRUDER_TEMP && mTemperatures[currentExtruder] == code.s;
+      mTemperatures[currentExtruder] = code.s;
+      return mPrefs.exportCompact && isRepeated;
+   }
+   else if (code.type == MCODE_FAN_ENABLE ||
+            code.type == MCODE_FAN_DISABLE)
+   {
+      double fanSpeed = 0.0;
+      if (code.type == MCODE_FAN_ENABLE)
+      {
+         fanSpeed = code.hasS? code.s: 255.0;
+      }
+
+      bool isRepeated = mFanSpeed == fanSpeed;
+      mFanSpeed = fanSpeed;
+      return mPrefs.exportCompact && isRepeated;
+   }
+
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::appendFixed(QByteArray& output, qint64 value, int axis)
+{
+   // Build the digits backwards from the end of the buffer.
+   char buffer[32];
+   char* end = buffer + sizeof(buffer);
+   char* pos = end;
+
+   bool negative = value < 0;
+   quint64 digits = negative? (quint64)0 - (quint64)value: (quint64)value;
+
+   // Fractional digits, leaving off any trailing zeros.
+   bool hasFraction = false;
+   for (int decimal = 0; decimal < AXIS_DECIMALS[axis]; ++decimal)
+   {
+      char digit = (char)(digits % 10);
+      digits /= 10;
+
+      if (digit != 0 || hasFraction)
+      {
+         *--pos = '0' + digit;
+         hasFraction = true;
+      }
+   }
+
+   if (hasFraction)
+   {
+      *--pos = '.';
+   }
+
+   // Whole digits.
+   do
+   {
+      *--pos = '0' + (char)(digits % 10);
+      digits /= 10;
+   } while (digits > 0);
+
+   if (negative)
+   {
+      *--pos = '-';
+   }
+
+   output.append(pos, (int)(end - pos));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::writeLayerIndex(const QString& fileName, bool isShard) const
+{
+   QFile file(fileName + LAYER_INDEX_EXTENSION);
+   if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+   {
+      return false;
    }
 
-   const ExtruderData& oldExtruder = mPrefs.extruderList[lastExtruder];
-   const ExtruderData& newExtruder = mPrefs.extruderList[currentExtruder];
+   file.write("; Layer index of \'");
+   file.write(QFileInfo(fileName).fileName().toAscii());
+   file.write("\' written by LocheGSplicer ");
+   file.write(VERSION.toAscii());
+   file.write("\n; Offsets count bytes of gcode text, before any compression.\n");
 
-   // Start by retracting the old extruder if necessary.
-   if (oldExtruder.retraction > 0)
+   // A shard also notes the extruders it expects and leaves, for merging.
+   if (isShard && !mLayerStates.empty())
+   {
+      QByteArray line = "Shard: " + QByteArray::number(mLayerStates.front().layer);
+      line += "-" + QByteArray::number(mLayerStates.back().layer);
+      line += " Enter: " + QByteArray::number(mShardEnteringExtruder);
+      line += " Leave: " + QByteArray::number(mShardLeavingExtruder);
+      line += " Total: " + QByteArray::number(mShardLayerCount);
+      line += "\n";
+      file.write(line);
+   }
+
+   int layerCount = (int)mLayerStates.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      const SpliceLayerState& state = mLayerStates[layerIndex];
+
+      QByteArray line = "Layer: " + QByteArray::number(state.layer);
+      line += " Offset: " + QByteArray::number(state.offset);
+      line += " Height: ";
+      appendFixed(line, state.height, Z);
+      line += " Tool: " + QByteArray::number(state.extruder);
+      line += " PosX: ";
+      appendFixed(line, state.pos[X], X);
+      line += " PosY: ";
+      appendFixed(line, state.pos[Y], Y);
+      line += " PosZ: ";
+      appendFixed(line, state.pos[Z], Z);
+      line += " Feed: " + QByteArray::number(state.feedRate);
+      line += " Fan: " + QByteArray::number(state.fanSpeed);
+      if (layerIndex < (int)mLayerTimes.size())
+      {
+         line += " Time: " + QByteArray::number(mLayerTimes[layerIndex], 'f', 2);
+      }
+      line += " Temps: ";
+
+      int temperatureCount = (int)state.temperatures.size();
+      for (int extruderIndex = 0; extruderIndex < temperatureCount; ++extruderIndex)
+      {
+         if (extruderIndex > 0) line += ",";
+         line += QByteArray::number(state.temperatures[extruderIndex]);
+      }
+
+      line += "\n";
+      file.write(line);
+   }
+
+   file.close();
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+std::vector<qint64> GCodeSplicer::getLayerOffsets() const
+{
+   std::vector<qint64> offsets;
+   offsets.reserve(mLayerStates.size());
+
+   int layerCount = (int)mLayerStates.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      offsets.push_back(mLayerStates[layerIndex].offset);
+   }
+   return offsets;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::buildResumeHeader(GCodeEmitter& emitter, const SpliceLayerState& state, int layer)
+{
+   emitter.addMetadata(METADATA_FILE, "Producer", "LocheGSplicer " + VERSION);
+   emitter.addMetadata(METADATA_PRINTER, "extruder_count", QString::number((int)mPrefs.extruderList.size()));
+   emitter.addMetadata(METADATA_PRINT, "resumed_from_layer", QString::number(layer));
+
+   emitter.write("; Resumed from layer ");
+   emitter.write(QString::number(layer).toAscii());
+   emitter.write(" using LocheGSplicer ");
+   emitter.write(VERSION.toAscii());
+   emitter.write("\n");
+
+   emitter.write("G21");
+   if (mPrefs.exportComments) emitter.write("; Set units to millimeters");
+   emitter.write("\n");
+
+   // We move back into place with absolute coordinates before
+   // switching to the mode the rest of the file uses.
+   emitter.write("G90");
+   if (mPrefs.exportComments) emitter.write("; Use absolute coordinates");
+   emitter.write("\n");
+
+   // The nozzle is most likely still resting on the failed print, so we
+   // lift off of it before heating up or moving anywhere.
+   emitter.write("G91");
+   if (mPrefs.exportComments) emitter.write("; Use relative coordinates");
+   emitter.write("\n");
+
+   emitter.write("G1 Z" + QByteArray::number(RESUME_Z_LIFT));
+   if (mPrefs.exportComments) emitter.write("; Lift off of the print");
+   emitter.write("\n");
+
+   emitter.write("G90");
+   if (mPrefs.exportComments) emitter.write("; Use absolute coordinates");
+   emitter.write("\n");
+
+   if (mPrefs.exportAbsoluteEMode)
+   {
+      emitter.write("M82");
+      if (mPrefs.exportComments) emitter.write("; Use absolute E coordinates");
+   }
+   else
+   {
+      emitter.write("M83");
+      if (mPrefs.exportComments) emitter.write("; Use relative E coordinates");
+   }
+   emitter.write("\n");
+
+   // Bring every extruder back to its temperature, any we did not know
+   // are set to idle, and finish with the one we resume printing with.
+   int extruderCount = (int)mPrefs.extruderList.size();
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+   {
+      if (extruderIndex == state.extruder)
+      {
+         continue;
+      }
+
+      double temperature = mPrefs.extruderList[extruderIndex].idleTemp;
+      if (extruderIndex < (int)state.temperatures.size() && state.temperatures[extruderIndex] >= 0.0)
+      {
+         temperature = state.temperatures[extruderIndex];
+      }
+
+      emitter.write("T");
+      emitter.write(QString::number(extruderIndex).toAscii());
+      emitter.write("\n");
+
+      emitter.write("M104 S");
+      emitter.write(QString::number(temperature).toAscii());
+      emitter.write("\n");
+   }
+
+   if (state.extruder >= 0 && state.extruder < extruderCount)
+   {
+      const ExtruderData& extruder = mPrefs.extruderList[state.extruder];
+
+      double temperature = extruder.printTemp;
+      if (state.extruder < (int)state.temperatures.size() && state.temperatures[state.extruder] >= 0.0)
+      {
+         temperature = state.temperatures[state.extruder];
+      }
+
+      emitter.write("T");
+      emitter.write(QString::number(state.extruder).toAscii());
+      emitter.write("\n");
+
+      emitter.write("M109 S");
+      emitter.write(QString::number(temperature).toAscii());
+      if (mPrefs.exportComments) emitter.write("; Wait for the extruder to heat up");
+      emitter.write("\n");
+
+      if (state.fanSpeed > 0.0)
+      {
+         emitter.write("M106 S");
+         emitter.write(QString::number(state.fanSpeed).toAscii());
+         emitter.write("\n");
+      }
+      else if (state.fanSpeed == 0.0)
+      {
+         emitter.write("M107\n");
+      }
+
+      // Z is never homed, it would run into the print.
+      emitter.write("G28 X0 Y0");
+      if (mPrefs.exportComments) emitter.write("; Home X and Y only");
+      emitter.write("\n");
+
+      // Travel back over everything that may have been printed, then
+      // come straight down into place.
+      qint32 highestHeight = state.height;
+      int stateCount = (int)mLayerStates.size();
+      for (int stateIndex = 0; stateIndex < stateCount; ++stateIndex)
+      {
+         highestHeight = qMax(highestHeight, mLayerStates[stateIndex].height);
+      }
+      qint64 clearZ = qMax(state.pos[Z], highestHeight + toFixed(RESUME_Z_CLEARANCE + extruder.offset[Z], Z));
+
+      QByteArray output = "G1 Z";
+      appendFixed(output, clearZ, Z);
+      output += " F" + QByteArray::number(extruder.travelSpeed * 60.0);
+      emitter.write(output);
+      if (mPrefs.exportComments) emitter.write("; Rise above the print");
+      emitter.write("\n");
+
+      output = "G1 X";
+      appendFixed(output, state.pos[X], X);
+      output += " Y";
+      appendFixed(output, state.pos[Y], Y);
+      emitter.write(output);
+      emitter.write("\n");
+
+      output = "G1 Z";
+      appendFixed(output, state.pos[Z], Z);
+      emitter.write(output);
+      if (mPrefs.exportComments) emitter.write("; Lower back into place");
+      emitter.write("\n");
+   }
+
+   // Moves that leave out their feed rate rely on the one we had.
+   if (state.feedRate >= 0.0)
+   {
+      emitter.write("G1 F");
+      emitter.write(QByteArray::number(state.feedRate));
+      emitter.write("\n");
+   }
+
+   if (!mPrefs.exportAbsoluteMode)
+   {
+      emitter.write("G91");
+      if (mPrefs.exportComments) emitter.write("; Use relative coordinates");
+      emitter.write("\n");
+   }
+}
+
+#ifdef BUILD_DEBUG_CONTROLS
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::debugBuildLayerData(const QString& fileName)
+{
+   if (mObjectList.empty())
+   {
+      mError = "No objects to export.";
+      return false;
+   }
+
+   QFile file;
+   file.setFileName(fileName);
+   if (!file.open(QIODevice::WriteOnly))
+   {
+      mError = "Could not open file \'" + fileName + "\' for writing.";
+      return false;
+   }
+
+   qint64 extrusionOffset = 0;
+   qint32 currentPos[AXIS_NUM] = {0,};
+
+   const GCodeObject* object = mObjectList[0];
+   if (object)
+   {
+      int levelCount = object->getLayerCount();
+      for (int levelIndex = 0; levelIndex < levelCount; ++levelIndex)
+      {
+         const LayerData& layer = object->getLayer(levelIndex);
+
+         file.write("; ++++++++++++++++++++++++++++++++++++++\n; Begin Layer ");
+         file.write(QString::number(levelIndex).toAscii());
+         file.write(" with height = ");
+         QByteArray height;
+         appendFixed(height, layer.height, Z);
+         file.write(height);
+         file.write("\n; ++++++++++++++++++++++++++++++++++++++\n");
+
+         if (levelIndex > 0)
+         {
+            file.write("G92 E0; Reset extruder position\n");
+            extrusionOffset = 0;
+         }
+
+         int codeCount = (int)layer.codes.size();
+         for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
+         {
+            const GCodeCommand& code = layer.codes[codeIndex];
+
+            if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
+               code.type == GCODE_EXTRUDER_MOVEMENT1)
+            {
+               QByteArray output;
+               if (code.type == GCODE_EXTRUDER_MOVEMENT0) output = "G0 ";
+               else                                       output = "G1 ";
+
+               bool hasChanged = false;
+               for (int axis = 0; axis < AXIS_NUM; ++axis)
+               {
+                  // Only export this axis if it has changed, or if we
+                  // have the preference to re-export duplicate axes.
+                  if (mPrefs.exportAllAxes ||
+                     (axis != E && code.axisValue[axis] != currentPos[axis]) ||
+                     (axis == E && code.axisValue[axis] != 0))
+                  {
+                     output += AXIS_NAME[axis];
+
+                     qint64 value = code.axisValue[axis];
+
+                     if (axis == E)
+                     {
+                        value += extrusionOffset;
+                        extrusionOffset = value;
+                     }
+                     appendFixed(output, value, axis);
+                     output += ' ';
+                     hasChanged = true;
+                  }
+
+                  currentPos[axis] = code.axisValue[axis];
+               }
+
+               if (code.hasF)
+               {
+                  output += "F" + QByteArray::number(code.f);
+                  hasChanged = true;
+               }
+
+               if (hasChanged)
+               {
+                  file.write(output);
+               }
+            }
+            else
+            {
+               file.write(code.command.toAscii());
+            }
+            file.write(code.comment.toAscii());
+            file.write("\n");
+         }
+      }
+   }
+	
+   return true;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+const QString& GCodeSplicer::getError() const
+{
+   return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::buildLayerList(std::vector<SpliceLayer>& layerList)
+{
+   TRACE_SPAN("GCodeSplicer::buildLayerList");
+
+   // We start with the extruder of our first object.
+   int lastExtruder = mObjectList[0]->getExtruder();
+   int extruderCount = (int)mPrefs.extruderList.size();
+   int objectCount = (int)mObjectList.size();
+
+   qint32 currentLayerHeight = 0;
+   while (getNextLayer(currentLayerHeight, currentLayerHeight))
+   {
+      layerList.push_back(SpliceLayer());
+      SpliceLayer& spliceLayer = layerList.back();
+      spliceLayer.height = currentLayerHeight;
+
+      // Iterate through each extruder.  We try to start with the last
+      // extruder we used previously in an attempt to reduce the total
+      // number of extruder changes done throughout the print.
+      int currentExtruder = lastExtruder;
+      for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
+      {
+         for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+         {
+            const GCodeObject* object = mObjectList[objectIndex];
+            if (object && object->getExtruder() == currentExtruder)
+            {
+               const LayerData* layer = NULL;
+               object->getLayerAtHeight(layer, currentLayerHeight);
+
+               // If we found some codes for this layer using our current extruder...
+               if (layer && !layer->codes.empty())
+               {
+                  SpliceBlock block;
+                  block.object = object;
+                  block.layer = layer;
+                  block.extruder = currentExtruder;
+                  block.height = currentLayerHeight;
+                  block.startTime = 0.0;
+                  block.duration = 0.0;
+                  block.startFeedRate = 0.0;
+                  for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+                  {
+                     block.startPos[axis] = 0.0;
+                  }
+                  spliceLayer.blocks.push_back(block);
+
+                  lastExtruder = currentExtruder;
+               }
+            }
+         }
+
+         // Iterate to the next extruder.
+         currentExtruder++;
+         if (currentExtruder >= extruderCount)
+         {
+            currentExtruder = 0;
+         }
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::orderExtruders(std::vector<SpliceLayer>& layerList)
+{
+   TRACE_SPAN("GCodeSplicer::orderExtruders");
+
+   int extruderCount = (int)mPrefs.extruderList.size();
+   int layerCount = (int)layerList.size();
+   if (extruderCount < 2 || layerCount == 0)
+   {
+      return;
+   }
+
+   // The cost of swapping between every pair of extruders.
+   std::vector<std::vector<double> > swapCosts(extruderCount, std::vector<double>(extruderCount, 0.0));
+   for (int fromIndex = 0; fromIndex < extruderCount; ++fromIndex)
+   {
+      for (int toIndex = 0; toIndex < extruderCount; ++toIndex)
+      {
+         if (fromIndex != toIndex)
+         {
+            swapCosts[fromIndex][toIndex] = getSwapTime(fromIndex, toIndex);
+         }
+      }
+   }
+
+   // For every layer and the extruder we end it with, the lowest total
+   // cost to get there, the extruder we ended the layer before with,
+   // and the order we visit the extruders of this layer in.
+   std::vector<std::vector<double> > totalCosts(layerCount, std::vector<double>(extruderCount, -1.0));
+   std::vector<std::vector<int> > lastEnds(layerCount, std::vector<int>(extruderCount, -1));
+   std::vector<std::vector<std::vector<int> > > orders(layerCount, std::vector<std::vector<int> >(extruderCount));
+
+   std::vector<double> startCosts(extruderCount, -1.0);
+   startCosts[mObjectList[0]->getExtruder()] = 0.0;
+
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      const std::vector<double>& previousCosts = layerIndex > 0? totalCosts[layerIndex - 1]: startCosts;
+
+      std::vector<bool> isUsed(extruderCount, false);
+      std::vector<int> order;
+      const std::vector<SpliceBlock>& blocks = layerList[layerIndex].blocks;
+      int blockCount = (int)blocks.size();
+      for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+      {
+         if (!isUsed[blocks[blockIndex].extruder])
+         {
+            isUsed[blocks[blockIndex].extruder] = true;
+            order.push_back(blocks[blockIndex].extruder);
+         }
+      }
+
+      // Layers with too many extruders to search, or nothing to print
+      // at all, keep the order they were built with.
+      bool canSearch = !order.empty() && (int)order.size() <= ORDER_MAX_EXTRUDERS;
+      if (canSearch)
+      {
+         std::sort(order.begin(), order.end());
+      }
+
+      do
+      {
+         double pathCost = 0.0;
+         int orderCount = (int)order.size();
+         for (int orderIndex = 1; orderIndex < orderCount; ++orderIndex)
+         {
+            pathCost += swapCosts[order[orderIndex - 1]][order[orderIndex]];
+         }
+
+         for (int lastEnd = 0; lastEnd < extruderCount; ++lastEnd)
+         {
+            if (previousCosts[lastEnd] < 0.0)
+            {
+               continue;
+            }
+
+            int first = order.empty()? lastEnd: order.front();
+            int end = order.empty()? lastEnd: order.back();
+            double cost = previousCosts[lastEnd] + swapCosts[lastEnd][first] + pathCost;
+
+            if (totalCosts[layerIndex][end] < 0.0 || cost < totalCosts[layerIndex][end])
+            {
+               totalCosts[layerIndex][end] = cost;
+               lastEnds[layerIndex][end] = lastEnd;
+               orders[layerIndex][end] = order;
+            }
+         }
+      } while (canSearch && std::next_permutation(order.begin(), order.end()));
+   }
+
+   // Find the cheapest extruder to finish the print with and
+   // follow it back to reorder the blocks of each layer.
+   int end = -1;
+   for (int extruderIndex = 0; extruderIndex < extruderCount; ++extruderIndex)
    {
-      file.write("G1 F");
-      file.write(QString::number(oldExtruder.retractSpeed * 60.0).toAscii());
-      file.write("\n");
+      double cost = totalCosts[layerCount - 1][extruderIndex];
+      if (cost >= 0.0 && (end == -1 || cost < totalCosts[layerCount - 1][end]))
+      {
+         end = extruderIndex;
+      }
+   }
 
-      file.write("G1 E");
-      file.write(QString::number(extrusionValue - oldExtruder.retraction * oldExtruder.flow).toAscii());
-      if (mPrefs.exportAbsoluteEMode)
+   for (int layerIndex = layerCount - 1; layerIndex >= 0 && end != -1; --layerIndex)
+   {
+      std::vector<SpliceBlock>& blocks = layerList[layerIndex].blocks;
+      std::vector<SpliceBlock> orderedBlocks;
+      orderedBlocks.reserve(blocks.size());
+
+      // Objects sharing an extruder stay in the order they were in.
+      const std::vector<int>& order = orders[layerIndex][end];
+      int orderCount = (int)order.size();
+      for (int orderIndex = 0; orderIndex < orderCount; ++orderIndex)
       {
-         extrusionValue -= oldExtruder.retraction * oldExtruder.flow;
+         int blockCount = (int)blocks.size();
+         for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+         {
+            if (blocks[blockIndex].extruder == order[orderIndex])
+            {
+               orderedBlocks.push_back(blocks[blockIndex]);
+            }
+         }
       }
-      if (mPrefs.exportComments) file.write("; Retract the old extruder");
-      file.write("\n");
+
+      blocks.swap(orderedBlocks);
+      end = lastEnds[layerIndex][end];
    }
+}
 
-   // TODO: Wipe excess from the old extruder if necessary.
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::scheduleLayers(std::vector<SpliceLayer>& layerList)
+{
+   TRACE_SPAN("GCodeSplicer::scheduleLayers");
 
-   // Set the old extruder to idle temperature if necessary.
-   if (oldExtruder.idleTemp > 0.0 && oldExtruder.idleTemp != oldExtruder.printTemp)
+   qint32 tolerance = (qint32)toFixed(mPrefs.swapZTolerance, Z);
+   if (tolerance <= 0 || layerList.empty() || layerList[0].blocks.empty())
    {
-      file.write("M104 S");
-      file.write(QString::number(oldExtruder.idleTemp).toAscii());
-      if (mPrefs.exportComments) file.write("; Set the old extruder to idle temp");
-      file.write("\n");
+      return;
    }
 
-   // Swap extruders.
-   file.write("T");
-   file.write(QString::number(currentExtruder).toAscii());
-   if (mPrefs.exportComments) file.write("; Perform the extruder swap");
-   file.write("\n");
+   // Queue up the blocks of each object, in the order they are printed,
+   // along with where they were printed so ties keep the extruder order.
+   int objectCount = (int)mObjectList.size();
+   std::vector<std::vector<SpliceBlock> > objectBlocks(objectCount);
+   std::vector<std::vector<int> > objectRanks(objectCount);
+   int blockTotal = 0;
 
-   // Set the new extruder to print temperature if necessary.
-   if (newExtruder.printTemp > 0.0 && newExtruder.idleTemp != newExtruder.printTemp)
+   int layerCount = (int)layerList.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      file.write("M109 S");
-      file.write(QString::number(newExtruder.printTemp).toAscii());
-      if (mPrefs.exportComments) file.write("; Set the new extruder to print temp");
-      file.write("\n");
+      const std::vector<SpliceBlock>& blocks = layerList[layerIndex].blocks;
+      int blockCount = (int)blocks.size();
+      for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+      {
+         for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+         {
+            if (mObjectList[objectIndex] == blocks[blockIndex].object)
+            {
+               objectBlocks[objectIndex].push_back(blocks[blockIndex]);
+               objectRanks[objectIndex].push_back(blockTotal);
+               blockTotal++;
+               break;
+            }
+         }
+      }
    }
 
-   // Prime the extruder if necessary.
-   if (newExtruder.primer * newExtruder.flow > 0 || newExtruder.retraction * newExtruder.flow > 0)
+   int currentExtruder = layerList[0].blocks[0].extruder;
+   std::vector<int> nextBlock(objectCount, 0);
+
+   layerList.clear();
+
+   for (int blockIndex = 0; blockIndex < blockTotal; ++blockIndex)
    {
-      double primer = newExtruder.primer;
-      if (newExtruder.primer <= 0.0)
+      // Find the lowest block still waiting on any other extruder, as
+      // our current extruder may not climb too far above it.
+      bool hasOther = false;
+      qint32 lowestOther = 0;
+      for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
       {
-         primer = newExtruder.retraction;
+         if (nextBlock[objectIndex] < (int)objectBlocks[objectIndex].size())
+         {
+            const SpliceBlock& block = objectBlocks[objectIndex][nextBlock[objectIndex]];
+            if (block.extruder != currentExtruder && (!hasOther || block.height < lowestOther))
+            {
+               lowestOther = block.height;
+               hasOther = true;
+            }
+         }
+      }
+
+      // Keep printing with our current extruder for as long as we can.
+      int bestObject = -1;
+      for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+      {
+         if (nextBlock[objectIndex] < (int)objectBlocks[objectIndex].size())
+         {
+            const SpliceBlock& block = objectBlocks[objectIndex][nextBlock[objectIndex]];
+            if (block.extruder == currentExtruder &&
+               (!hasOther || block.height <= lowestOther + tolerance) &&
+               (bestObject == -1 || isScheduledBefore(objectBlocks, objectRanks, nextBlock, objectIndex, bestObject)))
+            {
+               bestObject = objectIndex;
+            }
+         }
       }
 
-      primer *= newExtruder.flow;
+      // Otherwise swap to whoever has the lowest block, taking the
+      // extruders at the same height in the order they were chosen in.
+      if (bestObject == -1)
+      {
+         for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+         {
+            if (nextBlock[objectIndex] < (int)objectBlocks[objectIndex].size() &&
+               (bestObject == -1 || isScheduledBefore(objectBlocks, objectRanks, nextBlock, objectIndex, bestObject)))
+            {
+               bestObject = objectIndex;
+            }
+         }
+      }
 
-      file.write("G1 F");
-      file.write(QString::number(newExtruder.retractSpeed * 60.0).toAscii());
-      file.write("\n");
+      const SpliceBlock& block = objectBlocks[bestObject][nextBlock[bestObject]];
+      nextBlock[bestObject]++;
+      currentExtruder = block.extruder;
 
-      file.write("G1 E");
-      file.write(QString::number(extrusionValue + primer).toAscii());
-      if (mPrefs.exportAbsoluteEMode)
+      // Blocks in a row at the same height share a layer, a new one is
+      // only started when the height changes, up or back down.
+      if (layerList.empty() || layerList.back().height != block.height)
       {
-         extrusionValue += primer;
+         layerList.push_back(SpliceLayer());
+         layerList.back().height = block.height;
       }
-      if (mPrefs.exportComments) file.write("; Prime the new extruder");
-      file.write("\n");
+      layerList.back().blocks.push_back(block);
+   }
+
+   // Our layers no longer line up with the ones the extruders were
+   // ordered for, so order them again.
+   orderExtruders(layerList);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeSplicer::isScheduledBefore(const std::vector<std::vector<SpliceBlock> >& objectBlocks,
+                                     const std::vector<std::vector<int> >& objectRanks,
+                                     const std::vector<int>& nextBlock,
+                                     int objectIndex, int otherIndex) const
+{
+   qint32 height = objectBlocks[objectIndex][nextBlock[objectIndex]].height;
+   qint32 otherHeight = objectBlocks[otherIndex][nextBlock[otherIndex]].height;
+   if (height != otherHeight)
+   {
+      return height < otherHeight;
    }
 
-   file.write("G92 E0");
-   if (mPrefs.exportComments) file.write("; Reset extrusion");
-   file.write("\n");
-   extrusionValue = 0.0;
+   return objectRanks[objectIndex][nextBlock[objectIndex]] < objectRanks[otherIndex][nextBlock[otherIndex]];
+}
 
-   file.write("G1 F");
-   file.write(QString::number(oldExtruder.travelSpeed * 60.0).toAscii());
-   file.write("\n");
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::countSwaps(const std::vector<SpliceLayer>& layerList, double& swapTime) const
+{
+   int swapCount = 0;
+   int lastExtruder = mObjectList[0]->getExtruder();
+   swapTime = 0.0;
 
-   if (!mPrefs.swapCode.isEmpty())
+   int layerCount = (int)layerList.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      file.write(mPrefs.swapCode.toAscii());
-      file.write("\n");
+      const std::vector<SpliceBlock>& blocks = layerList[layerIndex].blocks;
+      int blockCount = (int)blocks.size();
+      for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+      {
+         int extruder = blocks[blockIndex].extruder;
+         if (lastExtruder != extruder)
+         {
+            swapTime += getSwapTime(lastExtruder, extruder);
+            swapCount++;
+         }
+         lastExtruder = extruder;
+      }
    }
-   return true;
+
+   return swapCount;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeSplicer::buildExtruderMovement(QFile& file, const GCodeCommand& code, int currentExtruder, double* offset, double* currentPos)
+void GCodeSplicer::optimizeTravel(std::vector<SpliceLayer>& layerList)
 {
-   QString output;
-   if (code.type == GCODE_EXTRUDER_MOVEMENT0) output = "G0 ";
-   else                                       output = "G1 ";
+   TRACE_SPAN("GCodeSplicer::optimizeTravel");
 
-   bool hasChanged = false;
-   for (int axis = 0; axis < AXIS_NUM; ++axis)
+   QPointF lastExit;
+   bool hasLastExit = false;
+
+   int layerCount = (int)layerList.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      // Only export this axis if it has changed, or if we
-      // have the preference to re-export duplicate axes.
-      if (mPrefs.exportAllAxes ||
-         (axis != E && code.axisValue[axis] != currentPos[axis]) ||
-         (axis == E && code.axisValue[axis] != 0.0))
+      std::vector<SpliceBlock>& blocks = layerList[layerIndex].blocks;
+      int blockCount = (int)blocks.size();
+
+      // Only blocks printed one after another with the same extruder
+      // can be reordered without adding any swaps.
+      int runStart = 0;
+      while (runStart < blockCount)
       {
-         output += QString(AXIS_NAME[axis]).toAscii();
+         int runEnd = runStart + 1;
+         while (runEnd < blockCount && blocks[runEnd].extruder == blocks[runStart].extruder)
+         {
+            runEnd++;
+         }
 
-         double value = code.axisValue[axis];
-         if (axis == E)
+         int stopCount = runEnd - runStart;
+         std::vector<TravelStop> stops(stopCount);
+         for (int stopIndex = 0; stopIndex < stopCount; ++stopIndex)
          {
-            // Offset the extrusion value by our extruders flow ratio.
-            value *= mPrefs.extruderList[currentExtruder].flow;
+            getBlockEnds(blocks[runStart + stopIndex], stops[stopIndex].entry, stops[stopIndex].exit);
          }
-         value += offset[axis];
-         if (axis == E && mPrefs.exportAbsoluteEMode)
+
+         std::vector<int> route;
+         route.reserve(stopCount);
+
+         if (stopCount > 1)
+         {
+            const QPointF* start = hasLastExit? &lastExit: NULL;
+
+            // Begin with a nearest neighbour route, keeping our first
+            // block when there is nowhere to start from.
+            std::vector<bool> isVisited(stopCount, false);
+            QPointF pos = hasLastExit? lastExit: stops[0].entry;
+            for (int routeIndex = 0; routeIndex < stopCount; ++routeIndex)
+            {
+               int nearest = -1;
+               double nearestDistance = 0.0;
+               for (int stopIndex = 0; stopIndex < stopCount; ++stopIndex)
+               {
+                  double distance = getDistance(pos, stops[stopIndex].entry);
+                  if (!isVisited[stopIndex] && (nearest == -1 || distance < nearestDistance))
+                  {
+                     nearest = stopIndex;
+                     nearestDistance = distance;
+                  }
+               }
+
+               isVisited[nearest] = true;
+               route.push_back(nearest);
+               pos = stops[nearest].exit;
+            }
+
+            // Then improve it with 2-opt, reversing the order we visit a
+            // span of blocks in while each one is still printed forward.
+            // Blocks enter and leave at different points, so the travel
+            // inside the span changes along with the two edges around it.
+            bool hasImproved = stopCount <= TRAVEL_MAX_STOPS;
+            for (int pass = 0; pass < TRAVEL_MAX_PASSES && hasImproved; ++pass)
+            {
+               hasImproved = false;
+               for (int first = start? 0: 1; first < stopCount - 1; ++first)
+               {
+                  const QPointF& before = first > 0? stops[route[first - 1]].exit: *start;
+
+                  // The travel inside the span as it is and reversed,
+                  // grown one block at a time as the span does.
+                  double inside = 0.0;
+                  double reversedInside = 0.0;
+                  for (int last = first + 1; last < stopCount; ++last)
+                  {
+                     inside += getDistance(stops[route[last - 1]].exit, stops[route[last]].entry);
+                     reversedInside += getDistance(stops[route[last]].exit, stops[route[last - 1]].entry);
+
+                     double length = getDistance(before, stops[route[first]].entry) + inside;
+                     double newLength = getDistance(before, stops[route[last]].entry) + reversedInside;
+                     if (last + 1 < stopCount)
+                     {
+                        const QPointF& after = stops[route[last + 1]].entry;
+                        length += getDistance(stops[route[last]].exit, after);
+                        newLength += getDistance(stops[route[first]].exit, after);
+                     }
+
+                     if (newLength < length - 0.001)
+                     {
+                        std::reverse(route.begin() + first, route.begin() + last + 1);
+                        std::swap(inside, reversedInside);
+                        hasImproved = true;
+                     }
+                  }
+               }
+            }
+
+            std::vector<SpliceBlock> runBlocks(blocks.begin() + runStart, blocks.begin() + runEnd);
+            for (int routeIndex = 0; routeIndex < stopCount; ++routeIndex)
+            {
+               blocks[runStart + routeIndex] = runBlocks[route[routeIndex]];
+            }
+         }
+         else
          {
-            offset[E] = value;
+            route.push_back(0);
          }
 
-         output += QString::number(value).toAscii() + " ";
-         hasChanged = true;
+         lastExit = stops[route.back()].exit;
+         hasLastExit = true;
+         runStart = runEnd;
       }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeSplicer::getTravelDistance(const std::vector<SpliceLayer>& layerList) const
+{
+   double distance = 0.0;
+   QPointF lastExit;
+   bool hasLastExit = false;
+
+   int layerCount = (int)layerList.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      const std::vector<SpliceBlock>& blocks = layerList[layerIndex].blocks;
+      int blockCount = (int)blocks.size();
+      for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+      {
+         QPointF entry;
+         QPointF exit;
+         getBlockEnds(blocks[blockIndex], entry, exit);
 
-      currentPos[axis] = code.axisValue[axis];
+         if (hasLastExit)
+         {
+            distance += getDistance(lastExit, entry);
+         }
+         lastExit = exit;
+         hasLastExit = true;
+      }
    }
 
-   if (code.hasF)
+   return distance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeSplicer::getBlockEnds(const SpliceBlock& block, QPointF& entry, QPointF& exit) const
+{
+   double offset[AXIS_NUM_NO_E];
+   getBlockOffset(block, offset);
+
+   const std::vector<GCodeCommand>& codes = block.layer->codes;
+   int codeCount = (int)codes.size();
+
+   // Homing is skipped when we splice, so every other
+   // command with a position is a move.
+   int firstIndex = 0;
+   while (firstIndex < codeCount &&
+      (!codes[firstIndex].hasAxis || codes[firstIndex].type == GCODE_HOME))
    {
-      output += "F" + QString::number(code.f).toAscii();
-      hasChanged = true;
+      firstIndex++;
    }
 
-   if (hasChanged)
+   int lastIndex = codeCount - 1;
+   while (lastIndex > firstIndex &&
+      (!codes[lastIndex].hasAxis || codes[lastIndex].type == GCODE_HOME))
    {
-      file.write(output.toAscii());
+      lastIndex--;
    }
 
-   return true;
+   if (firstIndex >= codeCount)
+   {
+      entry = QPointF(offset[X], offset[Y]);
+      exit = entry;
+      return;
+   }
+
+   entry = QPointF(fromFixed(codes[firstIndex].axisValue[X], X) + offset[X], fromFixed(codes[firstIndex].axisValue[Y], Y) + offset[Y]);
+   exit = QPointF(fromFixed(codes[lastIndex].axisValue[X], X) + offset[X], fromFixed(codes[lastIndex].axisValue[Y], Y) + offset[Y]);
 }
 
-#ifdef BUILD_DEBUG_CONTROLS
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeSplicer::debugBuildLayerData(const QString& fileName)
+void GCodeSplicer::schedulePreheats(std::vector<SpliceLayer>& layerList)
 {
-   if (mObjectList.empty())
+   TRACE_SPAN("GCodeSplicer::schedulePreheats");
+
+   // Flatten our layers so we can look back across them.
+   std::vector<SpliceBlock*> blockList;
+   int layerCount = (int)layerList.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      mError = "No objects to export.";
-      return false;
+      int blockCount = (int)layerList[layerIndex].blocks.size();
+      for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+      {
+         blockList.push_back(&layerList[layerIndex].blocks[blockIndex]);
+      }
    }
 
-   QFile file;
-   file.setFileName(fileName);
-   if (!file.open(QIODevice::WriteOnly))
+   int blockCount = (int)blockList.size();
+   int extruderCount = (int)mPrefs.extruderList.size();
+   if (blockCount == 0 || extruderCount == 0)
    {
-      mError = "Could not open file \'" + fileName + "\' for writing.";
-      return false;
+      return;
    }
 
-   double extrusionOffset = 0.0;
-   double currentPos[AXIS_NUM] = {0.0,};
+   // Estimate how long each block takes to print.
+   GCodeTimeEstimator estimator(mPrefs);
+   for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+   {
+      SpliceBlock& block = *blockList[blockIndex];
 
-   const GCodeObject* object = mObjectList[0];
-   if (object)
+      block.startFeedRate = estimator.getFeedRate();
+      for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+      {
+         block.startPos[axis] = estimator.getPosition()[axis];
+      }
+
+      double offset[AXIS_NUM_NO_E];
+      getBlockOffset(block, offset);
+
+      estimator.setSection(blockIndex);
+      int codeCount = (int)block.layer->codes.size();
+      for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
+      {
+         estimator.addCode(block.layer->codes[codeIndex], offset);
+      }
+   }
+
+   // Then when each one starts.
+   const std::vector<double>& blockTimes = estimator.getSectionTimes();
+   double time = 0.0;
+   for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
    {
-      int levelCount = object->getLayerCount();
-      for (int levelIndex = 0; levelIndex < levelCount; ++levelIndex)
+      SpliceBlock& block = *blockList[blockIndex];
+      block.startTime = time;
+      block.duration = blockIndex < (int)blockTimes.size()? blockTimes[blockIndex]: 0.0;
+      time += block.duration;
+   }
+
+   // The earliest block each extruder can start heating in, which
+   // is right after it was last swapped out and set to idle.
+   std::vector<int> earliestBlock(extruderCount, 0);
+
+   int lastExtruder = mObjectList[0]->getExtruder();
+   for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+   {
+      int extruder = blockList[blockIndex]->extruder;
+      if (extruder == lastExtruder)
       {
-         const LayerData& layer = object->getLayer(levelIndex);
+         continue;
+      }
 
-         file.write("; ++++++++++++++++++++++++++++++++++++++\n; Begin Layer ");
-         file.write(QString::number(levelIndex).toAscii());
-         file.write(" with height = ");
-         file.write(QString::number(layer.height).toAscii());
-         file.write("\n; ++++++++++++++++++++++++++++++++++++++\n");
+      double heatUpTime = getHeatUpTime(extruder);
+      int firstBlock = earliestBlock[extruder];
+      if (heatUpTime > 0.0 && firstBlock < blockIndex)
+      {
+         // Find the block that is printing when we need to start heating.
+         double startTime = qMax(blockList[blockIndex]->startTime - heatUpTime, blockList[firstBlock]->startTime);
 
-         if (levelIndex > 0)
+         int heatBlockIndex = blockIndex - 1;
+         while (heatBlockIndex > firstBlock && blockList[heatBlockIndex]->startTime > startTime)
          {
-            file.write("G92 E0; Reset extruder position\n");
-            extrusionOffset = 0.0;
+            heatBlockIndex--;
          }
 
-         int codeCount = (int)layer.codes.size();
+         // Then the code within it, by estimating the block again
+         // with every code counted on its own.
+         SpliceBlock& heatBlock = *blockList[heatBlockIndex];
+
+         double offset[AXIS_NUM_NO_E];
+         getBlockOffset(heatBlock, offset);
+
+         estimator.reset();
+         estimator.setPosition(heatBlock.startPos, heatBlock.startFeedRate);
+
+         int codeCount = (int)heatBlock.layer->codes.size();
          for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
          {
-            const GCodeCommand& code = layer.codes[codeIndex];
-
-            if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
-               code.type == GCODE_EXTRUDER_MOVEMENT1)
-            {
-               QString output;
-               if (code.type == GCODE_EXTRUDER_MOVEMENT0) output = "G0 ";
-               else                                       output = "G1 ";
+            estimator.setSection(codeIndex);
+            estimator.addCode(heatBlock.layer->codes[codeIndex], offset);
+         }
 
-               bool hasChanged = false;
-               for (int axis = 0; axis < AXIS_NUM; ++axis)
-               {
-                  // Only export this axis if it has changed, or if we
-                  // have the preference to re-export duplicate axes.
-                  if (mPrefs.exportAllAxes ||
-                     (axis != E && code.axisValue[axis] != currentPos[axis]) ||
-                     (axis == E && code.axisValue[axis] != 0.0))
-                  {
-                     output += QString(AXIS_NAME[axis]).toAscii();
+         const std::vector<double>& codeTimes = estimator.getSectionTimes();
+         double blockTime = startTime - heatBlock.startTime;
+         double elapsed = 0.0;
+         int codeIndex = 0;
+         while (codeIndex < codeCount - 1 && codeIndex < (int)codeTimes.size() && elapsed < blockTime)
+         {
+            elapsed += codeTimes[codeIndex];
+            codeIndex++;
+         }
 
-                     double value = code.axisValue[axis];
+         // Keep our preheats ordered by where they are written.
+         SplicePreheat preheat;
+         preheat.codeIndex = codeIndex;
+         preheat.extruder = extruder;
 
-                     if (axis == E)
-                     {
-                        value += extrusionOffset;
-                        extrusionOffset = value;
-                     }
-                     output += QString::number(value).toAscii() + " ";
-                     hasChanged = true;
-                  }
+         std::vector<SplicePreheat>::iterator insertPos = heatBlock.preheats.begin();
+         while (insertPos != heatBlock.preheats.end() && insertPos->codeIndex <= codeIndex)
+         {
+            ++insertPos;
+         }
+         heatBlock.preheats.insert(insertPos, preheat);
+      }
 
-                  currentPos[axis] = code.axisValue[axis];
-               }
+      earliestBlock[lastExtruder] = blockIndex;
+      lastExtruder = extruder;
+   }
+}
 
-               if (code.hasF)
-               {
-                  output += "F" + QString::number(code.f).toAscii();
-                  hasChanged = true;
-               }
+////////////////////////////////////////////////////////////////////////////////
+int GCodeSplicer::getLayerEntryState(const std::vector<SpliceLayer>& layerList, int layerIndex, qint64* pos) const
+{
+   // Search back for the last block before the layer and the last move
+   // written, which may be in an earlier block than that.
+   int extruder = -1;
+   for (int prevIndex = layerIndex - 1; prevIndex >= 0; --prevIndex)
+   {
+      const std::vector<SpliceBlock>& blocks = layerList[prevIndex].blocks;
+      for (int blockIndex = (int)blocks.size() - 1; blockIndex >= 0; --blockIndex)
+      {
+         const SpliceBlock& block = blocks[blockIndex];
+         if (extruder == -1)
+         {
+            extruder = block.extruder;
+         }
 
-               if (hasChanged)
+         const std::vector<GCodeCommand>& codes = block.layer->codes;
+         for (int codeIndex = (int)codes.size() - 1; codeIndex >= 0; --codeIndex)
+         {
+            const GCodeCommand& code = codes[codeIndex];
+            if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
+               code.type == GCODE_EXTRUDER_MOVEMENT1 ||
+               code.type == GCODE_CW_ARC ||
+               code.type == GCODE_CCW_ARC)
+            {
+               for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
                {
-                  file.write(output.toAscii());
+                  pos[axis] = code.axisValue[axis] + toFixed(block.object->getOffsetPos()[axis] + mPrefs.extruderList[block.extruder].offset[axis], axis);
                }
+               return extruder;
             }
-            else
-            {
-               file.write(code.command.toAscii());
-            }
-            file.write(code.comment.toAscii());
-            file.write("\n");
          }
       }
    }
-	
-   return true;
+
+   if (extruder == -1)
+   {
+      extruder = mObjectList[0]->getExtruder();
+   }
+   return extruder;
 }
-#endif
 
 ////////////////////////////////////////////////////////////////////////////////
-const QString& GCodeSplicer::getError() const
+void GCodeSplicer::getBlockOffset(const SpliceBlock& block, double* offset) const
 {
-   return mError;
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      offset[axis] = block.object->getOffsetPos()[axis] + mPrefs.extruderList[block.extruder].offset[axis];
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-int GCodeSplicer::getTotalLayerCount()
+double GCodeSplicer::getSwapTime(int lastExtruder, int currentExtruder) const
 {
-   int layerCount = 0;
-   double height = 0.0;
+   const ExtruderData& oldExtruder = mPrefs.extruderList[lastExtruder];
+   const ExtruderData& newExtruder = mPrefs.extruderList[currentExtruder];
+
+   double time = 0.0;
+   if (oldExtruder.retraction > 0.0 && oldExtruder.retractSpeed > 0.0)
+   {
+      time += oldExtruder.retraction * oldExtruder.flow / oldExtruder.retractSpeed;
+   }
+
+   double primer = newExtruder.primer > 0.0? newExtruder.primer: newExtruder.retraction;
+   if (primer > 0.0 && newExtruder.retractSpeed > 0.0)
+   {
+      time += primer * newExtruder.flow / newExtruder.retractSpeed;
+   }
+
+   // Heating is only hidden by a preheat when there is time for it,
+   // so we count it in full.
+   time += getHeatUpTime(currentExtruder);
 
-   while(getNextLayer(height, height))
+   // Then the travel to bring the new nozzle to where the old one was.
+   if (oldExtruder.travelSpeed > 0.0)
    {
-      layerCount++;
+      double deltaX = newExtruder.offset[X] - oldExtruder.offset[X];
+      double deltaY = newExtruder.offset[Y] - oldExtruder.offset[Y];
+      time += sqrt(deltaX * deltaX + deltaY * deltaY) / oldExtruder.travelSpeed;
    }
+   return time;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeSplicer::getHeatUpTime(int extruder) const
+{
+   const ExtruderData& data = mPrefs.extruderList[extruder];
 
-   return layerCount;
+   // Extruders are only cooled down when they have an idle temperature.
+   if (data.heatUpRate <= 0.0 ||
+      data.idleTemp <= 0.0 ||
+      data.printTemp <= data.idleTemp)
+   {
+      return 0.0;
+   }
+
+   return (data.printTemp - data.idleTemp) / data.heatUpRate;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool GCodeSplicer::getNextLayer(double height, double& outHeight)
+bool GCodeSplicer::getNextLayer(qint32 height, qint32& outHeight)
 {
-   double lowestHeight = 0.0;
+   TRACE_SPAN("GCodeSplicer::getNextLayer");
+
+   qint32 lowestHeight = 0;
 
    // Determine the next layer by getting the next
    // highest layer between all of the objects.
@@ -711,15 +2838,16 @@ bool GCodeSplicer::getNextLayer(double height, double& outHeight)
          const LayerData* data = NULL;
          if (object->getLayerAboveHeight(data, height) && data)
          {
-            if (lowestHeight == 0.0 || lowestHeight > data->height + object->getOffsetPos()[Z])
+            qint32 layerHeight = data->height + (qint32)toFixed(object->getOffsetPos()[Z], Z);
+            if (lowestHeight == 0 || lowestHeight > layerHeight)
             {
-               lowestHeight = data->height + object->getOffsetPos()[Z];
+               lowestHeight = layerHeight;
             }
          }
       }
    }
 
-   if (lowestHeight > 0.0)
+   if (lowestHeight > 0)
    {
       outHeight = lowestHeight;
       return true;
@@ -0,0 +1,844 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <GCodeTimeEstimator.h>
+#include <GCodeParser.h>
+#include <Trace.h>
+
+#include <QStringList>
+
+#include <math.h>
+
+// Printer defaults, used until the gcode sets its own limits.
+const static double DEFAULT_MAX_FEED_RATE[AXIS_NUM]     = {500.0, 500.0, 5.0, 25.0};       // mm/sec
+const static double DEFAULT_MAX_ACCELERATION[AXIS_NUM]  = {9000.0, 9000.0, 100.0, 10000.0}; // mm/sec^2
+const static double DEFAULT_JERK[AXIS_NUM]              = {20.0, 20.0, 0.4, 5.0};          // mm/sec
+const static double DEFAULT_ACCELERATION                = 3000.0;   // mm/sec^2
+const static double DEFAULT_FEED_RATE                   = 3000.0;   // mm/min
+const static double AMBIENT_TEMPERATURE                 = 20.0;
+
+// The number of movements the planner looks ahead, as with the firmware.
+const static int PLAN_LOOKAHEAD = 16;
+
+// Movements never slow down below this speed, in mm/sec.
+const static double MINIMUM_PLANNER_SPEED = 0.05;
+
+// Arcs are followed in segments of this length, in mm, as with the firmware.
+const static double ARC_SEGMENT_LENGTH = 1.0;
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Retrieves the value of a parameter from a command, such as S from "M104 S200".
+ */
+static bool getCommandValue(const QString& command, QChar letter, double& outValue)
+{
+   QStringList tokens = command.split(' ', QString::SkipEmptyParts);
+
+   // Our first token is the command itself.
+   for (int index = 1; index < tokens.size(); ++index)
+   {
+      const QString& token = tokens[index];
+      if (token.length() > 1 && token[0].toUpper() == letter)
+      {
+         bool ok = false;
+         double value = token.mid(1).toDouble(&ok);
+         if (ok)
+         {
+            outValue = value;
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Retrieves the time taken by a movement that accelerates from its entry
+ * speed up to its nominal speed and then decelerates to its exit speed.
+ */
+static double getTrapezoidTime(double distance, double acceleration, double nominalSpeed, double entrySpeed, double exitSpeed)
+{
+   if (acceleration <= 0.0)
+   {
+      return distance / nominalSpeed;
+   }
+
+   double accelDistance = (nominalSpeed * nominalSpeed - entrySpeed * entrySpeed) / (2.0 * acceleration);
+   double decelDistance = (nominalSpeed * nominalSpeed - exitSpeed * exitSpeed) / (2.0 * acceleration);
+
+   if (accelDistance + decelDistance <= distance)
+   {
+      return (nominalSpeed - entrySpeed) / acceleration +
+         (nominalSpeed - exitSpeed) / acceleration +
+         (distance - accelDistance - decelDistance) / nominalSpeed;
+   }
+
+   // Too short to ever reach our nominal speed, so we
+   // start slowing down as soon as we reach our peak.
+   double peakSpeed = sqrt((2.0 * acceleration * distance + entrySpeed * entrySpeed + exitSpeed * exitSpeed) / 2.0);
+   return (peakSpeed - entrySpeed) / acceleration + (peakSpeed - exitSpeed) / acceleration;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeTimeEstimator::GCodeTimeEstimator(const PreferenceData& prefs)
+   : mPrefs(prefs)
+{
+   reset();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+GCodeTimeEstimator::~GCodeTimeEstimator()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::reset()
+{
+   for (int axis = 0; axis < AXIS_NUM; ++axis)
+   {
+      mMaxFeedRate[axis] = DEFAULT_MAX_FEED_RATE[axis];
+      mMaxAcceleration[axis] = DEFAULT_MAX_ACCELERATION[axis];
+      mJerk[axis] = DEFAULT_JERK[axis];
+      mLastDirection[axis] = 0.0;
+   }
+   mPrintAcceleration = DEFAULT_ACCELERATION;
+   mRetractAcceleration = DEFAULT_ACCELERATION;
+   mTravelAcceleration = DEFAULT_ACCELERATION;
+
+   // Until the gcode gives us a junction deviation, we use jerk.
+   mJunctionDeviation = 0.0;
+
+   mPlanQueue.clear();
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      mPosition[axis] = 0.0;
+   }
+   mFeedRate = DEFAULT_FEED_RATE;
+   mExtruder = 0;
+   mLastNominalSpeed = 0.0;
+
+   int extruderCount = (int)mPrefs.extruderList.size();
+   mTemperature.assign(extruderCount, AMBIENT_TEMPERATURE);
+   mTargetTemperature.assign(extruderCount, AMBIENT_TEMPERATURE);
+   mTemperatureTime.assign(extruderCount, 0.0);
+
+   mSection = 0;
+   mTotalTime = 0.0;
+   mSectionTimes.clear();
+   mError.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::setSection(int section)
+{
+   mSection = qMax(0, section);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::setPosition(const double* position, double feedRate)
+{
+   flush();
+
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      mPosition[axis] = position[axis];
+   }
+   mFeedRate = feedRate;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const double* GCodeTimeEstimator::getPosition() const
+{
+   return mPosition;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeTimeEstimator::getFeedRate() const
+{
+   return mFeedRate;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::addCode(const GCodeCommand& code, const double* offset)
+{
+   if (code.type == GCODE_EXTRUDER_MOVEMENT0 ||
+       code.type == GCODE_EXTRUDER_MOVEMENT1 ||
+       code.type == GCODE_CW_ARC ||
+       code.type == GCODE_CCW_ARC)
+   {
+      if (code.hasF)
+      {
+         mFeedRate = code.f;
+      }
+
+      if (code.hasAxis)
+      {
+         double target[AXIS_NUM_NO_E];
+         for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+         {
+            target[axis] = fromFixed(code.axisValue[axis], axis) + (offset? offset[axis]: 0.0);
+         }
+
+         if (code.type == GCODE_CW_ARC || code.type == GCODE_CCW_ARC)
+         {
+            double center[AXIS_NUM_NO_E] = {mPosition[X] + fromFixed(code.arcOffset[X], X), mPosition[Y] + fromFixed(code.arcOffset[Y], Y), mPosition[Z]};
+            addArc(target, center, code.type == GCODE_CW_ARC, fromFixed(code.axisValue[E], E), mFeedRate);
+         }
+         else
+         {
+            addMove(target, fromFixed(code.axisValue[E], E), mFeedRate);
+         }
+      }
+   }
+   else if (code.type == GCODE_HOME)
+   {
+      // Homing waits for everything before it and its own
+      // time depends too much on the printer to estimate.
+      flush();
+      for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+      {
+         mPosition[axis] = fromFixed(code.axisValue[axis], axis) + (offset? offset[axis]: 0.0);
+      }
+   }
+   else
+   {
+      applyCommand(code.type, code.command);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::addArc(const double* target, const double* center, bool clockwise, double extrusion, double feedRate)
+{
+   double start[AXIS_NUM_NO_E];
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      start[axis] = mPosition[axis];
+   }
+
+   double radius = sqrt((start[X] - center[X]) * (start[X] - center[X]) + (start[Y] - center[Y]) * (start[Y] - center[Y]));
+   double startAngle = atan2(start[Y] - center[Y], start[X] - center[X]);
+   double sweep = atan2(target[Y] - center[Y], target[X] - center[X]) - startAngle;
+
+   // An arc that ends where it starts is a full circle.
+   if (clockwise && sweep >= 0.0)
+   {
+      sweep -= 2.0 * M_PI;
+   }
+   else if (!clockwise && sweep <= 0.0)
+   {
+      sweep += 2.0 * M_PI;
+   }
+
+   int segmentCount = qMax(1, (int)ceil(fabs(sweep) * radius / ARC_SEGMENT_LENGTH));
+   for (int segmentIndex = 1; segmentIndex < segmentCount; ++segmentIndex)
+   {
+      double angle = startAngle + sweep * segmentIndex / segmentCount;
+
+      double point[AXIS_NUM_NO_E];
+      point[X] = center[X] + radius * cos(angle);
+      point[Y] = center[Y] + radius * sin(angle);
+      point[Z] = start[Z] + (target[Z] - start[Z]) * segmentIndex / segmentCount;
+      addMove(point, extrusion / segmentCount, feedRate);
+   }
+
+   addMove(target, extrusion / segmentCount, feedRate);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::addMove(const double* target, double extrusion, double feedRate)
+{
+   double delta[AXIS_NUM] = {0.0,};
+   double distance = 0.0;
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      delta[axis] = target[axis] - mPosition[axis];
+      distance += delta[axis] * delta[axis];
+      mPosition[axis] = target[axis];
+   }
+   distance = sqrt(distance);
+   delta[E] = extrusion;
+
+   double acceleration = extrusion > 0.0? mPrintAcceleration: mTravelAcceleration;
+
+   // Moves that only extrude or retract travel the length of the filament.
+   if (distance < 0.000001)
+   {
+      distance = fabs(extrusion);
+      acceleration = mRetractAcceleration;
+      if (distance < 0.000001)
+      {
+         return;
+      }
+
+      for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+      {
+         delta[axis] = 0.0;
+      }
+   }
+
+   double speed = feedRate / 60.0;
+   if (speed <= 0.0)
+   {
+      return;
+   }
+
+   // Every axis has its own limits, which
+   // apply to its share of the movement.
+   double direction[AXIS_NUM];
+   for (int axis = 0; axis < AXIS_NUM; ++axis)
+   {
+      direction[axis] = delta[axis] / distance;
+
+      double share = fabs(direction[axis]);
+      if (share > 0.0)
+      {
+         speed = qMin(speed, mMaxFeedRate[axis] / share);
+         acceleration = qMin(acceleration, mMaxAcceleration[axis] / share);
+      }
+   }
+
+   // Find how fast we can take the corner from our previous movement.
+   double junctionSpeed = speed;
+   if (mLastNominalSpeed > 0.0)
+   {
+      junctionSpeed = qMin(junctionSpeed, mLastNominalSpeed);
+   }
+
+   if (mJunctionDeviation > 0.0)
+   {
+      if (mLastNominalSpeed <= 0.0)
+      {
+         junctionSpeed = MINIMUM_PLANNER_SPEED;
+      }
+      else
+      {
+         double cosTheta = 0.0;
+         for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+         {
+            cosTheta -= direction[axis] * mLastDirection[axis];
+         }
+
+         // Anything but a straight line slows down by how sharp the corner is.
+         if (cosTheta > -0.999999)
+         {
+            double sinHalfTheta = sqrt(0.5 * (1.0 - qMin(cosTheta, 0.999999)));
+            junctionSpeed = qMin(junctionSpeed,
+               sqrt(acceleration * mJunctionDeviation * sinHalfTheta / (1.0 - sinHalfTheta)));
+         }
+      }
+   }
+   else
+   {
+      // With jerk, no axis may instantly change its speed by more than its jerk.
+      for (int axis = 0; axis < AXIS_NUM; ++axis)
+      {
+         double change = fabs(direction[axis] - mLastDirection[axis]);
+         if (change * junctionSpeed > mJerk[axis])
+         {
+            junctionSpeed = mJerk[axis] / change;
+         }
+      }
+   }
+
+   PlanBlock block;
+   block.distance = distance;
+   block.acceleration = acceleration;
+   block.nominalSpeed = speed;
+   block.maxEntrySpeed = qMax(junctionSpeed, MINIMUM_PLANNER_SPEED);
+   block.entrySpeed = block.maxEntrySpeed;
+   block.section = mSection;
+   mPlanQueue.push_back(block);
+
+   for (int axis = 0; axis < AXIS_NUM; ++axis)
+   {
+      mLastDirection[axis] = direction[axis];
+   }
+   mLastNominalSpeed = speed;
+
+   if ((int)mPlanQueue.size() > PLAN_LOOKAHEAD)
+   {
+      recalculate();
+      retireBlock();
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::addWait(double seconds)
+{
+   flush();
+   addTime(mSection, seconds);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::setTemperature(int extruder, double temp, bool wait)
+{
+   if (extruder < 0 || extruder >= (int)mTemperature.size())
+   {
+      return;
+   }
+
+   updateTemperature(extruder);
+   mTargetTemperature[extruder] = temp;
+
+   if (wait)
+   {
+      flush();
+      updateTemperature(extruder);
+
+      double heatUpRate = mPrefs.extruderList[extruder].heatUpRate;
+      if (heatUpRate > 0.0 && temp > mTemperature[extruder])
+      {
+         addTime(mSection, (temp - mTemperature[extruder]) / heatUpRate);
+      }
+
+      mTemperature[extruder] = temp;
+      mTemperatureTime[extruder] = mTotalTime;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool GCodeTimeEstimator::estimateFile(const QString& fileName, const std::vector<qint64>* sectionOffsets)
+{
+   TRACE_SPAN("GCodeTimeEstimator::estimateFile");
+
+   reset();
+
+   GCodeParser parser;
+   if (!parser.loadFile(fileName))
+   {
+      mError = "Could not open file \'" + fileName + "\' for reading.";
+      return false;
+   }
+
+   bool absoluteMode = true;
+   bool absoluteEMode = true;
+   double coordConversion = 1.0;
+   double lastE = 0.0;
+   double layerZ = 0.0;
+   bool firstLayer = true;
+   int sectionCount = sectionOffsets? (int)sectionOffsets->size(): 0;
+
+   while (parser.parseNext())
+   {
+      // Anything before the first section is counted towards it.
+      while (mSection + 1 < sectionCount && parser.getLinePos() >= (*sectionOffsets)[mSection + 1])
+      {
+         setSection(mSection + 1);
+      }
+
+      QString line = parser.getLine().trimmed();
+      if (line.isEmpty())
+      {
+         continue;
+      }
+
+      if (line.startsWith('G') && parser.codeSeen("G"))
+      {
+         int type = 1000 + (int)parser.codeValueLong();
+
+         if (type == GCODE_EXTRUDER_MOVEMENT0 || type == GCODE_EXTRUDER_MOVEMENT1 ||
+            type == GCODE_CW_ARC || type == GCODE_CCW_ARC)
+         {
+            double target[AXIS_NUM_NO_E];
+            for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+            {
+               target[axis] = mPosition[axis];
+               if (parser.codeSeen(QString(AXIS_NAME[axis])))
+               {
+                  double value = parser.codeValueDouble() * coordConversion;
+                  target[axis] = absoluteMode? value: mPosition[axis] + value;
+               }
+            }
+
+            double extrusion = 0.0;
+            if (parser.codeSeen(QString(AXIS_NAME[E])))
+            {
+               double value = parser.codeValueDouble() * coordConversion;
+               extrusion = absoluteEMode? value - lastE: value;
+               lastE += extrusion;
+            }
+
+            if (parser.codeSeen("F"))
+            {
+               mFeedRate = parser.codeValueDouble() * coordConversion;
+            }
+
+            // A new layer begins with the first extrusion above the last one.
+            if (!sectionOffsets && extrusion > 0.0 && target[Z] > layerZ + 0.000001)
+            {
+               if (!firstLayer)
+               {
+                  setSection(mSection + 1);
+               }
+               firstLayer = false;
+               layerZ = target[Z];
+            }
+
+            if (type == GCODE_CW_ARC || type == GCODE_CCW_ARC)
+            {
+               // The center is always relative to where the arc starts.
+               double center[AXIS_NUM_NO_E] = {mPosition[X], mPosition[Y], mPosition[Z]};
+               if (parser.codeSeen("I")) center[X] += parser.codeValueDouble() * coordConversion;
+               if (parser.codeSeen("J")) center[Y] += parser.codeValueDouble() * coordConversion;
+
+               addArc(target, center, type == GCODE_CW_ARC, extrusion, mFeedRate);
+            }
+            else
+            {
+               addMove(target, extrusion, mFeedRate);
+            }
+         }
+         else if (type == GCODE_DWELL)
+         {
+            applyCommand(type, line);
+         }
+         else if (type == GCODE_HOME)
+         {
+            flush();
+
+            bool foundAny = false;
+            for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+            {
+               if (parser.codeSeen(QString(AXIS_NAME[axis])))
+               {
+                  mPosition[axis] = 0.0;
+                  foundAny = true;
+               }
+            }
+
+            if (!foundAny)
+            {
+               for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+               {
+                  mPosition[axis] = 0.0;
+               }
+            }
+         }
+         else if (type == GCODE_ABSOLUTE_COORDS)
+         {
+            absoluteMode = true;
+         }
+         else if (type == GCODE_RELATIVE_COORDS)
+         {
+            absoluteMode = false;
+         }
+         else if (type == GCODE_CURRENT_POSITION)
+         {
+            for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+            {
+               if (parser.codeSeen(QString(AXIS_NAME[axis])))
+               {
+                  mPosition[axis] = parser.codeValueDouble() * coordConversion;
+               }
+            }
+
+            if (parser.codeSeen(QString(AXIS_NAME[E])))
+            {
+               lastE = parser.codeValueDouble() * coordConversion;
+            }
+         }
+         else if (type == GCODE_INCHES_MODE)
+         {
+            coordConversion = 25.4;
+         }
+         else if (type == GCODE_MILLIMETERS_MODE)
+         {
+            coordConversion = 1.0;
+         }
+      }
+      else if (line.startsWith('M') && parser.codeSeen("M"))
+      {
+         int type = 2000 + (int)parser.codeValueLong();
+
+         if (type == MCODE_E_ABSOLUTE_COORDS)
+         {
+            absoluteEMode = true;
+         }
+         else if (type == MCODE_E_RELATIVE_COORDS)
+         {
+            absoluteEMode = false;
+         }
+         else
+         {
+            applyCommand(type, line);
+         }
+      }
+      else if (line.startsWith('T') && parser.codeSeen("T"))
+      {
+         mExtruder = (int)parser.codeValueLong();
+      }
+   }
+
+   if (!parser.getError().isEmpty())
+   {
+      mError = parser.getError();
+      return false;
+   }
+
+   flush();
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+double GCodeTimeEstimator::getTotalTime()
+{
+   flush();
+   return mTotalTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const std::vector<double>& GCodeTimeEstimator::getSectionTimes()
+{
+   flush();
+   return mSectionTimes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const QString& GCodeTimeEstimator::getError() const
+{
+   return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+QString GCodeTimeEstimator::formatTime(double seconds)
+{
+   qint64 total = qRound64(seconds);
+   qint64 hours = total / 3600;
+   qint64 minutes = (total / 60) % 60;
+
+   if (hours > 0)
+   {
+      return QString("%1h %2m %3s").arg(hours).arg(minutes, 2, 10, QChar('0')).arg(total % 60, 2, 10, QChar('0'));
+   }
+   return QString("%1m %2s").arg(minutes).arg(total % 60, 2, 10, QChar('0'));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::applyCommand(int type, const QString& command)
+{
+   double value = 0.0;
+
+   // 4: Dwell, given in milliseconds or seconds.
+   if (type == GCODE_DWELL)
+   {
+      if (getCommandValue(command, 'P', value))
+      {
+         addWait(value / 1000.0);
+      }
+      else if (getCommandValue(command, 'S', value))
+      {
+         addWait(value);
+      }
+   }
+   // 104 & 109: Set extruder temp, with or without waiting.
+   else if (type == MCODE_SET_EXTRUDER_TEMP ||
+            type == MCODE_SET_EXTRUDER_TEMP_WAIT)
+   {
+      int extruder = mExtruder;
+      if (getCommandValue(command, 'T', value))
+      {
+         extruder = (int)value;
+      }
+
+      if (getCommandValue(command, 'S', value))
+      {
+         setTemperature(extruder, value, type == MCODE_SET_EXTRUDER_TEMP_WAIT);
+      }
+   }
+   // 201: Set max acceleration per axis.
+   else if (type == MCODE_SET_MAX_ACCEL_PRINT)
+   {
+      for (int axis = 0; axis < AXIS_NUM; ++axis)
+      {
+         if (getCommandValue(command, AXIS_NAME[axis], value) && value > 0.0)
+         {
+            mMaxAcceleration[axis] = value;
+         }
+      }
+   }
+   // 203: Set max feed rate per axis.
+   else if (type == MCODE_SET_MAX_FEEDRATE)
+   {
+      for (int axis = 0; axis < AXIS_NUM; ++axis)
+      {
+         if (getCommandValue(command, AXIS_NAME[axis], value) && value > 0.0)
+         {
+            mMaxFeedRate[axis] = value;
+         }
+      }
+   }
+   // 204: Set default acceleration.  S sets both printing and
+   // travel, while newer firmware splits them into P, R and T.
+   else if (type == MCODE_SET_DEFAULT_ACCEL)
+   {
+      if (getCommandValue(command, 'S', value) && value > 0.0)
+      {
+         mPrintAcceleration = value;
+         mTravelAcceleration = value;
+      }
+      if (getCommandValue(command, 'P', value) && value > 0.0)
+      {
+         mPrintAcceleration = value;
+      }
+      if (getCommandValue(command, 'R', value) && value > 0.0)
+      {
+         mRetractAcceleration = value;
+      }
+      if (getCommandValue(command, 'T', value) && value > 0.0)
+      {
+         mTravelAcceleration = value;
+      }
+   }
+   // 205: Set advanced settings, jerk per axis or junction deviation.
+   else if (type == MCODE_SET_MIN_TRAVEL)
+   {
+      // Older firmware only has a single jerk for both X and Y.
+      if (getCommandValue(command, 'X', value))
+      {
+         mJerk[X] = value;
+         mJerk[Y] = value;
+      }
+      if (getCommandValue(command, 'Y', value))
+      {
+         mJerk[Y] = value;
+      }
+      if (getCommandValue(command, 'Z', value))
+      {
+         mJerk[Z] = value;
+      }
+      if (getCommandValue(command, 'E', value))
+      {
+         mJerk[E] = value;
+      }
+      if (getCommandValue(command, 'J', value))
+      {
+         mJunctionDeviation = value;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::recalculate()
+{
+   int count = (int)mPlanQueue.size();
+   if (count == 0)
+   {
+      return;
+   }
+
+   // Working backwards from a stop, make sure every movement can slow
+   // down in time for the next.  Our first movement has already begun,
+   // so its entry speed can no longer change.
+   double nextEntrySpeed = 0.0;
+   for (int index = count - 1; index > 0; --index)
+   {
+      PlanBlock& block = mPlanQueue[index];
+      block.entrySpeed = qMin(block.maxEntrySpeed,
+         sqrt(nextEntrySpeed * nextEntrySpeed + 2.0 * block.acceleration * block.distance));
+      nextEntrySpeed = block.entrySpeed;
+   }
+
+   // Then working forwards, make sure every movement can speed up in time.
+   for (int index = 0; index < count - 1; ++index)
+   {
+      const PlanBlock& block = mPlanQueue[index];
+      PlanBlock& next = mPlanQueue[index + 1];
+
+      double maxExitSpeed = sqrt(block.entrySpeed * block.entrySpeed + 2.0 * block.acceleration * block.distance);
+      if (next.entrySpeed > maxExitSpeed)
+      {
+         next.entrySpeed = maxExitSpeed;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::retireBlock()
+{
+   if (mPlanQueue.empty())
+   {
+      return;
+   }
+
+   const PlanBlock& block = mPlanQueue.front();
+   double exitSpeed = mPlanQueue.size() > 1? mPlanQueue[1].entrySpeed: 0.0;
+
+   addTime(block.section, getTrapezoidTime(block.distance, block.acceleration,
+      block.nominalSpeed, qMin(block.entrySpeed, block.nominalSpeed), qMin(exitSpeed, block.nominalSpeed)));
+
+   mPlanQueue.pop_front();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::flush()
+{
+   if (mPlanQueue.empty())
+   {
+      return;
+   }
+
+   recalculate();
+   while (!mPlanQueue.empty())
+   {
+      retireBlock();
+   }
+
+   // Whatever comes next starts from a stop.
+   for (int axis = 0; axis < AXIS_NUM; ++axis)
+   {
+      mLastDirection[axis] = 0.0;
+   }
+   mLastNominalSpeed = 0.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::updateTemperature(int extruder)
+{
+   double heatUpRate = mPrefs.extruderList[extruder].heatUpRate;
+   double target = mTargetTemperature[extruder];
+   double& temp = mTemperature[extruder];
+
+   // Cooling down never holds anything up, so we only follow heating.
+   if (target <= temp || heatUpRate <= 0.0)
+   {
+      temp = target;
+   }
+   else
+   {
+      temp = qMin(target, temp + heatUpRate * (mTotalTime - mTemperatureTime[extruder]));
+   }
+   mTemperatureTime[extruder] = mTotalTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void GCodeTimeEstimator::addTime(int section, double seconds)
+{
+   mTotalTime += seconds;
+
+   if (section >= (int)mSectionTimes.size())
+   {
+      mSectionTimes.resize(section + 1, 0.0);
+   }
+   mSectionTimes[section] += seconds;
+}
+
+////////////////////////////////////////////////////////////////////////////////
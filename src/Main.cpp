@@ -19,13 +19,314 @@
 
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QStringList>
 
 #include <MainWindow.h>
+#include <GCodeArranger.h>
+#include <GCodeObject.h>
+#include <GCodeSplicer.h>
+#include <PreferencesDialog.h>
+#include <Trace.h>
+#include <VisualizerView.h>
+
+#include <stdio.h>
+
+// The name of each draw quality, as shown in the preferences.
+const static char* DRAW_QUALITY_NAME[DRAW_QUALITY_NUM] = {"Low", "Medium", "High"};
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Imports every given file and prints the memory each one uses, along
+ * with what it would use once drawn at each draw quality.
+ *
+ * @param[in]  files  The gcode files to import.
+ */
+int printMemoryReport(const QStringList& files)
+{
+   PreferenceData prefs;
+   PreferencesDialog::restoreLastPreferences(prefs);
+
+   MemoryUsage total;
+   MemoryUsage qualityTotals[DRAW_QUALITY_NUM];
+   int result = 0;
+
+   int fileCount = files.size();
+   for (int fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+   {
+      GCodeObject object(prefs);
+      if (!object.loadFile(files[fileIndex]))
+      {
+         fprintf(stderr, "Failed to load '%s': %s\n", files[fileIndex].toAscii().constData(), object.getError().toAscii().constData());
+         result = 1;
+         continue;
+      }
+
+      MemoryUsage usage;
+      object.getMemoryUsage(usage);
+      total += usage;
+
+      printf("%s\n%s\n", files[fileIndex].toAscii().constData(), usage.toString().toAscii().constData());
+
+      // Geometry is counted without a display, the low quality lines
+      // are always kept as well for drawing while the camera moves.
+      for (int quality = 0; quality < DRAW_QUALITY_NUM; ++quality)
+      {
+         MemoryUsage projected = usage;
+         VisualizerView::estimateGeometryUsage(*object.getData(), (DrawQuality)quality, prefs.layerSkipSize, prefs.useDisplayLists, projected);
+         if (quality != DRAW_QUALITY_LOW)
+         {
+            VisualizerView::estimateGeometryUsage(*object.getData(), DRAW_QUALITY_LOW, prefs.layerSkipSize, false, projected);
+         }
+         qualityTotals[quality] += projected;
+
+         printf("%s drawn at %s quality\n%s\n", files[fileIndex].toAscii().constData(),
+            DRAW_QUALITY_NAME[quality], projected.toString().toAscii().constData());
+      }
+   }
+
+   if (fileCount > 1)
+   {
+      printf("All Files\n%s\n", total.toString().toAscii().constData());
+
+      for (int quality = 0; quality < DRAW_QUALITY_NUM; ++quality)
+      {
+         printf("All Files drawn at %s quality\n%s\n", DRAW_QUALITY_NAME[quality], qualityTotals[quality].toString().toAscii().constData());
+      }
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Splices files, or a range of their layers as a shard, without the gui.
+ *
+ * @param[in]  args  The arguments following --splice, the output file,
+ *                   options and then the gcode files, each of which may
+ *                   end with @<extruder> to choose the extruder it prints with.
+ */
+int spliceFiles(const QStringList& args)
+{
+   PreferenceData prefs;
+   PreferencesDialog::restoreLastPreferences(prefs);
+
+   if (args.isEmpty())
+   {
+      fprintf(stderr, "Usage: --splice <output> [--layers <first>-<last>] [--enter-extruder <index>] [--arrange] <files...>\n");
+      return 1;
+   }
+
+   QString outputFile = args[0];
+   int firstLayer = 1;
+   int lastLayer = -1;
+   int enteringExtruder = -1;
+   bool arrange = false;
+   QStringList files;
+
+   for (int argIndex = 1; argIndex < args.size(); ++argIndex)
+   {
+      const QString& arg = args[argIndex];
+      bool hasValue = argIndex + 1 < args.size();
+
+      if (arg == "--layers" && hasValue)
+      {
+         // Either a single layer, or a range that may leave out its end.
+         QStringList range = args[++argIndex].split('-');
+         firstLayer = range[0].toInt();
+         lastLayer = range.size() > 1? (range[1].isEmpty()? -1: range[1].toInt()): firstLayer;
+      }
+      else if (arg == "--enter-extruder" && hasValue)
+      {
+         enteringExtruder = args[++argIndex].toInt();
+      }
+      else if (arg == "--arrange")
+      {
+         arrange = true;
+      }
+      else
+      {
+         files.append(arg);
+      }
+   }
+
+   if (files.isEmpty() || firstLayer < 1 || (lastLayer != -1 && lastLayer < firstLayer))
+   {
+      fprintf(stderr, "Usage: --splice <output> [--layers <first>-<last>] [--enter-extruder <index>] [--arrange] <files...>\n");
+      return 1;
+   }
+
+   int extruderCount = (int)prefs.extruderList.size();
+   std::vector<GCodeObject*> objects;
+   int result = 0;
+
+   for (int fileIndex = 0; fileIndex < files.size() && result == 0; ++fileIndex)
+   {
+      QString fileName = files[fileIndex];
+      int extruder = fileIndex % extruderCount;
+
+      int extruderPos = fileName.lastIndexOf('@');
+      if (extruderPos > -1)
+      {
+         extruder = qBound(0, fileName.mid(extruderPos + 1).toInt(), extruderCount - 1);
+         fileName = fileName.left(extruderPos);
+      }
+
+      GCodeObject* object = new GCodeObject(prefs);
+      objects.push_back(object);
+
+      if (!object->loadFile(fileName))
+      {
+         fprintf(stderr, "Failed to load '%s': %s\n", fileName.toAscii().constData(), object->getError().toAscii().constData());
+         result = 1;
+      }
+
+      object->setExtruder(extruder);
+   }
+
+   if (result == 0 && arrange)
+   {
+      GCodeArranger arranger(prefs);
+      for (int objectIndex = 0; objectIndex < (int)objects.size(); ++objectIndex)
+      {
+         arranger.addObject(objects[objectIndex]);
+      }
+
+      if (!arranger.arrange(prefs.arrangeClearance))
+      {
+         fprintf(stderr, "Failed to arrange: %s\n", arranger.getError().toAscii().constData());
+         result = 1;
+      }
+   }
+
+   if (result == 0)
+   {
+      GCodeSplicer splicer(prefs);
+      for (int objectIndex = 0; objectIndex < (int)objects.size(); ++objectIndex)
+      {
+         splicer.addObject(objects[objectIndex]);
+      }
+
+      splicer.setLayerRange(firstLayer, lastLayer);
+      splicer.setEnteringExtruder(enteringExtruder);
+
+      if (!splicer.build(outputFile, NULL))
+      {
+         fprintf(stderr, "Failed to splice '%s': %s\n", outputFile.toAscii().constData(), splicer.getError().toAscii().constData());
+         result = 1;
+      }
+   }
+
+   for (int objectIndex = 0; objectIndex < (int)objects.size(); ++objectIndex)
+   {
+      delete objects[objectIndex];
+   }
+
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Merges shards spliced with --splice and --layers into a single file.
+ *
+ * @param[in]  args  The arguments following --merge, the output file
+ *                   and then every shard in order.
+ */
+int mergeFiles(const QStringList& args)
+{
+   PreferenceData prefs;
+   PreferencesDialog::restoreLastPreferences(prefs);
+
+   if (args.size() < 2)
+   {
+      fprintf(stderr, "Usage: --merge <output> <shards...>\n");
+      return 1;
+   }
+
+   GCodeSplicer splicer(prefs);
+   if (!splicer.mergeShards(args.mid(1), args[0]))
+   {
+      fprintf(stderr, "Failed to merge '%s': %s\n", args[0].toAscii().constData(), splicer.getError().toAscii().constData());
+      return 1;
+   }
+
+   return 0;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 int main(int argc, char *argv[])
 {
-   QApplication app(argc, argv);
+   // Console commands run as a plain console application so no display is needed.
+   bool memoryReport = false;
+   bool console = false;
+   for (int argIndex = 1; argIndex < argc; ++argIndex)
+   {
+      QString arg = argv[argIndex];
+      if (arg == "--memory-report")
+      {
+         memoryReport = true;
+         console = true;
+      }
+      else if (arg == "--splice" || arg == "--merge")
+      {
+         console = true;
+      }
+   }
+
+   QApplication app(argc, argv, !console);
+
+   // Tracing is enabled by either the environment or the command line,
+   // the command line taking priority.
+   QString traceFile = QString::fromLocal8Bit(qgetenv("LOCHEGSPLICER_TRACE"));
+   QStringList args = app.arguments();
+   int traceArg = args.indexOf("--trace");
+   if (traceArg > -1 && traceArg + 1 < args.size())
+   {
+      traceFile = args[traceArg + 1];
+   }
+
+   if (!traceFile.isEmpty())
+   {
+      Trace::start(traceFile);
+   }
+
+   if (memoryReport)
+   {
+      QStringList files = args.mid(args.indexOf("--memory-report") + 1);
+      if (traceArg > -1)
+      {
+         files.removeAll("--trace");
+         files.removeAll(traceFile);
+      }
+
+      int result = printMemoryReport(files);
+      Trace::stop();
+      return result;
+   }
+
+   if (console)
+   {
+      QStringList commandArgs = args.mid(1);
+      if (traceArg > -1)
+      {
+         commandArgs.removeAll("--trace");
+         commandArgs.removeAll(traceFile);
+      }
+
+      int result = 0;
+      int spliceArg = commandArgs.indexOf("--splice");
+      if (spliceArg > -1)
+      {
+         result = spliceFiles(commandArgs.mid(spliceArg + 1));
+      }
+      else
+      {
+         result = mergeFiles(commandArgs.mid(commandArgs.indexOf("--merge") + 1));
+      }
+
+      Trace::stop();
+      return result;
+   }
+
    MainWindow window;
    window.resize(800, 600);
    int desktopArea = QApplication::desktop()->width() *
@@ -35,5 +336,8 @@ int main(int argc, char *argv[])
       window.show();
    else
       window.showMaximized();
-   return app.exec();
+
+   int result = app.exec();
+   Trace::stop();
+   return result;
 }
@@ -20,13 +20,18 @@
 
 #include <MainWindow.h>
 #include <VisualizerView.h>
+#include <GCodeArranger.h>
 #include <GCodeObject.h>
 #include <GCodeSplicer.h>
+#include <GCodeTimeEstimator.h>
 #include <PreferencesDialog.h>
 
 #include <QtGui>
 #include <QVariant>
 
+#include <algorithm>
+#include <math.h>
+
 
 ////////////////////////////////////////////////////////////////////////////////
 MainWindow::MainWindow()
@@ -38,10 +43,14 @@ MainWindow::MainWindow()
    , mObjectListWidget(NULL)
    , mAddFileButton(NULL)
    , mRemoveFileButton(NULL)
+   , mDuplicateButton(NULL)
+   , mMemoryButton(NULL)
    , mPlaterXPosSpin(NULL)
    , mPlaterYPosSpin(NULL)
    , mPlaterZPosSpin(NULL)
+   , mArrangeButton(NULL)
    , mSpliceButton(NULL)
+   , mResumeButton(NULL)
 #ifdef BUILD_DEBUG_CONTROLS
    , mDebugExportLayerButton(NULL)
 #endif
@@ -151,6 +160,7 @@ void MainWindow::onObjectSelectionChanged()
 
    // Remove button can only be used if there are any selected.
    mRemoveFileButton->setEnabled(anySelected);
+   mDuplicateButton->setEnabled(singleObject);
 
 #ifdef BUILD_DEBUG_CONTROLS
    // The debug export layer data button can only be used if there is a single item
@@ -167,7 +177,7 @@ void MainWindow::onAddPressed()
    QString lastDir = settings.value(LAST_IMPORT_FOLDER, "").toString();
 
    QFileDialog dlg;
-   QString fileName = dlg.getOpenFileName(this, "Open GCode File", lastDir, "GCODE (*.gcode);; All Files (*.*)");
+   QString fileName = dlg.getOpenFileName(this, "Open GCode File", lastDir, "GCODE (*.gcode *.gcode.gz *.bgcode);; All Files (*.*)");
    if (!fileName.isEmpty())
    {
       QFileInfo fileInfo = fileName;
@@ -176,19 +186,36 @@ void MainWindow::onAddPressed()
       lastDir = fileInfo.absolutePath();
       settings.setValue(LAST_IMPORT_FOLDER, lastDir);
 
-      // Attempt to load our given file.
-      GCodeObject* newObject = new GCodeObject(mPrefs);
+      // If we already have this file imported, share its data
+      // instead of parsing it all over again.
+      GCodeObject* newObject = NULL;
+      int objectCount = (int)mObjectList.size();
+      for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+      {
+         if (mObjectList[objectIndex]->isLoadedFrom(fileName))
+         {
+            newObject = new GCodeObject(*mObjectList[objectIndex]);
+            newObject->centerOnPlatform();
+            break;
+         }
+      }
 
-      if (!newObject->loadFile(fileName, this))
+      // Otherwise attempt to load our given file.
+      if (!newObject)
       {
-         if (!newObject->getError().isEmpty())
+         newObject = new GCodeObject(mPrefs);
+
+         if (!newObject->loadFile(fileName, this))
          {
-            // Failed to load the file.
-            QString errorStr = "Failed to load file \'" + fileInfo.fileName() + "\' with error:\n\n" + newObject->getError();
-            QMessageBox::critical(this, "Failure!", errorStr, QMessageBox::Ok, QMessageBox::NoButton);
+            if (!newObject->getError().isEmpty())
+            {
+               // Failed to load the file.
+               QString errorStr = "Failed to load file \'" + fileInfo.fileName() + "\' with error:\n\n" + newObject->getError();
+               QMessageBox::critical(this, "Failure!", errorStr, QMessageBox::Ok, QMessageBox::NoButton);
+            }
+            delete newObject;
+            return;
          }
-         delete newObject;
-         return;
       }
 
       // First attempt to find the next extruder index to use.
@@ -212,31 +239,58 @@ void MainWindow::onAddPressed()
       }
 
       newObject->setExtruder(extruderIndex);
-      if (!mVisualizerView->addObject(newObject))
+      insertObject(newObject, fileInfo.fileName());
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void MainWindow::onDuplicatePressed()
+{
+   int rowIndex = -1;
+   int rowCount = (int)mObjectListWidget->rowCount();
+   for (int index = 0; index < rowCount && index < (int)mObjectList.size(); ++index)
+   {
+      if (mObjectListWidget->isItemSelected(mObjectListWidget->item(index, 0)))
       {
-         QMessageBox::critical(this, "Failure!", mVisualizerView->getError(), QMessageBox::Ok);
+         rowIndex = index;
+         break;
       }
-      mObjectList.push_back(newObject);
+   }
 
-      int rowIndex = mObjectListWidget->rowCount();
-      mObjectListWidget->insertRow(rowIndex);
+   if (rowIndex == -1)
+   {
+      return;
+   }
 
-      QTableWidgetItem* fileItem = new QTableWidgetItem(fileInfo.fileName());
-      fileItem->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+   bool ok = false;
+   int copyCount = QInputDialog::getInt(this, "Duplicate", "Number of copies:", 1, 1, 100, 1, &ok);
+   if (!ok)
+   {
+      return;
+   }
 
-      QSpinBox* extruderSpin = new QSpinBox();
-      extruderSpin->setMinimum(0);
-      extruderSpin->setMaximum((int)mPrefs.extruderList.size() - 1);
-      extruderSpin->setValue(extruderIndex);
-      connect(extruderSpin, SIGNAL(valueChanged(int)), this, SLOT(onExtruderIndexChanged(int)));
+   double spacing = QInputDialog::getDouble(this, "Duplicate", "Spacing between copies (mm):", 5.0, 0.0, 100.0, 2, &ok);
+   if (!ok)
+   {
+      return;
+   }
 
-      mObjectListWidget->setItem(rowIndex, 0, fileItem);
-      mObjectListWidget->setCellWidget(rowIndex, 1, extruderSpin);
-      mObjectListWidget->resizeColumnsToContents();
+   // Copies share all of their data with the original, so we
+   // only need to lay them out in a grid beside it.
+   const GCodeObject* source = mObjectList[rowIndex];
+   QString name = mObjectListWidget->item(rowIndex, 0)->text();
 
-      mSpliceButton->setEnabled(true);
+   double width = source->getMaxBounds()[X] - source->getMinBounds()[X] + spacing;
+   double depth = source->getMaxBounds()[Y] - source->getMinBounds()[Y] + spacing;
+   int columnCount = (int)ceil(sqrt((double)(copyCount + 1)));
 
-      updateLayerSlider();
+   for (int copyIndex = 1; copyIndex <= copyCount; ++copyIndex)
+   {
+      GCodeObject* copy = new GCodeObject(*source);
+      copy->setOffsetPos(source->getOffsetPos()[X] + (copyIndex % columnCount) * width,
+                         source->getOffsetPos()[Y] + (copyIndex / columnCount) * depth,
+                         source->getOffsetPos()[Z]);
+      insertObject(copy, name);
    }
 }
 
@@ -267,11 +321,48 @@ void MainWindow::onRemovePressed()
    if (mObjectListWidget->rowCount() == 0)
    {
       mSpliceButton->setEnabled(false);
+      mArrangeButton->setEnabled(false);
    }
 
    updateLayerSlider();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void MainWindow::onMemoryPressed()
+{
+   QString text;
+   MemoryUsage total;
+   QSet<const GCodeObjectData*> counted;
+
+   int objectCount = (int)mObjectList.size();
+   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   {
+      GCodeObject* object = mObjectList[objectIndex];
+
+      // Instances sharing their data with another only count once.
+      if (counted.contains(object->getData()))
+      {
+         text += mObjectListWidget->item(objectIndex, 0)->text() + "\n";
+         text += "Shares its data with an earlier object.\n\n";
+         continue;
+      }
+      counted.insert(object->getData());
+
+      MemoryUsage usage;
+      object->getMemoryUsage(usage);
+      mVisualizerView->getMemoryUsage(object, usage);
+      total += usage;
+
+      text += mObjectListWidget->item(objectIndex, 0)->text() + "\n";
+      text += usage.toString() + "\n";
+   }
+
+   text += "All Objects\n";
+   text += total.toString();
+
+   QMessageBox::information(this, "Memory Usage", text, QMessageBox::Ok);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void MainWindow::onPlaterXPosChanged(double pos)
 {
@@ -346,6 +437,28 @@ void MainWindow::onPlaterZPosChanged(double pos)
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void MainWindow::onArrangePressed()
+{
+   GCodeArranger arranger(mPrefs);
+
+   int objectCount = (int)mObjectList.size();
+   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   {
+      arranger.addObject(mObjectList[objectIndex]);
+   }
+
+   if (!arranger.arrange(mPrefs.arrangeClearance))
+   {
+      QMessageBox::critical(this, "Failure!", arranger.getError(), QMessageBox::Ok, QMessageBox::NoButton);
+      return;
+   }
+
+   // Refresh the plater controls with the new position of our selection.
+   onObjectSelectionChanged();
+   mVisualizerView->updateGL();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void MainWindow::onSplicePressed()
 {
@@ -354,7 +467,7 @@ void MainWindow::onSplicePressed()
    lastDir += "\\Spliced";
 
    QFileDialog dlg;
-   QString fileName = dlg.getSaveFileName(this, "Export GCode File", lastDir, "GCODE (*.gcode);; All Files (*.*)");
+   QString fileName = dlg.getSaveFileName(this, "Export GCode File", lastDir, "GCODE (*.gcode);; Compressed GCODE (*.gcode.gz);; Binary GCODE (*.bgcode);; All Files (*.*)");
    if (!fileName.isEmpty())
    {
       QFileInfo fileInfo = fileName;
@@ -381,11 +494,82 @@ void MainWindow::onSplicePressed()
       }
       else
       {
-         QMessageBox::information(this, "Success!", "GCode spliced and exported!", QMessageBox::Ok);
+         QString message = "GCode spliced and exported!\n\nEstimated print time: " + GCodeTimeEstimator::formatTime(builder.getEstimatedTime());
+         const std::vector<double>& layerTimes = builder.getLayerTimes();
+         if (!layerTimes.empty())
+         {
+            int longestLayer = (int)(std::max_element(layerTimes.begin(), layerTimes.end()) - layerTimes.begin());
+            message += "\nLongest layer: " + QString::number(longestLayer + 1) +
+               " at " + GCodeTimeEstimator::formatTime(layerTimes[longestLayer]);
+         }
+         message += "\nExtruder swaps: " + QString::number(builder.getSwapCount());
+         if (builder.getSwapCount() < builder.getBaselineSwapCount())
+         {
+            message += " (down from " + QString::number(builder.getBaselineSwapCount()) +
+               ", saving about " + GCodeTimeEstimator::formatTime(builder.getSwapTimeSaved()) + ")";
+         }
+         message += "\nTravel between objects: " + QString::number(builder.getTravelDistance(), 'f', 0) + "mm";
+         if (builder.getTravelDistance() < builder.getBaselineTravelDistance())
+         {
+            message += " (down from " + QString::number(builder.getBaselineTravelDistance(), 'f', 0) + "mm)";
+         }
+         if (builder.getArcCount() > 0)
+         {
+            message += "\nArc fitting replaced " + QString::number(builder.getArcMoveCount()) +
+               " moves with " + QString::number(builder.getArcCount()) + " arcs";
+         }
+         QMessageBox::information(this, "Success!", message, QMessageBox::Ok);
       }
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void MainWindow::onResumePressed()
+{
+   QSettings settings(COMPANY_NAME, APPLICATION_NAME);
+   QString lastDir = settings.value(LAST_EXPORT_FOLDER, "").toString();
+
+   QFileDialog dlg;
+   QString fileName = dlg.getOpenFileName(this, "Open Spliced GCode File", lastDir, "GCODE (*.gcode);; All Files (*.*)");
+   if (fileName.isEmpty())
+   {
+      return;
+   }
+
+   QFileInfo fileInfo = fileName;
+
+   GCodeSplicer builder(mPrefs);
+   if (!builder.loadLayerIndex(fileName))
+   {
+      QString errorStr = "Failed to resume file \'" + fileInfo.fileName() + "\' with error:\n\n" + builder.getError();
+      QMessageBox::critical(this, "Failure!", errorStr, QMessageBox::Ok, QMessageBox::NoButton);
+      return;
+   }
+
+   bool ok = false;
+   int layer = QInputDialog::getInt(this, "Resume Print", "Resume from layer:", 1, 1, builder.getIndexedLayerCount(), 1, &ok);
+   if (!ok)
+   {
+      return;
+   }
+
+   QString resumeFileName = dlg.getSaveFileName(this, "Export GCode File", fileInfo.absolutePath() + "/" + fileInfo.completeBaseName() + ".resume.gcode", "GCODE (*.gcode);; All Files (*.*)");
+   if (resumeFileName.isEmpty())
+   {
+      return;
+   }
+
+   if (!builder.exportResume(fileName, layer, resumeFileName))
+   {
+      QString errorStr = "Failed to resume file \'" + fileInfo.fileName() + "\' with error:\n\n" + builder.getError();
+      QMessageBox::critical(this, "Failure!", errorStr, QMessageBox::Ok, QMessageBox::NoButton);
+   }
+   else
+   {
+      QMessageBox::information(this, "Success!", "GCode exported to resume from layer " + QString::number(layer) + "!", QMessageBox::Ok);
+   }
+}
+
 #ifdef BUILD_DEBUG_CONTROLS
 ////////////////////////////////////////////////////////////////////////////////
 void MainWindow::onDebugExportLayerDataPressed()
@@ -467,9 +651,10 @@ void MainWindow::updateLayerSlider()
          if (levelCount > 0)
          {
             const LayerData& layer = object->getLayer(levelCount - 1);
-            if (layer.height + object->getOffsetPos()[Z] > maxHeight)
+            double height = fromFixed(layer.height, Z) + object->getOffsetPos()[Z];
+            if (height > maxHeight)
             {
-               maxHeight = layer.height + object->getOffsetPos()[Z];
+               maxHeight = height;
             }
          }
       }
@@ -559,8 +744,15 @@ void MainWindow::setupUI()
    mAddFileButton->setToolTip("Import and add a gcode file to the list.");
    mRemoveFileButton->setToolTip("Remove all selected gcode items from the list.");
    mRemoveFileButton->setEnabled(false);
+   mDuplicateButton = new QPushButton("Duplicate");
+   mDuplicateButton->setToolTip("Add copies of the selected gcode item, sharing all of its data.");
+   mDuplicateButton->setEnabled(false);
+   mMemoryButton = new QPushButton("Memory");
+   mMemoryButton->setToolTip("Show how much memory each imported gcode file is using.");
    buttonLayout->addWidget(mAddFileButton);
    buttonLayout->addWidget(mRemoveFileButton);
+   buttonLayout->addWidget(mDuplicateButton);
+   buttonLayout->addWidget(mMemoryButton);
 
    // Below the object list are the plating controls for
    // positioning each gcode file offset.
@@ -598,6 +790,11 @@ void MainWindow::setupUI()
    platerLayout->addWidget(mPlaterYPosSpin, 0, 3, 1, 1);
    platerLayout->addWidget(platerZLabel, 0, 4, 1, 1);
    platerLayout->addWidget(mPlaterZPosSpin, 0, 5, 1, 1);
+
+   mArrangeButton = new QPushButton("Arrange");
+   mArrangeButton->setToolTip("Packs every object onto the platform, keeping them apart by the clearance in your preferences.");
+   mArrangeButton->setEnabled(false);
+   platerLayout->addWidget(mArrangeButton, 1, 0, 1, 6);
    platerLayout->setColumnStretch(0, 0);
    platerLayout->setColumnStretch(1, 1);
    platerLayout->setColumnStretch(2, 0);
@@ -620,6 +817,10 @@ void MainWindow::setupUI()
    mSpliceButton->setEnabled(false);
    buildLayout->addWidget(mSpliceButton);
 
+   mResumeButton = new QPushButton("Resume");
+   mResumeButton->setToolTip("Exports the rest of a previously spliced file from a chosen layer, to resume a failed print.");
+   buildLayout->addWidget(mResumeButton);
+
 #ifdef BUILD_DEBUG_CONTROLS
    mDebugExportLayerButton = new QPushButton("DEBUG: Export Layer Markings");
    buildLayout->addWidget(mDebugExportLayerButton);
@@ -649,15 +850,50 @@ void MainWindow::setupConnections()
    connect(mObjectListWidget,       SIGNAL(itemSelectionChanged()),  this, SLOT(onObjectSelectionChanged()));
    connect(mAddFileButton,          SIGNAL(pressed()),               this, SLOT(onAddPressed()));
    connect(mRemoveFileButton,       SIGNAL(pressed()),               this, SLOT(onRemovePressed()));
+   connect(mDuplicateButton,        SIGNAL(pressed()),               this, SLOT(onDuplicatePressed()));
+   connect(mMemoryButton,           SIGNAL(pressed()),               this, SLOT(onMemoryPressed()));
    connect(mPlaterXPosSpin,         SIGNAL(valueChanged(double)),    this, SLOT(onPlaterXPosChanged(double)));
    connect(mPlaterYPosSpin,         SIGNAL(valueChanged(double)),    this, SLOT(onPlaterYPosChanged(double)));
    connect(mPlaterZPosSpin,         SIGNAL(valueChanged(double)),    this, SLOT(onPlaterZPosChanged(double)));
+   connect(mArrangeButton,          SIGNAL(pressed()),               this, SLOT(onArrangePressed()));
    connect(mSpliceButton,           SIGNAL(pressed()),               this, SLOT(onSplicePressed()));
+   connect(mResumeButton,           SIGNAL(pressed()),               this, SLOT(onResumePressed()));
 #ifdef BUILD_DEBUG_CONTROLS
    connect(mDebugExportLayerButton, SIGNAL(pressed()),               this, SLOT(onDebugExportLayerDataPressed()));
 #endif
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void MainWindow::insertObject(GCodeObject* object, const QString& name)
+{
+   if (!mVisualizerView->addObject(object))
+   {
+      QMessageBox::critical(this, "Failure!", mVisualizerView->getError(), QMessageBox::Ok);
+   }
+   mObjectList.push_back(object);
+
+   int rowIndex = mObjectListWidget->rowCount();
+   mObjectListWidget->insertRow(rowIndex);
+
+   QTableWidgetItem* fileItem = new QTableWidgetItem(name);
+   fileItem->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+
+   QSpinBox* extruderSpin = new QSpinBox();
+   extruderSpin->setMinimum(0);
+   extruderSpin->setMaximum((int)mPrefs.extruderList.size() - 1);
+   extruderSpin->setValue(object->getExtruder());
+   connect(extruderSpin, SIGNAL(valueChanged(int)), this, SLOT(onExtruderIndexChanged(int)));
+
+   mObjectListWidget->setItem(rowIndex, 0, fileItem);
+   mObjectListWidget->setCellWidget(rowIndex, 1, extruderSpin);
+   mObjectListWidget->resizeColumnsToContents();
+
+   mSpliceButton->setEnabled(true);
+   mArrangeButton->setEnabled(true);
+
+   updateLayerSlider();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void MainWindow::applyPreferences(const PreferenceData& newPrefs)
 {
@@ -665,14 +901,43 @@ void MainWindow::applyPreferences(const PreferenceData& newPrefs)
    bool regenerateGeometry = false;
    if (mPrefs.useDisplayLists != newPrefs.useDisplayLists ||
       mPrefs.drawQuality != newPrefs.drawQuality ||
-      mPrefs.layerSkipSize != newPrefs.layerSkipSize)
+      mPrefs.layerSkipSize != newPrefs.layerSkipSize ||
+      mPrefs.geometryCacheSize != newPrefs.geometryCacheSize)
    {
       regenerateGeometry = true;
    }
 
    // Finalize the properties.
+   PreferenceData oldPrefs = mPrefs;
    mPrefs = newPrefs;
 
+   // Warn before generating geometry that would take us over our memory budget.
+   if (regenerateGeometry && mPrefs.memoryBudget > 0)
+   {
+      MemoryUsage usage;
+      int objectCount = (int)mObjectList.size();
+      for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+      {
+         mObjectList[objectIndex]->getMemoryUsage(usage);
+      }
+
+      unsigned long long projected = usage.getTotal() + mVisualizerView->estimateGeometryMemory(mPrefs.drawQuality, mPrefs.layerSkipSize);
+      unsigned long long budget = (unsigned long long)mPrefs.memoryBudget * 1024 * 1024;
+      if (projected > budget)
+      {
+         QString message = "Drawing at this quality is expected to use " + MemoryUsage::formatBytes(projected) +
+                           ", which is over the memory budget of " + MemoryUsage::formatBytes(budget) + ".\n\nContinue anyway?";
+         if (QMessageBox::warning(this, "Memory Budget", message, QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
+         {
+            // Keep drawing the way we were.
+            mPrefs.drawQuality = oldPrefs.drawQuality;
+            mPrefs.layerSkipSize = oldPrefs.layerSkipSize;
+            regenerateGeometry = mPrefs.useDisplayLists != oldPrefs.useDisplayLists ||
+                                 mPrefs.geometryCacheSize != oldPrefs.geometryCacheSize;
+         }
+      }
+   }
+
    int extruderCount = (int)mPrefs.extruderList.size() - 1;
    int count = mObjectListWidget->rowCount();
    for (int index = 0; index < count; ++index)
@@ -685,7 +950,7 @@ void MainWindow::applyPreferences(const PreferenceData& newPrefs)
    {
       //mVisualizerView->setShaderEnabled(mPrefs.drawQuality == DRAW_QUALITY_HIGH);
 
-      if (!mVisualizerView->regenerateGeometry())
+      if (!mVisualizerView->prepareGeometry())
       {
          QMessageBox::critical(this, "Failure!", mVisualizerView->getError(), QMessageBox::Ok);
       }
@@ -110,6 +110,14 @@ void PreferencesDialog::onSaveConfigPressed()
       file.write(QString::number(mPrefs.layerSkipSize).toAscii());
       file.write("\n");
 
+      file.write("GeometryCacheSize: ");
+      file.write(QString::number(mPrefs.geometryCacheSize).toAscii());
+      file.write("\n");
+
+      file.write("MemoryBudget: ");
+      file.write(QString::number(mPrefs.memoryBudget).toAscii());
+      file.write("\n");
+
       // Splicing properties.
       file.write("ExportImportedStartCode: ");
       file.write(mPrefs.exportImportedStartCode? "TRUE": "FALSE");
@@ -135,6 +143,10 @@ void PreferencesDialog::onSaveConfigPressed()
       file.write(mPrefs.exportAllAxes? "TRUE": "FALSE");
       file.write("\n");
 
+      file.write("ExportCompact: ");
+      file.write(mPrefs.exportCompact? "TRUE": "FALSE");
+      file.write("\n");
+
       file.write("PrintSkirt: ");
       file.write(mPrefs.printSkirt? "TRUE": "FALSE");
       file.write("\n");
@@ -143,6 +155,14 @@ void PreferencesDialog::onSaveConfigPressed()
       file.write(QString::number(mPrefs.skirtDistance).toAscii());
       file.write("\n");
 
+      file.write("SwapZTolerance: ");
+      file.write(QString::number(mPrefs.swapZTolerance).toAscii());
+      file.write("\n");
+
+      file.write("ArcTolerance: ");
+      file.write(QString::number(mPrefs.arcTolerance).toAscii());
+      file.write("\n");
+
       // Printer properties.
       int extruderCount = (int)mPrefs.extruderList.size();
       file.write("ExtruderCount: ");
@@ -193,6 +213,10 @@ void PreferencesDialog::onSaveConfigPressed()
          file.write(QString::number(extruder.travelSpeed).toAscii());
          file.write("\n");
 
+         file.write("  HeatUpRate: ");
+         file.write(QString::number(extruder.heatUpRate).toAscii());
+         file.write("\n");
+
          file.write("  Color: R");
          file.write(QString::number(extruder.color.red()).toAscii());
          file.write(" G");
@@ -212,6 +236,10 @@ void PreferencesDialog::onSaveConfigPressed()
       file.write(QString::number(mPrefs.platformHeight).toAscii());
       file.write("\n");
 
+      file.write("ArrangeClearance: ");
+      file.write(QString::number(mPrefs.arrangeClearance).toAscii());
+      file.write("\n");
+
       // Advanced properties.
       file.write("ExportAbsoluteMode: ");
       file.write(mPrefs.exportAbsoluteMode? "TRUE": "FALSE");
@@ -229,6 +257,10 @@ void PreferencesDialog::onSaveConfigPressed()
       file.write(QString::number(mPrefs.importPrimer).toAscii());
       file.write("\n");
 
+      file.write("ImportReadAhead: ");
+      file.write(mPrefs.importReadAhead? "TRUE": "FALSE");
+      file.write("\n");
+
       file.close();
 
       QMessageBox::information(this, "Success!", "Configuration saved!", QMessageBox::Ok);
@@ -293,6 +325,14 @@ void PreferencesDialog::onLoadConfigPressed()
          {
             mPrefs.layerSkipSize = parser.codeValueInt();
          }
+         else if (parser.codeSeen("GeometryCacheSize:"))
+         {
+            mPrefs.geometryCacheSize = parser.codeValueInt();
+         }
+         else if (parser.codeSeen("MemoryBudget:"))
+         {
+            mPrefs.memoryBudget = parser.codeValueInt();
+         }
          // Splicing properties.
          else if (parser.codeSeen("ExportImportedStartCode:"))
          {
@@ -318,6 +358,10 @@ void PreferencesDialog::onLoadConfigPressed()
          {
             mPrefs.exportAllAxes = parser.codeValue() == "TRUE";
          }
+         else if (parser.codeSeen("ExportCompact:"))
+         {
+            mPrefs.exportCompact = parser.codeValue() == "TRUE";
+         }
          else if (parser.codeSeen("PrintSkirt:"))
          {
             mPrefs.printSkirt = parser.codeValue() == "TRUE";
@@ -326,6 +370,14 @@ void PreferencesDialog::onLoadConfigPressed()
          {
             mPrefs.skirtDistance = parser.codeValueDouble();
          }
+         else if (parser.codeSeen("SwapZTolerance:"))
+         {
+            mPrefs.swapZTolerance = parser.codeValueDouble();
+         }
+         else if (parser.codeSeen("ArcTolerance:"))
+         {
+            mPrefs.arcTolerance = parser.codeValueDouble();
+         }
          // Printer properties.
          else if (parser.codeSeen("ExtruderCount:"))
          {
@@ -385,6 +437,10 @@ void PreferencesDialog::onLoadConfigPressed()
                {
                   extruder.retractSpeed = parser.codeValueDouble();
                }
+               else if (parser.codeSeen("HeatUpRate:"))
+               {
+                  extruder.heatUpRate = parser.codeValueDouble();
+               }
                else if (parser.codeSeen("Color:"))
                {
                   if (parser.codeSeen(" R"))
@@ -414,6 +470,10 @@ void PreferencesDialog::onLoadConfigPressed()
          {
             mPrefs.platformHeight = parser.codeValueInt();
          }
+         else if (parser.codeSeen("ArrangeClearance:"))
+         {
+            mPrefs.arrangeClearance = parser.codeValueDouble();
+         }
          // Advanced properties.
          else if (parser.codeSeen("ExportAbsoluteMode:"))
          {
@@ -431,6 +491,10 @@ void PreferencesDialog::onLoadConfigPressed()
          {
             mPrefs.importPrimer = parser.codeValueDouble();
          }
+         else if (parser.codeSeen("ImportReadAhead:"))
+         {
+            mPrefs.importReadAhead = parser.codeValue() == "TRUE";
+         }
       }
 
       updateUI();
@@ -457,6 +521,18 @@ void PreferencesDialog::onLayerSkipChanged(int value)
    mPrefs.layerSkipSize = value;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onGeometryCacheSizeChanged(int value)
+{
+   mPrefs.geometryCacheSize = value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onMemoryBudgetChanged(int value)
+{
+   mPrefs.memoryBudget = value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PreferencesDialog::onBackgroundColorPressed()
 {
@@ -504,6 +580,12 @@ void PreferencesDialog::onExportAllAxesChanged(int state)
    mPrefs.exportAllAxes = (state == Qt::Checked);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onExportCompactChanged(int state)
+{
+   mPrefs.exportCompact = (state == Qt::Checked);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PreferencesDialog::onPrintSkirtChanged(int state)
 {
@@ -516,6 +598,18 @@ void PreferencesDialog::onSkirtDistanceChanged(double value)
    mPrefs.skirtDistance = value;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onSwapZToleranceChanged(double value)
+{
+   mPrefs.swapZTolerance = value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onArcToleranceChanged(double value)
+{
+   mPrefs.arcTolerance = value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PreferencesDialog::onExtruderSelected(int index)
 {
@@ -548,6 +642,8 @@ void PreferencesDialog::onExtruderSelected(int index)
    mExtruderTravelSpeedSpin->setValue(data.travelSpeed);
    mExtruderRetractSpeedSpin->setEnabled(true);
    mExtruderRetractSpeedSpin->setValue(data.retractSpeed);
+   mExtruderHeatUpRateSpin->setEnabled(true);
+   mExtruderHeatUpRateSpin->setValue(data.heatUpRate);
    mExtruderColorButton->setEnabled(true);
    QPixmap pix = QPixmap(QSize(16, 16));
    pix.fill(data.color);
@@ -720,6 +816,19 @@ void PreferencesDialog::onExtruderRetractSpeedChanged(double value)
    data.retractSpeed = value;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onExtruderHeatUpRateChanged(double value)
+{
+   if (mCurrentExtruder < 0 || mCurrentExtruder >= (int)mPrefs.extruderList.size())
+   {
+      return;
+   }
+
+   ExtruderData& data = mPrefs.extruderList[mCurrentExtruder];
+
+   data.heatUpRate = value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PreferencesDialog::onExtruderColorPressed()
 {
@@ -750,6 +859,12 @@ void PreferencesDialog::onPlatformHeightChanged(double value)
    mPrefs.platformHeight = value;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onArrangeClearanceChanged(double value)
+{
+   mPrefs.arrangeClearance = value;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PreferencesDialog::onExportAbsoluteModeChanged(int state)
 {
@@ -774,6 +889,12 @@ void PreferencesDialog::onImportPrimerChanged(double value)
    mPrefs.importPrimer = value;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void PreferencesDialog::onImportReadAheadChanged(int state)
+{
+   mPrefs.importReadAhead = (state == Qt::Checked);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void PreferencesDialog::onOkPressed()
 {
@@ -859,9 +980,30 @@ void PreferencesDialog::setupUI()
       mLayerSkipSpin->setToolTip("This will skip the generation of geometry for every # of layers.");
       renderingLayout->addWidget(mLayerSkipSpin, 2, 1, 1, 2);
 
+      QLabel* geometryCacheSizeLabel = new QLabel("Geometry Cache: ");
+      geometryCacheSizeLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+      renderingLayout->addWidget(geometryCacheSizeLabel, 3, 0, 1, 1);
+
+      mGeometryCacheSizeSpin = new QSpinBox();
+      mGeometryCacheSizeSpin->setRange(0, 16384);
+      mGeometryCacheSizeSpin->setSuffix(" MB");
+      mGeometryCacheSizeSpin->setToolTip("The amount of memory kept for geometry of other draw qualities, so switching back to them is instant.");
+      renderingLayout->addWidget(mGeometryCacheSizeSpin, 3, 1, 1, 2);
+
+      QLabel* memoryBudgetLabel = new QLabel("Memory Budget: ");
+      memoryBudgetLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+      renderingLayout->addWidget(memoryBudgetLabel, 4, 0, 1, 1);
+
+      mMemoryBudgetSpin = new QSpinBox();
+      mMemoryBudgetSpin->setRange(0, 65536);
+      mMemoryBudgetSpin->setSuffix(" MB");
+      mMemoryBudgetSpin->setSpecialValueText("Unlimited");
+      mMemoryBudgetSpin->setToolTip("You will be warned before changing the draw quality would use more memory than this.");
+      renderingLayout->addWidget(mMemoryBudgetSpin, 4, 1, 1, 2);
+
       mBackgroundColorButton = new QPushButton("Background Color");
       mBackgroundColorButton->setToolTip("The background color of the visualizer window.");
-      renderingLayout->addWidget(mBackgroundColorButton, 3, 0, 1, 3);
+      renderingLayout->addWidget(mBackgroundColorButton, 5, 0, 1, 3);
       renderingLayout->setRowStretch(1, 0);
 
       renderingLayout->setColumnStretch(0, 1);
@@ -920,6 +1062,11 @@ void PreferencesDialog::setupUI()
       gcodeLayout->addWidget(mExportCommentsCheckbox, 5, 0, 1, 1);
       gcodeLayout->addWidget(mExportAllAxesCheckbox, 5, 1, 1, 1);
 
+      // Compact output.
+      mExportCompactCheckbox = new QCheckBox("Compact Output");
+      mExportCompactCheckbox->setToolTip("This option leaves out repeated feed rates, axes, temperatures and fan speeds\nfor a smaller file that prints exactly the same.  Overrides Export All Axes.");
+      gcodeLayout->addWidget(mExportCompactCheckbox, 6, 0, 1, 1);
+
       // Skirt.
       QGroupBox* skirtGroup = new QGroupBox("Skirt");
       splicingLayout->addWidget(skirtGroup);
@@ -941,6 +1088,46 @@ void PreferencesDialog::setupUI()
       skirtLayout->addWidget(mPrintSkirtCheckbox);
       skirtLayout->addWidget(skirtDistanceLabel);
       skirtLayout->addWidget(mSkirtDistanceSpin);
+
+      // Extruder swaps.
+      QGroupBox* swapGroup = new QGroupBox("Extruder Swaps");
+      splicingLayout->addWidget(swapGroup);
+
+      QHBoxLayout* swapLayout = new QHBoxLayout();
+      swapGroup->setLayout(swapLayout);
+
+      QLabel* swapZToleranceLabel = new QLabel("Layer Grouping Height: ");
+      swapZToleranceLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+      mSwapZToleranceSpin = new QDoubleSpinBox();
+      mSwapZToleranceSpin->setSuffix("mm");
+      mSwapZToleranceSpin->setMinimum(0.0);
+      mSwapZToleranceSpin->setMaximum(10.0);
+      mSwapZToleranceSpin->setDecimals(2);
+      mSwapZToleranceSpin->setSingleStep(0.1);
+      mSwapZToleranceSpin->setSpecialValueText("Off");
+      mSwapZToleranceSpin->setToolTip("How far (in mm) an extruder may print above the others before swapping.\nGrouping several layers of one extruder saves swaps, but your nozzles need the clearance.");
+      swapLayout->addWidget(swapZToleranceLabel);
+      swapLayout->addWidget(mSwapZToleranceSpin);
+
+      // Arc fitting.
+      QGroupBox* arcGroup = new QGroupBox("Arc Fitting");
+      splicingLayout->addWidget(arcGroup);
+
+      QHBoxLayout* arcLayout = new QHBoxLayout();
+      arcGroup->setLayout(arcLayout);
+
+      QLabel* arcToleranceLabel = new QLabel("Arc Tolerance: ");
+      arcToleranceLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+      mArcToleranceSpin = new QDoubleSpinBox();
+      mArcToleranceSpin->setSuffix("mm");
+      mArcToleranceSpin->setMinimum(0.0);
+      mArcToleranceSpin->setMaximum(1.0);
+      mArcToleranceSpin->setDecimals(3);
+      mArcToleranceSpin->setSingleStep(0.01);
+      mArcToleranceSpin->setSpecialValueText("Off");
+      mArcToleranceSpin->setToolTip("How far (in mm) a G2/G3 arc may stray from the moves it replaces.\nCurves made of many short moves are exported as arcs, easing the load on the printer.\nAbout 0.05mm works well, your firmware must support arcs.");
+      arcLayout->addWidget(arcToleranceLabel);
+      arcLayout->addWidget(mArcToleranceSpin);
    }
 
    //// Printer Tab.
@@ -983,6 +1170,8 @@ void PreferencesDialog::setupUI()
       extruderTravelSpeedLabel->setAlignment(Qt::AlignCenter | Qt::AlignRight);
       QLabel* extruderRetractSpeedLabel = new QLabel("Retract Speed:");
       extruderRetractSpeedLabel->setAlignment(Qt::AlignCenter | Qt::AlignRight);
+      QLabel* extruderHeatUpRateLabel = new QLabel("Heat Up Rate:");
+      extruderHeatUpRateLabel->setAlignment(Qt::AlignCenter | Qt::AlignRight);
 
       mExtruderOffsetXSpin = new QDoubleSpinBox();
       mExtruderOffsetXSpin->setMinimum(0.0);
@@ -1039,6 +1228,12 @@ void PreferencesDialog::setupUI()
       mExtruderRetractSpeedSpin->setMaximum(1000.0);
       mExtruderRetractSpeedSpin->setSuffix("mm/sec");
       mExtruderRetractSpeedSpin->setToolTip("Retraction and prime speed of the extruder (in mm/sec).");
+      mExtruderHeatUpRateSpin = new QDoubleSpinBox();
+      mExtruderHeatUpRateSpin->setMinimum(0.0);
+      mExtruderHeatUpRateSpin->setMaximum(100.0);
+      mExtruderHeatUpRateSpin->setSuffix("C/sec");
+      mExtruderHeatUpRateSpin->setSpecialValueText("Off");
+      mExtruderHeatUpRateSpin->setToolTip("How fast the extruder heats up (in C/sec), used to start heating it from idle before it is swapped in.");
       mExtruderColorButton = new QPushButton("Color");
       QPixmap pix = QPixmap(QSize(16, 16));
       pix.fill(Qt::darkGray);
@@ -1072,7 +1267,9 @@ void PreferencesDialog::setupUI()
       extruderLayout->addWidget(mExtruderTravelSpeedSpin,  3, 6, 1, 1);
       extruderLayout->addWidget(extruderRetractSpeedLabel, 4, 5, 1, 1);
       extruderLayout->addWidget(mExtruderRetractSpeedSpin, 4, 6, 1, 1);
-      extruderLayout->addWidget(mExtruderColorButton,      5, 3, 1, 4);
+      extruderLayout->addWidget(extruderHeatUpRateLabel,   5, 3, 1, 1);
+      extruderLayout->addWidget(mExtruderHeatUpRateSpin,   5, 4, 1, 1);
+      extruderLayout->addWidget(mExtruderColorButton,      5, 5, 1, 2);
 
       // Add/Remove buttons.
       mAddExtruderButton = new QPushButton("Add");
@@ -1109,10 +1306,20 @@ void PreferencesDialog::setupUI()
       mPlatformHeightSpin->setMaximum(1000.0);
       mPlatformHeightSpin->setToolTip("The height of your build platform.");
 
+      QLabel* arrangeClearanceLabel = new QLabel("Clearance: ");
+      arrangeClearanceLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+
+      mArrangeClearanceSpin = new QDoubleSpinBox();
+      mArrangeClearanceSpin->setMinimum(0.0);
+      mArrangeClearanceSpin->setMaximum(100.0);
+      mArrangeClearanceSpin->setToolTip("The minimum distance kept between objects when they are arranged on the platform.");
+
       platformLayout->addWidget(platformWidthLabel);
       platformLayout->addWidget(mPlatformWidthSpin);
       platformLayout->addWidget(platformHeightLabel);
       platformLayout->addWidget(mPlatformHeightSpin);
+      platformLayout->addWidget(arrangeClearanceLabel);
+      platformLayout->addWidget(mArrangeClearanceSpin);
    }
 
    //// Advanced Tab.
@@ -1167,6 +1374,10 @@ void PreferencesDialog::setupUI()
       mImportPrimerSpin->setDecimals(4);
       importLayout->addWidget(mImportPrimerSpin, 1, 1, 1, 1);
 
+      mImportReadAheadCheckbox = new QCheckBox("Read Ahead");
+      mImportReadAheadCheckbox->setToolTip("If enabled, imported files are read on a separate thread while they are parsed.\nThis speeds up importing from network or other slow storage.");
+      importLayout->addWidget(mImportReadAheadCheckbox, 2, 1, 1, 1);
+
       importLayout->setColumnStretch(0, 1);
       importLayout->setColumnStretch(1, 2);
 
@@ -1206,6 +1417,8 @@ void PreferencesDialog::setupConnections()
    connect(mUseDisplayListsCheckbox,         SIGNAL(stateChanged(int)),          this, SLOT(onUseDisplayListsChanged(int)));
    connect(mDrawQualityCombo,                SIGNAL(currentIndexChanged(int)),   this, SLOT(onDrawQualityChanged(int)));
    connect(mLayerSkipSpin,                   SIGNAL(valueChanged(int)),          this, SLOT(onLayerSkipChanged(int)));
+   connect(mGeometryCacheSizeSpin,           SIGNAL(valueChanged(int)),          this, SLOT(onGeometryCacheSizeChanged(int)));
+   connect(mMemoryBudgetSpin,                SIGNAL(valueChanged(int)),          this, SLOT(onMemoryBudgetChanged(int)));
    connect(mBackgroundColorButton,           SIGNAL(pressed()),                  this, SLOT(onBackgroundColorPressed()));
 
    //// Splicing Tab.
@@ -1215,8 +1428,11 @@ void PreferencesDialog::setupConnections()
    connect(mGCodeSwapEdit,                   SIGNAL(textChanged()),              this, SLOT(onSwapChanged()));
    connect(mExportCommentsCheckbox,          SIGNAL(stateChanged(int)),          this, SLOT(onExportCommentsChanged(int)));
    connect(mExportAllAxesCheckbox,           SIGNAL(stateChanged(int)),          this, SLOT(onExportAllAxesChanged(int)));
+   connect(mExportCompactCheckbox,           SIGNAL(stateChanged(int)),          this, SLOT(onExportCompactChanged(int)));
    connect(mPrintSkirtCheckbox,              SIGNAL(stateChanged(int)),          this, SLOT(onPrintSkirtChanged(int)));
    connect(mSkirtDistanceSpin,               SIGNAL(valueChanged(double)),       this, SLOT(onSkirtDistanceChanged(double)));
+   connect(mSwapZToleranceSpin,              SIGNAL(valueChanged(double)),       this, SLOT(onSwapZToleranceChanged(double)));
+   connect(mArcToleranceSpin,                SIGNAL(valueChanged(double)),       this, SLOT(onArcToleranceChanged(double)));
 
    //// Printer Tab.
    connect(mExtruderList,                    SIGNAL(currentRowChanged(int)),     this, SLOT(onExtruderSelected(int)));
@@ -1232,16 +1448,19 @@ void PreferencesDialog::setupConnections()
    connect(mExtruderPrimerSpin,              SIGNAL(valueChanged(double)),       this, SLOT(onExtruderPrimerChanged(double)));
    connect(mExtruderTravelSpeedSpin,         SIGNAL(valueChanged(double)),       this, SLOT(onExtruderTravelSpeedChanged(double)));
    connect(mExtruderRetractSpeedSpin,        SIGNAL(valueChanged(double)),       this, SLOT(onExtruderRetractSpeedChanged(double)));
+   connect(mExtruderHeatUpRateSpin,          SIGNAL(valueChanged(double)),       this, SLOT(onExtruderHeatUpRateChanged(double)));
    connect(mExtruderColorButton,             SIGNAL(pressed()),                  this, SLOT(onExtruderColorPressed()));
    
    connect(mPlatformWidthSpin,               SIGNAL(valueChanged(double)),       this, SLOT(onPlatformWidthChanged(double)));
    connect(mPlatformHeightSpin,              SIGNAL(valueChanged(double)),       this, SLOT(onPlatformHeightChanged(double)));
+   connect(mArrangeClearanceSpin,            SIGNAL(valueChanged(double)),       this, SLOT(onArrangeClearanceChanged(double)));
 
    //// Advanced Tab.
    connect(mExportAbsoluteModeCheckbox,      SIGNAL(stateChanged(int)),          this, SLOT(onExportAbsoluteModeChanged(int)));
    connect(mExportAbsoluteEModeCheckbox,     SIGNAL(stateChanged(int)),          this, SLOT(onExportAbsoluteEModeChanged(int)));
    connect(mImportRetractionSpin,            SIGNAL(valueChanged(double)),       this, SLOT(onImportRetractionChanged(double)));
    connect(mImportPrimerSpin,                SIGNAL(valueChanged(double)),       this, SLOT(onImportPrimerChanged(double)));
+   connect(mImportReadAheadCheckbox,         SIGNAL(stateChanged(int)),          this, SLOT(onImportReadAheadChanged(int)));
 
    //// Dialog Buttons.
    connect(mOkButton,                        SIGNAL(pressed()),                  this, SLOT(onOkPressed()));
@@ -1256,6 +1475,8 @@ void PreferencesDialog::updateUI()
    mUseDisplayListsCheckbox->setChecked(mPrefs.useDisplayLists);
    mDrawQualityCombo->setCurrentIndex((int)mPrefs.drawQuality);
    mLayerSkipSpin->setValue(mPrefs.layerSkipSize);
+   mGeometryCacheSizeSpin->setValue(mPrefs.geometryCacheSize);
+   mMemoryBudgetSpin->setValue(mPrefs.memoryBudget);
    setBackgroundColor(mPrefs.backgroundColor);
 
    // Splicing Tab.
@@ -1265,8 +1486,11 @@ void PreferencesDialog::updateUI()
    mGCodeSwapEdit->setText(mPrefs.swapCode);
    mExportCommentsCheckbox->setChecked(mPrefs.exportComments);
    mExportAllAxesCheckbox->setChecked(mPrefs.exportAllAxes);
+   mExportCompactCheckbox->setChecked(mPrefs.exportCompact);
    mPrintSkirtCheckbox->setChecked(mPrefs.printSkirt);
    mSkirtDistanceSpin->setValue(mPrefs.skirtDistance);
+   mSwapZToleranceSpin->setValue(mPrefs.swapZTolerance);
+   mArcToleranceSpin->setValue(mPrefs.arcTolerance);
 
    // Printer Tab.
    ExtruderData defaults;
@@ -1286,6 +1510,7 @@ void PreferencesDialog::updateUI()
    mExtruderPrimerSpin->setEnabled(false);
    mExtruderTravelSpeedSpin->setEnabled(false);
    mExtruderRetractSpeedSpin->setEnabled(false);
+   mExtruderHeatUpRateSpin->setEnabled(false);
    mExtruderColorButton->setEnabled(false);
    mExtruderOffsetXSpin->setValue(defaults.offset[X]);
    mExtruderOffsetYSpin->setValue(defaults.offset[Y]);
@@ -1297,11 +1522,13 @@ void PreferencesDialog::updateUI()
    mExtruderPrimerSpin->setValue(defaults.primer);
    mExtruderTravelSpeedSpin->setValue(defaults.travelSpeed);
    mExtruderRetractSpeedSpin->setValue(defaults.retractSpeed);
+   mExtruderHeatUpRateSpin->setValue(defaults.heatUpRate);
    QPixmap pix = QPixmap(QSize(16, 16));
    pix.fill(Qt::darkGray);
    mExtruderColorButton->setIcon(QIcon(pix));
    mPlatformWidthSpin->setValue(mPrefs.platformWidth);
    mPlatformHeightSpin->setValue(mPrefs.platformHeight);
+   mArrangeClearanceSpin->setValue(mPrefs.arrangeClearance);
    mCurrentExtruder = -1;
 
    // Advanced Tab.
@@ -1309,6 +1536,7 @@ void PreferencesDialog::updateUI()
    mExportAbsoluteEModeCheckbox->setChecked(mPrefs.exportAbsoluteEMode);
    mImportRetractionSpin->setValue(mPrefs.importRetraction);
    mImportPrimerSpin->setValue(mPrefs.importPrimer);
+   mImportReadAheadCheckbox->setChecked(mPrefs.importReadAhead);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1358,6 +1586,8 @@ void PreferencesDialog::storeLastPreferences()
       settings.setValue("BackgroundColor", mPrefs.backgroundColor);
       settings.setValue("UseDisplayLists", mPrefs.useDisplayLists);
       settings.setValue("DrawQuality", (int)mPrefs.drawQuality);
+      settings.setValue("GeometryCacheSize", mPrefs.geometryCacheSize);
+      settings.setValue("MemoryBudget", mPrefs.memoryBudget);
       // Splicing properties.
       settings.setValue("ExportImportedStartCode", mPrefs.exportImportedStartCode);
       settings.setValue("CustomPrefixCode", mPrefs.prefixCode);
@@ -1365,8 +1595,11 @@ void PreferencesDialog::storeLastPreferences()
       settings.setValue("CustomSwapCode", mPrefs.swapCode);
       settings.setValue("ExportComments", mPrefs.exportComments);
       settings.setValue("ExportAllAxes", mPrefs.exportAllAxes);
+      settings.setValue("ExportCompact", mPrefs.exportCompact);
       settings.setValue("PrintSkirt", mPrefs.printSkirt);
       settings.setValue("SkirtDistance", mPrefs.skirtDistance);
+      settings.setValue("SwapZTolerance", mPrefs.swapZTolerance);
+      settings.setValue("ArcTolerance", mPrefs.arcTolerance);
       // Printer properties.
       int extruderCount = (int)mPrefs.extruderList.size();
       settings.beginWriteArray("Extruders", extruderCount);
@@ -1384,16 +1617,19 @@ void PreferencesDialog::storeLastPreferences()
          settings.setValue("Primer", data.primer);
          settings.setValue("TravelSpeed", data.travelSpeed);
          settings.setValue("RetractSpeed", data.retractSpeed);
+         settings.setValue("HeatUpRate", data.heatUpRate);
          settings.setValue("Color", data.color);
       }
       settings.endArray();
       settings.setValue("PlatformWidth", mPrefs.platformWidth);
       settings.setValue("PlatformHeight", mPrefs.platformHeight);
+      settings.setValue("ArrangeClearance", mPrefs.arrangeClearance);
       // Advanced properties.
       settings.setValue("ExportAbsoluteMode", mPrefs.exportAbsoluteMode);
       settings.setValue("ExportAbsoluteEMode", mPrefs.exportAbsoluteEMode);
       settings.setValue("ImportRetraction", mPrefs.importRetraction);
       settings.setValue("ImportPrimer", mPrefs.importPrimer);
+      settings.setValue("ImportReadAhead", mPrefs.importReadAhead);
    }
    settings.endGroup();
 }
@@ -1415,6 +1651,8 @@ bool PreferencesDialog::restoreLastPreferences(PreferenceData& prefs)
       prefs.backgroundColor = settings.value("BackgroundColor", defaults.backgroundColor).value<QColor>();
       prefs.useDisplayLists = settings.value("UseDisplayLists", defaults.useDisplayLists).toBool();
       prefs.drawQuality = (DrawQuality)settings.value("DrawQuality", (int)defaults.drawQuality).toInt();
+      prefs.geometryCacheSize = settings.value("GeometryCacheSize", defaults.geometryCacheSize).toInt();
+      prefs.memoryBudget = settings.value("MemoryBudget", defaults.memoryBudget).toInt();
       // Splicing properties.
       prefs.exportImportedStartCode = settings.value("ExportImportedStartCode", defaults.exportImportedStartCode).toBool();
       prefs.prefixCode = settings.value("CustomPrefixCode", defaults.prefixCode).toString();
@@ -1422,8 +1660,11 @@ bool PreferencesDialog::restoreLastPreferences(PreferenceData& prefs)
       prefs.swapCode = settings.value("CustomSwapCode", defaults.swapCode).toString();
       prefs.exportComments = settings.value("ExportComments", defaults.exportComments).toBool();
       prefs.exportAllAxes = settings.value("ExportAllAxes", defaults.exportAllAxes).toBool();
+      prefs.exportCompact = settings.value("ExportCompact", defaults.exportCompact).toBool();
       prefs.printSkirt = settings.value("PrintSkirt", defaults.printSkirt).toBool();
       prefs.skirtDistance = settings.value("SkirtDistance", defaults.skirtDistance).toDouble();
+      prefs.swapZTolerance = settings.value("SwapZTolerance", defaults.swapZTolerance).toDouble();
+      prefs.arcTolerance = settings.value("ArcTolerance", defaults.arcTolerance).toDouble();
       // Printer properties.
       ExtruderData defaultExtruder;
       int extruderCount = settings.beginReadArray("Extruders");
@@ -1442,16 +1683,19 @@ bool PreferencesDialog::restoreLastPreferences(PreferenceData& prefs)
          data.primer = settings.value("Primer", defaultExtruder.primer).toDouble();
          data.travelSpeed = settings.value("TravelSpeed", defaultExtruder.travelSpeed).toDouble();
          data.retractSpeed = settings.value("RetractSpeed", defaultExtruder.retractSpeed).toDouble();
+         data.heatUpRate = settings.value("HeatUpRate", defaultExtruder.heatUpRate).toDouble();
          data.color = settings.value("Color", defaultExtruder.color).value<QColor>();
       }
       settings.endArray();
       prefs.platformWidth = settings.value("PlatformWidth", defaults.platformWidth).toDouble();
       prefs.platformHeight = settings.value("PlatformHeight", defaults.platformHeight).toDouble();
+      prefs.arrangeClearance = settings.value("ArrangeClearance", defaults.arrangeClearance).toDouble();
       // Advanced properties.
       prefs.exportAbsoluteMode = settings.value("ExportAbsoluteMode", defaults.exportAbsoluteMode).toBool();
       prefs.exportAbsoluteEMode = settings.value("ExportAbsoluteEMode", defaults.exportAbsoluteEMode).toBool();
       prefs.importRetraction = settings.value("ImportRetraction", defaults.importRetraction).toDouble();
       prefs.importPrimer = settings.value("ImportPrimer", defaults.importPrimer).toDouble();
+      prefs.importReadAhead = settings.value("ImportReadAhead", defaults.importReadAhead).toBool();
    }
    settings.endGroup();
 
@@ -0,0 +1,199 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <ReadAheadReader.h>
+#include <Trace.h>
+
+#include <string.h>
+
+// The size of each block read from file.
+const static int READ_AHEAD_BLOCK_SIZE = 1024 * 1024;
+
+// How long either side of the ring sleeps while it waits on the other, in microseconds.
+const static int READ_AHEAD_WAIT_TIME = 100;
+
+////////////////////////////////////////////////////////////////////////////////
+ReadAheadReader::ReadAheadReader()
+   : mWriteIndex(0)
+   , mReadIndex(0)
+   , mFinished(0)
+   , mStopping(0)
+   , mSlotPos(0)
+   , mPos(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ReadAheadReader::~ReadAheadReader()
+{
+   close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReadAheadReader::open(const QString& fileName, qint64 offset)
+{
+   close();
+
+   mFile.setFileName(fileName);
+   if (!mFile.open(QIODevice::ReadOnly))
+   {
+      return false;
+   }
+
+   if (!mFile.seek(offset))
+   {
+      mFile.close();
+      return false;
+   }
+
+   mPos = offset;
+   start();
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ReadAheadReader::close()
+{
+   if (isRunning())
+   {
+      mStopping.fetchAndStoreRelease(1);
+      wait();
+   }
+
+   mFile.close();
+
+   for (int slotIndex = 0; slotIndex < READ_AHEAD_SLOT_COUNT; ++slotIndex)
+   {
+      mSlots[slotIndex].clear();
+   }
+
+   mWriteIndex = 0;
+   mReadIndex = 0;
+   mFinished = 0;
+   mStopping = 0;
+   mSlotPos = 0;
+   mPos = 0;
+   mError.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int ReadAheadReader::read(char* data, int maxSize)
+{
+   int size = 0;
+   while (size < maxSize && waitForSlot())
+   {
+      int readIndex = mReadIndex;
+      const QByteArray& slot = mSlots[readIndex % READ_AHEAD_SLOT_COUNT];
+
+      int copySize = qMin(maxSize - size, slot.size() - mSlotPos);
+      memcpy(data + size, slot.constData() + mSlotPos, copySize);
+      size += copySize;
+      mSlotPos += copySize;
+
+      // Hand the slot back to the reader thread once it has been emptied.
+      if (mSlotPos == slot.size())
+      {
+         mSlotPos = 0;
+         mReadIndex.fetchAndStoreRelease(readIndex + 1);
+      }
+   }
+
+   mPos += size;
+   return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReadAheadReader::atEnd()
+{
+   return !waitForSlot();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 ReadAheadReader::pos() const
+{
+   return mPos;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const QString& ReadAheadReader::getError() const
+{
+   return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ReadAheadReader::run()
+{
+   TRACE_SPAN("ReadAheadReader::run");
+
+   while (!mFile.atEnd())
+   {
+      // Wait for the consumer to empty a slot for us.
+      int writeIndex = mWriteIndex;
+      while (writeIndex - mReadIndex.fetchAndAddAcquire(0) >= READ_AHEAD_SLOT_COUNT)
+      {
+         if (mStopping.fetchAndAddAcquire(0))
+         {
+            return;
+         }
+
+         usleep(READ_AHEAD_WAIT_TIME);
+      }
+
+      QByteArray& slot = mSlots[writeIndex % READ_AHEAD_SLOT_COUNT];
+      slot.resize(READ_AHEAD_BLOCK_SIZE);
+
+      qint64 size = mFile.read(slot.data(), READ_AHEAD_BLOCK_SIZE);
+      if (size < 0)
+      {
+         mError = "Failed to read the file.";
+         break;
+      }
+
+      if (size == 0)
+      {
+         break;
+      }
+
+      slot.resize((int)size);
+      mWriteIndex.fetchAndStoreRelease(writeIndex + 1);
+   }
+
+   mFinished.fetchAndStoreRelease(1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReadAheadReader::waitForSlot()
+{
+   int readIndex = mReadIndex;
+   while (mWriteIndex.fetchAndAddAcquire(0) == readIndex)
+   {
+      // The last slot may have been filled just before the reader finished.
+      if (mFinished.fetchAndAddAcquire(0))
+      {
+         return mWriteIndex.fetchAndAddAcquire(0) != readIndex;
+      }
+
+      usleep(READ_AHEAD_WAIT_TIME);
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
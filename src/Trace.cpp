@@ -0,0 +1,138 @@
+/*
+ * LocheGSplicer
+ * Copyright (C) 2012 Jeff P. Houde (Lochemage)
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+
+#include <Trace.h>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////////
+struct TraceEvent
+{
+   const char* name;
+   qint64      start;
+   qint64      duration;
+   qint64      threadId;
+   QString     args;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+bool Trace::mEnabled = false;
+
+static QString                   gTraceFileName;
+static QElapsedTimer             gTraceTimer;
+static QMutex                    gTraceMutex;
+static std::vector<TraceEvent>   gTraceEvents;
+
+////////////////////////////////////////////////////////////////////////////////
+void Trace::start(const QString& fileName)
+{
+   QMutexLocker lock(&gTraceMutex);
+
+   gTraceFileName = fileName;
+   gTraceEvents.clear();
+   gTraceEvents.reserve(4096);
+   gTraceTimer.start();
+
+   mEnabled = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool Trace::stop()
+{
+   QMutexLocker lock(&gTraceMutex);
+
+   if (!mEnabled)
+   {
+      return false;
+   }
+
+   mEnabled = false;
+
+   QFile file(gTraceFileName);
+   if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+   {
+      return false;
+   }
+
+   file.write("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+   int eventCount = (int)gTraceEvents.size();
+   for (int eventIndex = 0; eventIndex < eventCount; ++eventIndex)
+   {
+      const TraceEvent& event = gTraceEvents[eventIndex];
+
+      file.write("{\"name\": \"");
+      file.write(event.name);
+      file.write("\", \"cat\": \"LocheGSplicer\", \"ph\": \"X\", \"pid\": 1, \"tid\": ");
+      file.write(QByteArray::number(event.threadId));
+      file.write(", \"ts\": ");
+      file.write(QByteArray::number(event.start));
+      file.write(", \"dur\": ");
+      file.write(QByteArray::number(event.duration));
+
+      if (!event.args.isEmpty())
+      {
+         file.write(", \"args\": {");
+         file.write(event.args.toAscii());
+         file.write("}");
+      }
+
+      file.write(eventIndex + 1 < eventCount? "},\n": "}\n");
+   }
+
+   file.write("]}\n");
+   file.close();
+
+   gTraceEvents.clear();
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+qint64 Trace::getTime()
+{
+   return gTraceTimer.nsecsElapsed() / 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Trace::addEvent(const char* name, qint64 start, qint64 duration, const QString& args)
+{
+   if (!mEnabled)
+   {
+      return;
+   }
+
+   TraceEvent event;
+   event.name = name;
+   event.start = start;
+   event.duration = duration;
+   event.threadId = (qint64)(quintptr)QThread::currentThreadId();
+   event.args = args;
+
+   QMutexLocker lock(&gTraceMutex);
+   gTraceEvents.push_back(event);
+}
+
+////////////////////////////////////////////////////////////////////////////////
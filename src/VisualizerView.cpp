@@ -20,10 +20,37 @@
 
 #include <VisualizerView.h>
 #include <GCodeObject.h>
+#include <Trace.h>
 
 #include <math.h>
 #include <assert.h>
 
+////////////////////////////////////////////////////////////////////////////////
+// The time (in milliseconds) we want each frame to take while the camera
+// is moving, this keeps us at roughly 30 frames per second.
+const static int INTERACTION_FRAME_TIME = 33;
+
+// The largest number of layers we will skip over while the camera is moving.
+const static int MAX_INTERACTION_LAYER_STRIDE = 64;
+
+// The distance at which the camera is considered to have reached its target.
+const static double CAMERA_SETTLE_DISTANCE = 0.001;
+
+// The length (in millimetres) of the segments arcs are drawn with at each
+// draw quality, and the most segments any one arc is drawn with.
+const static double ARC_SEGMENT_LENGTH[DRAW_QUALITY_NUM] = {2.0, 1.0, 0.5};
+const static int ARC_MAX_SEGMENTS = 256;
+
+////////////////////////////////////////////////////////////////////////////////
+/**
+ * Retrieves how many segments an arc is drawn with at a draw quality.
+ */
+static int getArcSegmentCount(const GCodeCommand& code, const double* start, DrawQuality quality)
+{
+   int segmentCount = (int)ceil(getArcLength(code, start) / ARC_SEGMENT_LENGTH[quality]);
+   return qBound(1, segmentCount, ARC_MAX_SEGMENTS);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 #ifndef GL_MULTISAMPLE
 #define GL_MULTISAMPLE  0x809D
@@ -67,6 +94,9 @@ VisualizerView::VisualizerView(const PreferenceData& prefs)
    , mUpdateTimer(NULL)
    , mPrefs(prefs)
    , mLayerDrawHeight(0.0)
+   , mInteracting(false)
+   , mInteractionLayerStride(1)
+   , mGeometryUseCounter(0)
 {
    for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
    {
@@ -91,7 +121,7 @@ VisualizerView::VisualizerView(const PreferenceData& prefs)
 
    mUpdateTimer = new QTimer(this);
    connect(mUpdateTimer, SIGNAL(timeout()), this, SLOT(updateTick()));
-   mUpdateTimer->start(100);
+   mUpdateTimer->start(INTERACTION_FRAME_TIME);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -107,43 +137,30 @@ VisualizerView::~VisualizerView()
 ////////////////////////////////////////////////////////////////////////////////
 bool VisualizerView::addObject(GCodeObject* object)
 {
-   VisualizerObjectData objectData;
-   objectData.object = object;
+   mInstanceList.push_back(object);
 
-   int maxProgress = object->getLayerCount() - 1;
-   if (mPrefs.useDisplayLists)
-   {
-      maxProgress *= 3;
-   }
-   else
+   // Instances of data we already have geometry for cost nothing more.
+   VisualizerObjectData* existing = findObjectData(object->getData());
+   if (existing)
    {
-      maxProgress *= 2;
+      existing->instanceCount++;
+      updateGL();
+      return true;
    }
 
-   QProgressDialog progressDialog("Generating Geometry...", 0, 0, maxProgress, this);
-   progressDialog.setWindowModality(Qt::WindowModal);
-   progressDialog.setFixedSize(progressDialog.sizeHint());
-   progressDialog.show();
+   VisualizerObjectData objectData;
+   objectData.data = object->getData();
+   objectData.instanceCount = 1;
+   mObjectList.push_back(objectData);
 
-   if (!generateGeometry(objectData, progressDialog))
+   if (!prepareGeometry())
    {
-      freeBuffers(objectData);
+      freeBuffers(mObjectList.back());
+      mObjectList.pop_back();
+      mInstanceList.pop_back();
       return false;
    }
 
-   // If we are using display lists, then generate our display lists.
-   if (mPrefs.useDisplayLists)
-   {
-      if (!genObject(objectData, progressDialog))
-      {
-         return false;
-      }
-   }
-
-   mObjectList.push_back(objectData);
-
-   updateGL();
-
    return true;
 }
 
@@ -155,18 +172,35 @@ void VisualizerView::removeObject(GCodeObject* object)
       return;
    }
 
+   int instanceCount = (int)mInstanceList.size();
+   for (int instanceIndex = 0; instanceIndex < instanceCount; ++instanceIndex)
+   {
+      if (mInstanceList[instanceIndex] == object)
+      {
+         mInstanceList.erase(mInstanceList.begin() + instanceIndex);
+         break;
+      }
+   }
+
+   // The geometry goes away along with the last instance using it.
    int objectCount = (int)mObjectList.size();
    for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
    {
       VisualizerObjectData& data = mObjectList[objectIndex];
-      if (data.object == object)
+      if (data.data == object->getData())
       {
-         freeBuffers(data);
-         mObjectList.erase(mObjectList.begin() + objectIndex);
+         data.instanceCount--;
+         if (data.instanceCount <= 0)
+         {
+            freeBuffers(data);
+            mObjectList.erase(mObjectList.begin() + objectIndex);
+         }
          break;
       }
    }
 
+   mInteractionLayerStride = 1;
+
    updateGL();
 }
 
@@ -180,6 +214,7 @@ void VisualizerView::clearObjects()
       freeBuffers(data);
    }
    mObjectList.clear();
+   mInstanceList.clear();
 
    updateGL();
 }
@@ -217,51 +252,224 @@ void VisualizerView::setLayerDrawHeight(double height)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool VisualizerView::regenerateGeometry()
+bool VisualizerView::prepareGeometry()
 {
    bool result = true;
 
-   // Count the total number of layers that we are generating so we can
-   // properly estimate our progress bar.
+   // Count the total number of layers that we are still missing geometry
+   // for so we can properly estimate our progress bar.
    int maxProgress = 0;
    int objectCount = (int)mObjectList.size();
    for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
    {
       VisualizerObjectData& objectData = mObjectList[objectIndex];
-      maxProgress += objectData.object->getLayerCount() - 1;
-   }
+      int layerCount = (int)objectData.data->layers.size() - 1;
 
-   if (mPrefs.useDisplayLists)
-   {
-      maxProgress *= 3;
-   }
-   else
-   {
-      maxProgress *= 2;
+      const VisualizerGeometryData* geometry = findGeometry(objectData, mPrefs.drawQuality, mPrefs.layerSkipSize);
+      if (!geometry)
+      {
+         maxProgress += layerCount * 2;
+      }
+
+      if (mPrefs.useDisplayLists && (!geometry || !geometry->hasDisplayLists))
+      {
+         maxProgress += layerCount;
+      }
+
+      // Anything higher than our lowest quality also keeps a line
+      // representation around to draw while the camera is moving.
+      if (mPrefs.drawQuality != DRAW_QUALITY_LOW &&
+         !findGeometry(objectData, DRAW_QUALITY_LOW, mPrefs.layerSkipSize))
+      {
+         maxProgress += layerCount * 2;
+      }
    }
 
    QProgressDialog progressDialog("Generating Geometry...", 0, 0, maxProgress, this);
    progressDialog.setWindowModality(Qt::WindowModal);
    progressDialog.setFixedSize(progressDialog.sizeHint());
-   progressDialog.show();
+   if (maxProgress > 0)
+   {
+      progressDialog.show();
+   }
+
+   mGeometryUseCounter++;
 
    for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
    {
       VisualizerObjectData& objectData = mObjectList[objectIndex];
-      result &= generateGeometry(objectData, progressDialog);
+
+      if (mPrefs.drawQuality != DRAW_QUALITY_LOW)
+      {
+         VisualizerGeometryData* interaction = ensureGeometry(objectData, DRAW_QUALITY_LOW, mPrefs.layerSkipSize, progressDialog);
+         if (!interaction)
+         {
+            result = false;
+            continue;
+         }
+         interaction->lastUsed = mGeometryUseCounter;
+      }
+
+      VisualizerGeometryData* geometry = ensureGeometry(objectData, mPrefs.drawQuality, mPrefs.layerSkipSize, progressDialog);
+      if (!geometry)
+      {
+         result = false;
+         continue;
+      }
+      geometry->lastUsed = mGeometryUseCounter;
+
+      // Only the geometry we are drawing keeps its display lists.
+      int geometryCount = (int)objectData.geometry.size();
+      for (int geometryIndex = 0; geometryIndex < geometryCount; ++geometryIndex)
+      {
+         VisualizerGeometryData& other = objectData.geometry[geometryIndex];
+         if (&other != geometry || !mPrefs.useDisplayLists)
+         {
+            freeDisplayLists(other);
+         }
+      }
 
       // If we are using display lists, then generate our display lists.
-      if (mPrefs.useDisplayLists)
+      if (mPrefs.useDisplayLists && !geometry->hasDisplayLists)
       {
-         result &= genObject(objectData, progressDialog);
+         result &= genObject(*geometry, progressDialog);
       }
    }
 
+   // Now that everything we need is built, throw away whatever
+   // no longer fits within our cache.
+   trimGeometryCache();
+
+   mInteractionLayerStride = 1;
+
    updateGL();
 
    return result;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+unsigned long long VisualizerView::getGeometryMemoryUsage(DrawQuality quality) const
+{
+   unsigned long long bytes = 0;
+
+   int objectCount = (int)mObjectList.size();
+   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   {
+      const VisualizerGeometryData* geometry = findGeometry(mObjectList[objectIndex], quality, mPrefs.layerSkipSize);
+      if (geometry)
+      {
+         bytes += geometry->getMemoryUsage();
+      }
+   }
+
+   return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::getMemoryUsage(const GCodeObject* object, MemoryUsage& usage) const
+{
+   int objectCount = (int)mObjectList.size();
+   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   {
+      const VisualizerObjectData& objectData = mObjectList[objectIndex];
+      if (objectData.data != object->getData())
+      {
+         continue;
+      }
+
+      int geometryCount = (int)objectData.geometry.size();
+      for (int geometryIndex = 0; geometryIndex < geometryCount; ++geometryIndex)
+      {
+         objectData.geometry[geometryIndex].getMemoryUsage(usage);
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned long long VisualizerView::estimateGeometryMemory(DrawQuality quality, int layerSkipSize) const
+{
+   unsigned long long bytes = 0;
+
+   int objectCount = (int)mObjectList.size();
+   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   {
+      const VisualizerObjectData& objectData = mObjectList[objectIndex];
+
+      // Our low quality lines are kept as well for drawing while the camera moves.
+      DrawQuality tiers[2] = {quality, DRAW_QUALITY_LOW};
+      int tierCount = quality == DRAW_QUALITY_LOW? 1: 2;
+      for (int tierIndex = 0; tierIndex < tierCount; ++tierIndex)
+      {
+         DrawQuality tierQuality = tiers[tierIndex];
+
+         const VisualizerGeometryData* geometry = findGeometry(objectData, tierQuality, layerSkipSize);
+         if (geometry)
+         {
+            bytes += geometry->getMemoryUsage();
+            continue;
+         }
+
+         MemoryUsage usage;
+         estimateGeometryUsage(*objectData.data, tierQuality, layerSkipSize, false, usage);
+         bytes += usage.getTotal();
+      }
+   }
+
+   return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::estimateGeometryUsage(const GCodeObjectData& data, DrawQuality quality, int layerSkipSize, bool useDisplayLists, MemoryUsage& usage)
+{
+   std::vector<VisualizerBufferData> layers;
+   countGeometry(data, quality, layerSkipSize, layers);
+
+   int layerCount = (int)layers.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      const VisualizerBufferData& buffer = layers[layerIndex];
+
+      // This matches the buffers generateGeometry allocates for each quality.
+      unsigned long long vertexBytes = (unsigned long long)buffer.vertexCount * 3 * sizeof(double);
+      usage.vertexBuffers += vertexBytes;
+      if (quality != DRAW_QUALITY_LOW)
+      {
+         usage.normalBuffers += vertexBytes;
+      }
+      if (quality == DRAW_QUALITY_MED)
+      {
+         usage.indexBuffers += (unsigned long long)buffer.quadCount * 4 * sizeof(unsigned int);
+      }
+
+      if (useDisplayLists)
+      {
+         usage.displayLists += (unsigned long long)buffer.vertexCount * 3 * sizeof(float) * (quality != DRAW_QUALITY_LOW? 2: 1);
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::snapCamera()
+{
+   for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+   {
+      mCameraRot[axis] = mCameraRotTarget[axis];
+      mCameraTrans[axis] = mCameraTransTarget[axis];
+   }
+
+   mCameraZoom = mCameraZoomTarget;
+   mInteracting = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::renderFrame()
+{
+   makeCurrent();
+   resizeGL(width(), height());
+   paintGL();
+   glFinish();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 const QString& VisualizerView::getError() const
 {
@@ -358,6 +566,13 @@ void VisualizerView::updateTick()
 {
    if (updateCamera())
    {
+      mInteracting = true;
+      updateGL();
+   }
+   else if (mInteracting)
+   {
+      // The camera has settled, so draw one more frame at full quality.
+      mInteracting = false;
       updateGL();
    }
 }
@@ -423,20 +638,25 @@ bool VisualizerView::updateCamera()
    bool changed = false;
    double dist = 0.0;
 
-   // Update camera translation towards target.
+   // Update camera translation towards target.  Once we are close enough
+   // we snap to the target, otherwise we would keep creeping towards it
+   // forever and never be able to tell that the camera has settled.
    for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
    {
       dist = mCameraRotTarget[axis] - mCameraRot[axis];
       if (dist) changed = true;
-      mCameraRot[axis] += dist / 4.0;
+      if (fabs(dist) < CAMERA_SETTLE_DISTANCE) mCameraRot[axis] = mCameraRotTarget[axis];
+      else                                     mCameraRot[axis] += dist / 4.0;
 
-      dist = (mCameraTransTarget[axis] - mCameraTrans[axis]) / 2.0;
+      dist = mCameraTransTarget[axis] - mCameraTrans[axis];
       if (dist) changed = true;
-      mCameraTrans[axis] += dist;
+      if (fabs(dist) < CAMERA_SETTLE_DISTANCE) mCameraTrans[axis] = mCameraTransTarget[axis];
+      else                                     mCameraTrans[axis] += dist / 2.0;
    }
-   dist = (mCameraZoomTarget - mCameraZoom) / 2.0;
+   dist = mCameraZoomTarget - mCameraZoom;
    if (dist) changed = true;
-   mCameraZoom += dist;
+   if (fabs(dist) < CAMERA_SETTLE_DISTANCE) mCameraZoom = mCameraZoomTarget;
+   else                                     mCameraZoom += dist / 2.0;
 
    return changed;
 }
@@ -444,7 +664,13 @@ bool VisualizerView::updateCamera()
 ////////////////////////////////////////////////////////////////////////////////
 void VisualizerView::paintGL()
 {
-   updateCamera();
+   if (updateCamera())
+   {
+      mInteracting = true;
+   }
+
+   QTime frameTime;
+   frameTime.start();
 
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
    glLoadIdentity();
@@ -460,21 +686,59 @@ void VisualizerView::paintGL()
    // Apply camera translation.
    glTranslatef(-mCameraTrans[X], -mCameraTrans[Y], -mCameraTrans[Z]);
 
-   int objectCount = (int)mObjectList.size();
-   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   // While the camera is moving we draw our low quality lines instead.
+   DrawQuality quality = mInteracting? DRAW_QUALITY_LOW: mPrefs.drawQuality;
+
+   int instanceCount = (int)mInstanceList.size();
+   for (int instanceIndex = 0; instanceIndex < instanceCount; ++instanceIndex)
    {
-      if (mPrefs.useDisplayLists)
+      const GCodeObject* object = mInstanceList[instanceIndex];
+      const VisualizerObjectData* objectData = findObjectData(object->getData());
+      if (!objectData)
       {
-         callObject(mObjectList[objectIndex]);
+         continue;
+      }
+
+      const VisualizerGeometryData* geometry = findGeometry(*objectData, quality, mPrefs.layerSkipSize);
+      if (!geometry)
+      {
+         continue;
+      }
+
+      if (mInteracting)
+      {
+         drawInteractionObject(*object, *geometry);
+      }
+      else if (geometry->hasDisplayLists)
+      {
+         callObject(*object, *geometry);
       }
       else
       {
-         drawObject(mObjectList[objectIndex]);
+         drawObject(*object, *geometry);
       }
    }
 
    drawPlatform();
    glPopMatrix();
+
+   if (mInteracting)
+   {
+      // Wait for the frame to finish so we know how long it really took,
+      // then adjust how many layers we draw while the camera is moving
+      // so we can stay within our frame time.
+      glFinish();
+
+      int elapsed = frameTime.elapsed();
+      if (elapsed > INTERACTION_FRAME_TIME && mInteractionLayerStride < MAX_INTERACTION_LAYER_STRIDE)
+      {
+         mInteractionLayerStride *= 2;
+      }
+      else if (elapsed < INTERACTION_FRAME_TIME / 4 && mInteractionLayerStride > 1)
+      {
+         mInteractionLayerStride /= 2;
+      }
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -631,12 +895,14 @@ void VisualizerView::drawPlatform()
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& progressDialog)
+bool VisualizerView::genObject(VisualizerGeometryData& geometry, QProgressDialog& progressDialog)
 {
+   TRACE_SPAN("VisualizerView::genObject");
+
    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
    glPushAttrib(GL_LIGHTING_BIT);
 
-   switch (mPrefs.drawQuality)
+   switch (geometry.quality)
    {
    case DRAW_QUALITY_LOW:
       {
@@ -644,10 +910,10 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
 
          glLineWidth(1.0f);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            VisualizerBufferData& buffer = object.layers[layerIndex];
+            VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
             buffer.displayListIndex = glGenLists(1);
 
@@ -663,7 +929,7 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
             glEndList();
 
             // Increment our progress bar.
-            progressDialog.setValue(progressDialog.value() + 1 + mPrefs.layerSkipSize);
+            progressDialog.setValue(progressDialog.value() + 1 + geometry.layerSkipSize);
          }
       }
       break;
@@ -679,10 +945,10 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
          glEnableClientState(GL_VERTEX_ARRAY);
          glEnableClientState(GL_NORMAL_ARRAY);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            VisualizerBufferData& buffer = object.layers[layerIndex];
+            VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
             buffer.displayListIndex = glGenLists(1);
 
@@ -699,7 +965,7 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
             glEndList();
 
             // Increment our progress bar.
-            progressDialog.setValue(progressDialog.value() + 1 + mPrefs.layerSkipSize);
+            progressDialog.setValue(progressDialog.value() + 1 + geometry.layerSkipSize);
          }
       }
       break;
@@ -715,10 +981,10 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
          glEnableClientState(GL_VERTEX_ARRAY);
          glEnableClientState(GL_NORMAL_ARRAY);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            VisualizerBufferData& buffer = object.layers[layerIndex];
+            VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
             buffer.displayListIndex = glGenLists(1);
 
@@ -735,7 +1001,7 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
             glEndList();
 
             // Increment our progress bar.
-            progressDialog.setValue(progressDialog.value() + 1 + mPrefs.layerSkipSize);
+            progressDialog.setValue(progressDialog.value() + 1 + geometry.layerSkipSize);
          }
       }
       break;
@@ -744,20 +1010,21 @@ bool VisualizerView::genObject(VisualizerObjectData& object, QProgressDialog& pr
    glPopAttrib();
    glPopClientAttrib();
 
+   geometry.hasDisplayLists = true;
    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void VisualizerView::callObject(const VisualizerObjectData& object)
+void VisualizerView::callObject(const GCodeObject& object, const VisualizerGeometryData& geometry)
 {
    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
    glPushAttrib(GL_LIGHTING_BIT);
    glPushMatrix();
 
-   const double* offset = object.object->getOffsetPos();
+   const double* offset = object.getOffsetPos();
    glTranslated(offset[0], offset[1], offset[2]);
 
-   int extruderIndex = object.object->getExtruder();
+   int extruderIndex = object.getExtruder();
    if (extruderIndex < 0 || extruderIndex >= (int)mPrefs.extruderList.size())
    {
       // Default to extruder index 0 if our desired index is out of bounds.
@@ -770,7 +1037,7 @@ void VisualizerView::callObject(const VisualizerObjectData& object)
              1.0);
 
 
-   switch (mPrefs.drawQuality)
+   switch (geometry.quality)
    {
    case DRAW_QUALITY_LOW:
       {
@@ -778,15 +1045,15 @@ void VisualizerView::callObject(const VisualizerObjectData& object)
 
          glLineWidth(1.0f);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            const VisualizerBufferData& buffer = object.layers[layerIndex];
+            const VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
-            if (buffer.height + object.object->getOffsetPos()[Z] <= mLayerDrawHeight)
+            if (buffer.height + object.getOffsetPos()[Z] <= mLayerDrawHeight)
             {
                // If this layer is at the top, render it with a slightly darker color.
-               if (layerIndex < layerCount - 1 && buffer.height + object.object->getOffsetPos()[Z] > mLayerDrawHeight - object.object->getAverageLayerHeight())
+               if (layerIndex < layerCount - 1 && buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight - object.getAverageLayerHeight())
                {
                   QColor darker = mPrefs.extruderList[extruderIndex].color.dark();
                   glColor4d(darker.redF(), darker.greenF(), darker.blueF(), 1.0);
@@ -813,15 +1080,15 @@ void VisualizerView::callObject(const VisualizerObjectData& object)
          glEnableClientState(GL_VERTEX_ARRAY);
          glEnableClientState(GL_NORMAL_ARRAY);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            const VisualizerBufferData& buffer = object.layers[layerIndex];
+            const VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
-            if (buffer.height + object.object->getOffsetPos()[Z] <= mLayerDrawHeight)
+            if (buffer.height + object.getOffsetPos()[Z] <= mLayerDrawHeight)
             {
                // If this layer is at the top, render it with a slightly darker color.
-               if (layerIndex < layerCount - 1 && buffer.height + object.object->getOffsetPos()[Z] > mLayerDrawHeight - object.object->getAverageLayerHeight())
+               if (layerIndex < layerCount - 1 && buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight - object.getAverageLayerHeight())
                {
                   QColor darker = mPrefs.extruderList[extruderIndex].color.dark();
                   glColor4d(darker.redF(), darker.greenF(), darker.blueF(), 1.0);
@@ -848,15 +1115,15 @@ void VisualizerView::callObject(const VisualizerObjectData& object)
          glEnableClientState(GL_VERTEX_ARRAY);
          glEnableClientState(GL_NORMAL_ARRAY);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            const VisualizerBufferData& buffer = object.layers[layerIndex];
+            const VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
-            if (buffer.height + object.object->getOffsetPos()[Z] <= mLayerDrawHeight)
+            if (buffer.height + object.getOffsetPos()[Z] <= mLayerDrawHeight)
             {
                // If this layer is at the top, render it with a slightly darker color.
-               if (layerIndex < layerCount - 1 && buffer.height + object.object->getOffsetPos()[Z] > mLayerDrawHeight - object.object->getAverageLayerHeight())
+               if (layerIndex < layerCount - 1 && buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight - object.getAverageLayerHeight())
                {
                   QColor darker = mPrefs.extruderList[extruderIndex].color.dark();
                   glColor4d(darker.redF(), darker.greenF(), darker.blueF(), 1.0);
@@ -879,16 +1146,16 @@ void VisualizerView::callObject(const VisualizerObjectData& object)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void VisualizerView::drawObject(const VisualizerObjectData& object)
+void VisualizerView::drawObject(const GCodeObject& object, const VisualizerGeometryData& geometry)
 {
    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
    glPushAttrib(GL_LIGHTING_BIT);
    glPushMatrix();
 
-   const double* offset = object.object->getOffsetPos();
+   const double* offset = object.getOffsetPos();
    glTranslated(offset[0], offset[1], offset[2]);
 
-   int extruderIndex = object.object->getExtruder();
+   int extruderIndex = object.getExtruder();
    if (extruderIndex < 0 || extruderIndex >= (int)mPrefs.extruderList.size())
    {
       // Default to extruder index 0 if our desired index is out of bounds.
@@ -900,7 +1167,7 @@ void VisualizerView::drawObject(const VisualizerObjectData& object)
       mPrefs.extruderList[extruderIndex].color.blueF(),
       1.0);
 
-   switch (mPrefs.drawQuality)
+   switch (geometry.quality)
    {
    case DRAW_QUALITY_LOW:
       {
@@ -908,15 +1175,15 @@ void VisualizerView::drawObject(const VisualizerObjectData& object)
 
          glLineWidth(1.0f);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            const VisualizerBufferData& buffer = object.layers[layerIndex];
+            const VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
-            if (buffer.height + object.object->getOffsetPos()[Z] <= mLayerDrawHeight)
+            if (buffer.height + object.getOffsetPos()[Z] <= mLayerDrawHeight)
             {
                // If this layer is at the top, render it with a slightly darker color.
-               if (layerIndex < layerCount - 1 && buffer.height + object.object->getOffsetPos()[Z] > mLayerDrawHeight - object.object->getAverageLayerHeight())
+               if (layerIndex < layerCount - 1 && buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight - object.getAverageLayerHeight())
                {
                   QColor darker = mPrefs.extruderList[extruderIndex].color.dark();
                   glColor4d(darker.redF(), darker.greenF(), darker.blueF(), 1.0);
@@ -943,15 +1210,15 @@ void VisualizerView::drawObject(const VisualizerObjectData& object)
          glEnableClientState(GL_VERTEX_ARRAY);
          glEnableClientState(GL_NORMAL_ARRAY);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            const VisualizerBufferData& buffer = object.layers[layerIndex];
+            const VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
-            if (buffer.height + object.object->getOffsetPos()[Z] <= mLayerDrawHeight)
+            if (buffer.height + object.getOffsetPos()[Z] <= mLayerDrawHeight)
             {
                // If this layer is at the top, render it with a slightly darker color.
-               if (layerIndex < layerCount - 1 && buffer.height + object.object->getOffsetPos()[Z] > mLayerDrawHeight - object.object->getAverageLayerHeight())
+               if (layerIndex < layerCount - 1 && buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight - object.getAverageLayerHeight())
                {
                   QColor darker = mPrefs.extruderList[extruderIndex].color.dark();
                   glColor4d(darker.redF(), darker.greenF(), darker.blueF(), 1.0);
@@ -979,15 +1246,15 @@ void VisualizerView::drawObject(const VisualizerObjectData& object)
          glEnableClientState(GL_VERTEX_ARRAY);
          glEnableClientState(GL_NORMAL_ARRAY);
 
-         int layerCount = (int)object.layers.size();
+         int layerCount = (int)geometry.layers.size();
          for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
          {
-            const VisualizerBufferData& buffer = object.layers[layerIndex];
+            const VisualizerBufferData& buffer = geometry.layers[layerIndex];
 
-            if (buffer.height + object.object->getOffsetPos()[Z] <= mLayerDrawHeight)
+            if (buffer.height + object.getOffsetPos()[Z] <= mLayerDrawHeight)
             {
                // If this layer is at the top, render it with a slightly darker color.
-               if (layerIndex < layerCount - 1 && buffer.height + object.object->getOffsetPos()[Z] > mLayerDrawHeight - object.object->getAverageLayerHeight())
+               if (layerIndex < layerCount - 1 && buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight - object.getAverageLayerHeight())
                {
                   QColor darker = mPrefs.extruderList[extruderIndex].color.dark();
                   glColor4d(darker.redF(), darker.greenF(), darker.blueF(), 1.0);
@@ -1011,116 +1278,108 @@ void VisualizerView::drawObject(const VisualizerObjectData& object)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-bool VisualizerView::generateGeometry(VisualizerObjectData& data, QProgressDialog& progressDialog)
+void VisualizerView::drawInteractionObject(const GCodeObject& object, const VisualizerGeometryData& geometry)
 {
-   if (!data.object)
+   const std::vector<VisualizerBufferData>& layers = geometry.layers;
+
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glPushAttrib(GL_LIGHTING_BIT);
+   glPushMatrix();
+
+   const double* offset = object.getOffsetPos();
+   glTranslated(offset[0], offset[1], offset[2]);
+
+   int extruderIndex = object.getExtruder();
+   if (extruderIndex < 0 || extruderIndex >= (int)mPrefs.extruderList.size())
    {
-      mError = "No object to generate geometry for.";
-      return false;
+      // Default to extruder index 0 if our desired index is out of bounds.
+      extruderIndex = 0;
    }
 
-   freeBuffers(data);
+   glColor4d(mPrefs.extruderList[extruderIndex].color.redF(),
+      mPrefs.extruderList[extruderIndex].color.greenF(),
+      mPrefs.extruderList[extruderIndex].color.blueF(),
+      1.0);
 
-   // Before we can allocate memory for our vertex buffers, we first need to
-   // determine exactly how many vertices we need.
-   int skipCount = mPrefs.layerSkipSize + 1;
-   double lastE = 0.0;
-   int levelCount = data.object->getLayerCount();
-   for (int levelIndex = 1; levelIndex < levelCount; ++levelIndex)
+   glEnableClientState(GL_VERTEX_ARRAY);
+
+   glLineWidth(1.0f);
+
+   int layerCount = (int)layers.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      const LayerData& layerData = data.object->getLayer(levelIndex);
+      const VisualizerBufferData& buffer = layers[layerIndex];
 
-      // Skip layers if necessary.
-      if (mPrefs.layerSkipSize > 0)
+      if (buffer.height + object.getOffsetPos()[Z] > mLayerDrawHeight)
       {
-         skipCount++;
-
-         if (skipCount <= mPrefs.layerSkipSize)
-         {
-            continue;
-         }
+         break;
+      }
 
-         skipCount = 0;
+      // Only every few layers are drawn on large scenes, but we always
+      // want the top most visible layer so the outline stays intact.
+      bool topLayer = layerIndex == layerCount - 1 ||
+         layers[layerIndex + 1].height + object.getOffsetPos()[Z] > mLayerDrawHeight;
+      if (layerIndex % mInteractionLayerStride != 0 && !topLayer)
+      {
+         continue;
       }
 
-      VisualizerBufferData buffer;
-      buffer.height = layerData.height;
+      glVertexPointer(3, GL_DOUBLE, 0, buffer.vertexBuffer);
+      glDrawArrays(GL_LINES, 0, buffer.vertexCount);
+   }
 
-      const std::vector<GCodeCommand>& codes = layerData.codes;
+   glPopMatrix();
+   glPopAttrib();
+   glPopClientAttrib();
+}
 
-      int codeCount = (int)codes.size();
-      for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
-      {
-         const GCodeCommand& code = codes[codeIndex];
+////////////////////////////////////////////////////////////////////////////////
+bool VisualizerView::generateGeometry(VisualizerObjectData& data, VisualizerGeometryData& geometry, QProgressDialog& progressDialog)
+{
+   TRACE_SPAN("VisualizerView::generateGeometry");
 
-         if (code.hasAxis)
-         {
-            // We only draw a line segment if we are extruding filament on this line.
-            if (code.axisValue[E] != 0.0 && lastE + code.axisValue[E] > 0.0)
-            {
-               switch (mPrefs.drawQuality)
-               {
-               case DRAW_QUALITY_LOW:
-                  {
-                     // The line segment will consist of a single line between two points.
-                     buffer.vertexCount += 2;
-                  }
-                  break;
-               case DRAW_QUALITY_MED:
-                  {
-                     // The line segment will consist of 8 points that
-                     // form together to make two flat quads.
-                     buffer.vertexCount += 8;
-                     buffer.quadCount += 4;
-                  }
-                  break;
-               case DRAW_QUALITY_HIGH:
-                  {
-                     // The line segment will consist of four quads, each
-                     // using their own four points so they can have their
-                     // own normal values.
-                     buffer.vertexCount += 4 * 4;
-                  }
-                  break;
-               }
-            }
+   if (!data.data)
+   {
+      mError = "No object to generate geometry for.";
+      return false;
+   }
 
-            lastE += code.axisValue[E];
-            if (lastE > 0.0)
-            {
-               lastE = 0.0;
-            }
-         }
-      }
+   freeBuffers(geometry.layers);
 
-      // Increment our progress bar.
-      progressDialog.setValue(progressDialog.value() + 1 + mPrefs.layerSkipSize);
+   DrawQuality quality = geometry.quality;
+   int layerSkipSize = geometry.layerSkipSize;
+   std::vector<VisualizerBufferData>& layers = geometry.layers;
 
-      data.layers.push_back(buffer);
-   }
+   // Before we can allocate memory for our vertex buffers, we first need to
+   // determine exactly how many vertices we need.
+   countGeometry(*data.data, quality, layerSkipSize, layers);
 
-   if (data.layers.size() > 0)
+   // Increment our progress bar.
+   int levelCount = (int)data.data->layers.size();
+   progressDialog.setValue(progressDialog.value() + levelCount - 1);
+
+   if (layers.size() > 0)
    {
-      skipCount = mPrefs.layerSkipSize + 1;
+      int skipCount = layerSkipSize + 1;
 
-      double radius = data.object->getAverageLayerHeight() * 0.5;
-      QVector3D up = QVector3D(0.0, 0.0, 1.0);
+      double radius = data.data->averageLayerHeight * 0.5;
 
-      double lastPos[AXIS_NUM] = {0.0,};
+      double lastPos[AXIS_NUM_NO_E] = {0.0,};
+      qint64 lastE = 0;
 
       // Now fill in our newly allocated buffer space.
       int bufferIndex = 0;
 
       for (int levelIndex = 1; levelIndex < levelCount; ++levelIndex)
       {
-         const LayerData& layerData = data.object->getLayer(levelIndex);
+         const LayerData& layerData = data.data->layers[levelIndex];
 
          // Skip layers if necessary.
-         if (mPrefs.layerSkipSize > 0)
+         if (layerSkipSize > 0)
          {
             skipCount++;
 
-            if (skipCount <= mPrefs.layerSkipSize)
+            if (skipCount <= layerSkipSize)
             {
                continue;
             }
@@ -1128,18 +1387,18 @@ bool VisualizerView::generateGeometry(VisualizerObjectData& data, QProgressDialo
             skipCount = 0;
          }
 
-         if (bufferIndex >= (int)data.layers.size())
+         if (bufferIndex >= (int)layers.size())
          {
             mError = "Failed to configure enough layers.";
             return false;
          }
 
-         VisualizerBufferData& buffer = data.layers[bufferIndex++];
+         VisualizerBufferData& buffer = layers[bufferIndex++];
 
          // Allocate memory for this layer.
          try
          {
-            switch (mPrefs.drawQuality)
+            switch (quality)
             {
             case DRAW_QUALITY_MED:
                {
@@ -1158,7 +1417,7 @@ bool VisualizerView::generateGeometry(VisualizerObjectData& data, QProgressDialo
          catch (...)
          {
             mError = "Memory allocation error.";
-            data.layers.erase(data.layers.begin() + bufferIndex - 1, data.layers.end());
+            layers.erase(layers.begin() + bufferIndex - 1, layers.end());
             return false;
          }
 
@@ -1175,170 +1434,50 @@ bool VisualizerView::generateGeometry(VisualizerObjectData& data, QProgressDialo
             if (code.hasAxis)
             {
                // We only draw a line segment if we are extruding filament on this line.
-               if (code.axisValue[E] != 0.0 && lastPos[E] + code.axisValue[E] > 0.0)
+               if (code.axisValue[E] != 0 && lastE + code.axisValue[E] > 0)
                {
                   QVector3D p1 = QVector3D(lastPos[X], lastPos[Y], lastPos[Z]);
-                  QVector3D p2 = QVector3D(code.axisValue[X], code.axisValue[Y], code.axisValue[Z]);
+                  QVector3D p2 = QVector3D(fromFixed(code.axisValue[X], X), fromFixed(code.axisValue[Y], Y), fromFixed(code.axisValue[Z], Z));
 
-                  switch (mPrefs.drawQuality)
+                  // Arcs are only broken into segments here, as finely as our quality needs.
+                  if (code.type == GCODE_CW_ARC || code.type == GCODE_CCW_ARC)
                   {
-                  case DRAW_QUALITY_LOW:
-                     {
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2);
-                     }
-                     break;
-
-                  case DRAW_QUALITY_MED:
+                     int segmentCount = getArcSegmentCount(code, lastPos, quality);
+                     for (int segmentIndex = 1; segmentIndex <= segmentCount; ++segmentIndex)
                      {
-                        // Set up a rotation matrix
-                        QMatrix4x4 rot;
-                        rot.lookAt(p2 - p1, QVector3D(0.0, 0.0, 0.0), up);
-
-                        QVector3D right;
-                        right.setX(1.0);
-                        right = right * rot;
-
-                        QVector3D vec = (p2 - p1).normalized();
-                        QVector3D norm;
-
-                        int vertexIndex = pointIndex / 3;
-
-                        // Generate our quads.
-                        // Left
-                        buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_TOP_LEFT;
-                        buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_BOT_LEFT;
-                        buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_BOT_LEFT;
-                        buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_TOP_LEFT;
-                        quadIndex += 4;
-
-                        // Top
-                        buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_TOP_RIGHT;
-                        buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_TOP_LEFT;
-                        buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_TOP_LEFT;
-                        buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_TOP_RIGHT;
-                        quadIndex += 4;
-
-                        // Right
-                        buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_BOT_RIGHT;
-                        buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_TOP_RIGHT;
-                        buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_TOP_RIGHT;
-                        buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_BOT_RIGHT;
-                        quadIndex += 4;
-
-                        // Bottom
-                        buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_BOT_LEFT;
-                        buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_BOT_RIGHT;
-                        buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_BOT_RIGHT;
-                        buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_BOT_LEFT;
-                        quadIndex += 4;
-
-                        // Generate our 8 vertices for this rectangle segment.
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius - right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius + right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius - right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius + right * radius - vec * radius);
-
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 - right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 + right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 - right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 + right * radius + vec * radius);
-
-                        // Generate our 8 vertex normal values.
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up - right - vec).normalized());
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up + right - vec).normalized());
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up - right - vec).normalized());
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up + right - vec).normalized());
-
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up - right + vec).normalized());
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up + right + vec).normalized());
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up - right + vec).normalized());
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up + right + vec).normalized());
-                     }
-                     break;
+                        double point[AXIS_NUM_NO_E];
+                        getArcPoint(code, lastPos, (double)segmentIndex / segmentCount, point);
 
-                  case DRAW_QUALITY_HIGH:
-                     {
-                        // Set up a rotation matrix
-                        QMatrix4x4 rot;
-                        rot.lookAt(p2 - p1, QVector3D(0.0, 0.0, 0.0), up);
-
-                        QVector3D right;
-                        right.setX(1.0);
-                        right = right * rot;
-
-                        QVector3D vec = (p2 - p1).normalized();
-                        QVector3D norm;
-
-                        int vertexIndex = pointIndex / 3;
-
-                        // Left.
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius - right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius - right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 - right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 - right * radius + vec * radius);
-
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
-
-                        // Top.
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius + right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius - right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 - right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 + right * radius + vec * radius);
-
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
-
-                        // Right.
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius + right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius + right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 + right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 + right * radius + vec * radius);
-
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
-
-                        // Bottom.
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius - right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius + right * radius - vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 + right * radius + vec * radius);
-                        addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 - right * radius + vec * radius);
-
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
-                        addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
+                        QVector3D segmentEnd = segmentIndex < segmentCount? QVector3D(point[X], point[Y], point[Z]): p2;
+                        addGeometrySegment(buffer, quality, p1, segmentEnd, radius, pointIndex, normalIndex, quadIndex);
+                        p1 = segmentEnd;
                      }
-                     break;
+                  }
+                  else
+                  {
+                     addGeometrySegment(buffer, quality, p1, p2, radius, pointIndex, normalIndex, quadIndex);
                   }
                }
 
                for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
                {
-                  lastPos[axis] = code.axisValue[axis];
+                  lastPos[axis] = fromFixed(code.axisValue[axis], axis);
                }
 
-               lastPos[E] += code.axisValue[E];
-               if (lastPos[E] > 0.0)
+               lastE += code.axisValue[E];
+               if (lastE > 0)
                {
-                  lastPos[E] = 0.0;
+                  lastE = 0;
                }
             }
          }
 
          // Increment our progress bar.
-         progressDialog.setValue(progressDialog.value() + 1 + mPrefs.layerSkipSize);
+         progressDialog.setValue(progressDialog.value() + 1 + layerSkipSize);
 
          // Just a simple check to make sure we actually used the proper number of vertices.
          if (buffer.vertexCount * 3 != pointIndex ||
-             (mPrefs.drawQuality != DRAW_QUALITY_LOW &&
+             (quality != DRAW_QUALITY_LOW &&
              (buffer.vertexCount * 3 != normalIndex ||
              buffer.quadCount * 4 != quadIndex)))
          {
@@ -1351,6 +1490,240 @@ bool VisualizerView::generateGeometry(VisualizerObjectData& data, QProgressDialo
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::addGeometrySegment(VisualizerBufferData& buffer, DrawQuality quality, const QVector3D& p1, const QVector3D& p2, double radius, int& pointIndex, int& normalIndex, int& quadIndex)
+{
+   QVector3D up = QVector3D(0.0, 0.0, 1.0);
+
+   switch (quality)
+   {
+   case DRAW_QUALITY_LOW:
+      {
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2);
+      }
+      break;
+
+   case DRAW_QUALITY_MED:
+      {
+         // Set up a rotation matrix
+         QMatrix4x4 rot;
+         rot.lookAt(p2 - p1, QVector3D(0.0, 0.0, 0.0), up);
+
+         QVector3D right;
+         right.setX(1.0);
+         right = right * rot;
+
+         QVector3D vec = (p2 - p1).normalized();
+         QVector3D norm;
+
+         int vertexIndex = pointIndex / 3;
+
+         // Generate our quads.
+         // Left
+         buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_TOP_LEFT;
+         buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_BOT_LEFT;
+         buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_BOT_LEFT;
+         buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_TOP_LEFT;
+         quadIndex += 4;
+
+         // Top
+         buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_TOP_RIGHT;
+         buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_TOP_LEFT;
+         buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_TOP_LEFT;
+         buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_TOP_RIGHT;
+         quadIndex += 4;
+
+         // Right
+         buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_BOT_RIGHT;
+         buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_TOP_RIGHT;
+         buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_TOP_RIGHT;
+         buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_BOT_RIGHT;
+         quadIndex += 4;
+
+         // Bottom
+         buffer.indexBuffer[quadIndex + 0] = vertexIndex + POINT_FIRST_BOT_LEFT;
+         buffer.indexBuffer[quadIndex + 1] = vertexIndex + POINT_FIRST_BOT_RIGHT;
+         buffer.indexBuffer[quadIndex + 2] = vertexIndex + POINT_SECOND_BOT_RIGHT;
+         buffer.indexBuffer[quadIndex + 3] = vertexIndex + POINT_SECOND_BOT_LEFT;
+         quadIndex += 4;
+
+         // Generate our 8 vertices for this rectangle segment.
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius - right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius + right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius - right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius + right * radius - vec * radius);
+
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 - right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 + right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 - right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 + right * radius + vec * radius);
+
+         // Generate our 8 vertex normal values.
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up - right - vec).normalized());
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up + right - vec).normalized());
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up - right - vec).normalized());
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up + right - vec).normalized());
+
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up - right + vec).normalized());
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (up + right + vec).normalized());
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up - right + vec).normalized());
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, (-up + right + vec).normalized());
+      }
+      break;
+
+   case DRAW_QUALITY_HIGH:
+      {
+         // Set up a rotation matrix
+         QMatrix4x4 rot;
+         rot.lookAt(p2 - p1, QVector3D(0.0, 0.0, 0.0), up);
+
+         QVector3D right;
+         right.setX(1.0);
+         right = right * rot;
+
+         QVector3D vec = (p2 - p1).normalized();
+         QVector3D norm;
+
+         int vertexIndex = pointIndex / 3;
+
+         // Left.
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius - right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius - right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 - right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 - right * radius + vec * radius);
+
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -right);
+
+         // Top.
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius + right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius - right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 - right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 + right * radius + vec * radius);
+
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, up);
+
+         // Right.
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius + right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 + up * radius + right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 + up * radius * 0.95 + right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 + right * radius + vec * radius);
+
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, right);
+
+         // Bottom.
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius - right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p1 - up * radius + right * radius - vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 + right * radius + vec * radius);
+         addGeometryPoint(&buffer.vertexBuffer[pointIndex], pointIndex, p2 - up * radius * 0.95 - right * radius + vec * radius);
+
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
+         addGeometryPoint(&buffer.normalBuffer[normalIndex], normalIndex, -up);
+      }
+      break;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::countGeometry(const GCodeObjectData& data, DrawQuality quality, int layerSkipSize, std::vector<VisualizerBufferData>& layers)
+{
+   int skipCount = layerSkipSize + 1;
+   double lastPos[AXIS_NUM_NO_E] = {0.0,};
+   qint64 lastE = 0;
+   int levelCount = (int)data.layers.size();
+   for (int levelIndex = 1; levelIndex < levelCount; ++levelIndex)
+   {
+      const LayerData& layerData = data.layers[levelIndex];
+
+      // Skip layers if necessary.
+      if (layerSkipSize > 0)
+      {
+         skipCount++;
+
+         if (skipCount <= layerSkipSize)
+         {
+            continue;
+         }
+
+         skipCount = 0;
+      }
+
+      VisualizerBufferData buffer;
+      buffer.height = fromFixed(layerData.height, Z);
+
+      const std::vector<GCodeCommand>& codes = layerData.codes;
+
+      int codeCount = (int)codes.size();
+      for (int codeIndex = 0; codeIndex < codeCount; ++codeIndex)
+      {
+         const GCodeCommand& code = codes[codeIndex];
+
+         if (code.hasAxis)
+         {
+            // We only draw a line segment if we are extruding filament on this line.
+            if (code.axisValue[E] != 0 && lastE + code.axisValue[E] > 0)
+            {
+               int segmentCount = 1;
+               if (code.type == GCODE_CW_ARC || code.type == GCODE_CCW_ARC)
+               {
+                  segmentCount = getArcSegmentCount(code, lastPos, quality);
+               }
+
+               switch (quality)
+               {
+               case DRAW_QUALITY_LOW:
+                  {
+                     // The line segment will consist of a single line between two points.
+                     buffer.vertexCount += 2 * segmentCount;
+                  }
+                  break;
+               case DRAW_QUALITY_MED:
+                  {
+                     // The line segment will consist of 8 points that
+                     // form together to make two flat quads.
+                     buffer.vertexCount += 8 * segmentCount;
+                     buffer.quadCount += 4 * segmentCount;
+                  }
+                  break;
+               case DRAW_QUALITY_HIGH:
+                  {
+                     // The line segment will consist of four quads, each
+                     // using their own four points so they can have their
+                     // own normal values.
+                     buffer.vertexCount += 4 * 4 * segmentCount;
+                  }
+                  break;
+               }
+            }
+
+            for (int axis = 0; axis < AXIS_NUM_NO_E; ++axis)
+            {
+               lastPos[axis] = fromFixed(code.axisValue[axis], axis);
+            }
+
+            lastE += code.axisValue[E];
+            if (lastE > 0)
+            {
+               lastE = 0;
+            }
+         }
+      }
+
+      layers.push_back(buffer);
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void VisualizerView::addGeometryPoint(double* buffer, int& index, const QVector3D& point)
 {
@@ -1369,10 +1742,22 @@ void VisualizerView::addGeometryPoint(double* buffer, int& index, const QVector3
 ////////////////////////////////////////////////////////////////////////////////
 void VisualizerView::freeBuffers(VisualizerObjectData& data)
 {
-   int layerCount = (int)data.layers.size();
+   int geometryCount = (int)data.geometry.size();
+   for (int geometryIndex = 0; geometryIndex < geometryCount; ++geometryIndex)
+   {
+      freeBuffers(data.geometry[geometryIndex].layers);
+   }
+
+   data.geometry.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::freeBuffers(std::vector<VisualizerBufferData>& layers)
+{
+   int layerCount = (int)layers.size();
    for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
    {
-      VisualizerBufferData& buffer = data.layers[layerIndex];
+      VisualizerBufferData& buffer = layers[layerIndex];
 
       if (buffer.displayListIndex != GL_INVALID_VALUE)
       {
@@ -1382,7 +1767,151 @@ void VisualizerView::freeBuffers(VisualizerObjectData& data)
       buffer.free();
    }
 
-   data.layers.clear();
+   layers.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+VisualizerObjectData* VisualizerView::findObjectData(const GCodeObjectData* data)
+{
+   int objectCount = (int)mObjectList.size();
+   for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+   {
+      if (mObjectList[objectIndex].data == data)
+      {
+         return &mObjectList[objectIndex];
+      }
+   }
+
+   return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const VisualizerObjectData* VisualizerView::findObjectData(const GCodeObjectData* data) const
+{
+   return const_cast<VisualizerView*>(this)->findObjectData(data);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+VisualizerGeometryData* VisualizerView::findGeometry(VisualizerObjectData& data, DrawQuality quality, int layerSkipSize)
+{
+   int geometryCount = (int)data.geometry.size();
+   for (int geometryIndex = 0; geometryIndex < geometryCount; ++geometryIndex)
+   {
+      VisualizerGeometryData& geometry = data.geometry[geometryIndex];
+      if (geometry.quality == quality && geometry.layerSkipSize == layerSkipSize)
+      {
+         return &geometry;
+      }
+   }
+
+   return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const VisualizerGeometryData* VisualizerView::findGeometry(const VisualizerObjectData& data, DrawQuality quality, int layerSkipSize) const
+{
+   return const_cast<VisualizerView*>(this)->findGeometry(const_cast<VisualizerObjectData&>(data), quality, layerSkipSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+VisualizerGeometryData* VisualizerView::ensureGeometry(VisualizerObjectData& data, DrawQuality quality, int layerSkipSize, QProgressDialog& progressDialog)
+{
+   VisualizerGeometryData* existing = findGeometry(data, quality, layerSkipSize);
+   if (existing)
+   {
+      return existing;
+   }
+
+   VisualizerGeometryData geometry;
+   geometry.quality = quality;
+   geometry.layerSkipSize = layerSkipSize;
+
+   if (!generateGeometry(data, geometry, progressDialog))
+   {
+      freeBuffers(geometry.layers);
+      return NULL;
+   }
+
+   data.geometry.push_back(geometry);
+   return &data.geometry.back();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool VisualizerView::isGeometryInUse(const VisualizerGeometryData& geometry) const
+{
+   if (geometry.layerSkipSize != mPrefs.layerSkipSize)
+   {
+      return false;
+   }
+
+   // Our low quality geometry is always in use, either because it is our
+   // current draw quality or because we draw it while the camera moves.
+   return geometry.quality == mPrefs.drawQuality || geometry.quality == DRAW_QUALITY_LOW;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::trimGeometryCache()
+{
+   unsigned long long budget = (unsigned long long)mPrefs.geometryCacheSize * 1024 * 1024;
+
+   // Keep discarding the least recently used geometry that we are not
+   // currently drawing until everything else fits within our budget.
+   while (true)
+   {
+      unsigned long long cacheSize = 0;
+      VisualizerObjectData* oldestObject = NULL;
+      int oldestIndex = -1;
+
+      int objectCount = (int)mObjectList.size();
+      for (int objectIndex = 0; objectIndex < objectCount; ++objectIndex)
+      {
+         VisualizerObjectData& objectData = mObjectList[objectIndex];
+
+         int geometryCount = (int)objectData.geometry.size();
+         for (int geometryIndex = 0; geometryIndex < geometryCount; ++geometryIndex)
+         {
+            const VisualizerGeometryData& geometry = objectData.geometry[geometryIndex];
+            if (isGeometryInUse(geometry))
+            {
+               continue;
+            }
+
+            cacheSize += geometry.getMemoryUsage();
+
+            if (!oldestObject || geometry.lastUsed < oldestObject->geometry[oldestIndex].lastUsed)
+            {
+               oldestObject = &objectData;
+               oldestIndex = geometryIndex;
+            }
+         }
+      }
+
+      if (!oldestObject || cacheSize <= budget)
+      {
+         break;
+      }
+
+      freeBuffers(oldestObject->geometry[oldestIndex].layers);
+      oldestObject->geometry.erase(oldestObject->geometry.begin() + oldestIndex);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void VisualizerView::freeDisplayLists(VisualizerGeometryData& geometry)
+{
+   int layerCount = (int)geometry.layers.size();
+   for (int layerIndex = 0; layerIndex < layerCount; ++layerIndex)
+   {
+      VisualizerBufferData& buffer = geometry.layers[layerIndex];
+
+      if (buffer.displayListIndex != GL_INVALID_VALUE)
+      {
+         glDeleteLists(buffer.displayListIndex, 1);
+         buffer.displayListIndex = GL_INVALID_VALUE;
+      }
+   }
+
+   geometry.hasDisplayLists = false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////